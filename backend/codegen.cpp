@@ -1,103 +1,17 @@
 #include "backend/codegen.h"
 
 #include <algorithm>
-#include <sstream>
-#include <iostream>
-#include <iomanip>
 
 namespace cs160::backend {
 
-// Assembly instruction operands, short names
-struct Operand {
- virtual const std::string toString() const = 0;
-};
+// Registers, short names
+constexpr Reg EAX = Reg::EAX;
+constexpr Reg EDX = Reg::EDX;
+constexpr Reg ESP = Reg::ESP;
+constexpr Reg EBP = Reg::EBP;
+constexpr Reg AL = Reg::AL;
 
-// register
-struct R final : public Operand {
-  std::string value;
-
-  R(std::string v) : value(std::move(v)) {}
-
-  const std::string toString() const override {
-    return '\%' + value;
-  }
-};
-
-// label
-struct L final : public Operand {
-  std::string value;
-
-  L(std::string v) : value(std::move(v)) {}
-
-  const std::string toString() const override {
-    return value;
-  }
-};
-
-// pre-defined registers
-static const R EAX{"eax"};
-static const R EDX{"edx"};
-static const R ESP{"esp"};
-static const R EBP{"ebp"};
-
-// integer constant
-struct C final : public Operand {
-  int32_t value;
-
-  C(int32_t v) : value(v) {}
-
-  const std::string toString() const override {
-    return '$' + std::to_string(value);
-  }
-};
-
-// unsigned integer constant, printed in hexadecimal for easier reading
-struct H final : public Operand {
-  uint32_t value;
-
-  H(uint32_t v) : value(v) {}
-
-  const std::string toString() const override {
-    std::ostringstream s;
-    s << "$0x" << std::hex << std::setfill('0') << std::setw(8) << value;
-    return s.str();
-  }
-};
-
-// offset
-struct O final : public Operand {
-  int32_t offset;
-  R reg;
-
-  O(int32_t offset, R reg) : offset(offset), reg(reg) {}
-
-  const std::string toString() const override {
-    std::ostringstream s;
-    s << offset << "(" << reg.toString() << ")";
-    return s.str();
-  }
-};
-
-// Helper functions for producing assembly code
-
-// overload for nullary case
-std::string Insn(const std::string & opcode) {
-  return "  " + opcode;
-}
-
-// overload for non-nullary case
-template<typename OpT1, typename ... OpT>
-std::string Insn(std::string opcode, OpT1 first, OpT... rest) {
-  std::ostringstream insn;
-  insn << "  " << opcode << " " << first.toString();
-
-  // use fold expression to print the rest
-  ((insn << ", " << rest.toString()), ...);  
-
-  return insn.str();
-}
-
-std::optional<VarInfo> Context::lookup(std::string const & x) {
+std::optional<VarInfo> Context::lookup(Symbol x) {
   auto offset = varInfo.find(x);
 
   if (offset != varInfo.end()) {
@@ -112,6 +26,19 @@ std::optional<VarInfo> Context::lookup(std::string const & x) {
   }
 }
 
+void Context::pointerSlots(std::vector<int32_t> & slots) const {
+  for (auto & [_, info] : varInfo) {
+    if (info.second != TypeExpr::IntName) {
+      // offsets are kept negated, see allocateVar
+      slots.push_back(-info.first / 4);
+    }
+  }
+
+  if (parent) {
+    parent->pointerSlots(slots);
+  }
+}
+
 // Symbol table methods
 
 const std::string SymbolTable::tmpPrefix = "tmp_";
@@ -122,16 +49,16 @@ void SymbolTable::addFnDef(const FunctionDef & fnDef) {
     throw CodeGenError {"Function " + fnDef.function_name() + " is defined more than once"};
   }
 
-  std::vector<std::string> paramTypes;
+  std::vector<Symbol> paramTypes;
 
   for (auto & [type, _] : fnDef.parameters()) {
     paramTypes.push_back(type->name());
   }
 
-  fnInfo.emplace(std::string(fnDef.function_name()), FnInfo{std::move(paramTypes), std::string(fnDef.type().name())});
+  fnInfo.emplace(fnDef.function_name(), FnInfo{std::move(paramTypes), fnDef.type().name()});
 }
 
-uint32_t SymbolTable::getArity(const std::string & f) {
+uint32_t SymbolTable::getArity(Symbol f) {
   auto a = fnInfo.find(f);
   if (a == fnInfo.end()) {
     throw CodeGenError {"Trying to use undefined function " + f};
@@ -140,17 +67,32 @@ uint32_t SymbolTable::getArity(const std::string & f) {
   return a->second.argTypes.size();
 }
 
+const TypeInfo & SymbolTable::getTypeInfo(Symbol type) {
+  auto info = typeInfo.find(type);
+  if (info == typeInfo.end()) {
+    throw CodeGenError { "Type " + type + " is not defined" };
+  }
+
+  return info->second;
+}
+
+std::vector<int32_t> SymbolTable::pointerSlots() const {
+  std::vector<int32_t> slots;
+  ctx.pointerSlots(slots);
+  return slots;
+}
+
 // Reset local variable information, used when entering a new function definition
 void SymbolTable::resetLocalsInfo() {
   ctx = {};
 }
 
 // Allocate stack space for a new local variable
-void SymbolTable::allocateVar(std::string x, const std::string & type) {
+void SymbolTable::allocateVar(Symbol x, Symbol type) {
   if (ctx.varInfo.count(x)) {
     throw CodeGenError { x + " is already defined in the same scope" };
   }
-  ctx.varInfo.emplace(std::move(x), VarInfo{ctx.nextOffset, type});
+  ctx.varInfo.emplace(x, VarInfo{ctx.nextOffset, type});
   // move the offset counter by 4
   ctx.nextOffset += 4;
 }
@@ -170,17 +112,17 @@ void SymbolTable::closeScope() {
 
 // Temporary variable implementation
 
-const std::string CodeGen::TmpVar::IntT = "int";
+const Symbol CodeGen::TmpVar::IntT = "int";
 
-CodeGen::TmpVar::TmpVar(const std::string & name, CodeGen &codegen) : name(name), codegen(codegen) {
+CodeGen::TmpVar::TmpVar(Symbol name, Symbol type, CodeGen &codegen) : name(name), codegen(codegen) {
   codegen.symbolTable.openScope();
-  codegen.symbolTable.allocateVar(name, IntT);
-  codegen.insns.push_back(Insn("sub", C{4}, ESP));
+  codegen.symbolTable.allocateVar(name, type);
+  codegen.code.emit(Opcode::Subl, Imm{4}, ESP);
 }
 
 CodeGen::TmpVar::~TmpVar() {
   codegen.symbolTable.closeScope();
-  codegen.insns.push_back(Insn("add", C{4}, ESP));
+  codegen.code.emit(Opcode::Addl, Imm{4}, ESP);
 }
 
 int32_t CodeGen::TmpVar::operator * () const {
@@ -189,186 +131,499 @@ int32_t CodeGen::TmpVar::operator * () const {
 
 // Code generator methods
 
-CodeGen::TmpVar CodeGen::freshTmp() {
+CodeGen::TmpVar CodeGen::freshTmp(Symbol type) {
   auto name = SymbolTable::tmpPrefix + std::to_string(symbolTable.nextTmp++);
-  return TmpVar(name, *this);
+  return TmpVar(name, type, *this);
+}
+
+void CodeGen::emitCall(const std::string & callee) {
+  // The GC walks the stack by return addresses, so label the instruction
+  // after the call and remember which slots of this frame hold pointers.
+  auto returnLabel = ".LRET_" + std::to_string(stackMaps.size());
+  auto slots = symbolTable.pointerSlots();
+  slots.insert(slots.end(), pendingPointerArgs.begin(), pendingPointerArgs.end());
+  std::sort(slots.begin(), slots.end());
+
+  code.emit(Opcode::Call, Sym{code.symbol(callee)});
+  auto label = code.newLabel(returnLabel);
+  code.define(label);
+  stackMaps.push_back({label, std::move(slots)});
+}
+
+void CodeGen::emitRuntimeInfo() {
+  // Lets the runtime refuse collectors that need barriers this code lacks
+  code.blank();
+  code.directive(".section .rodata");
+  code.directive(".align 4");
+  code.directive(".globl L2WriteBarriers");
+  code.define(code.symbol("L2WriteBarriers"));
+  code.directive(".long " + std::to_string(writeBarriers ? 1 : 0));
+  emitAllocationSites();
+}
+
+void CodeGen::emitAllocationSites() {
+  // Layout: the number of sites, then for each site the words of its
+  // objects and the address of its name. The runtime finds the site of an
+  // object in its last field.
+  code.directive(".globl L2AllocSites");
+  code.define(code.symbol("L2AllocSites"));
+  code.directive(".long " + std::to_string(allocationSites.size()));
+  for (size_t i = 0; i < allocationSites.size(); ++i) {
+    code.directive(".long " + std::to_string(allocationSites[i].words) +
+                   ", ALLOC_SITE_NAME_" + std::to_string(i));
+  }
+  for (size_t i = 0; i < allocationSites.size(); ++i) {
+    code.define(code.symbol("ALLOC_SITE_NAME_" + std::to_string(i)));
+    code.directive(".asciz \"" + allocationSites[i].name + "\"");
+  }
+  // A 64-bit allocation counter per site, bumped by the program
+  code.directive(".data");
+  code.directive(".align 8");
+  code.directive(".globl L2AllocSiteCounts");
+  code.define(code.symbol("L2AllocSiteCounts"));
+  code.directive(".zero " + std::to_string(8 * std::max<size_t>(allocationSites.size(), 1)));
+}
+
+void CodeGen::emitStackMaps() {
+  // Layout: the number of entries, then for each call site its return
+  // address, the number of pointer slots and the slots themselves as word
+  // offsets from the frame pointer of the calling function.
+  code.blank();
+  code.comment("GC STACK MAPS");
+  code.directive(".section .l2_stack_maps, \"a\", @progbits");
+  code.directive(".align 4");
+  code.directive(".globl L2StackMaps");
+  code.define(code.symbol("L2StackMaps"));
+  code.directive(".long " + std::to_string(stackMaps.size()));
+  for (auto & entry : stackMaps) {
+    std::string line = ".long " + std::string(code.name(entry.returnLabel)) + ", " + std::to_string(entry.pointerSlots.size());
+    for (auto slot : entry.pointerSlots) {
+      line += ", " + std::to_string(slot);
+    }
+    code.directive(line);
+  }
 }
 
-std::vector<std::string> CodeGen::generateCode(const Program & program) {
+MachineCode CodeGen::generateCode(const Program & program) {
   // reset instructions, label counter, symbol table, etc.
-  insns = {"  .extern allocate"};
+  code = {};
+  for (auto name : {"allocate", "L2AllocPtr", "L2AllocLimit", "L2CardTable"}) {
+    code.directive(std::string(".extern ") + name);
+  }
   nextIndex = 0;
   symbolTable = {};
+  stackMaps.clear();
+  pendingPointerArgs.clear();
+  allocationSites.clear();
+  registerNeeds.clear();
+  registerVariables.clear();
+  busyRegisters = 0;
+  usedRegisters = 0;
   inTopLevelScope = true;
   // actual code gen
   VisitProgramExpr(program);
-  return insns;
+  emitRuntimeInfo();
+  emitStackMaps();
+  return std::move(code);
 }
 
 void CodeGen::VisitNil(const NilExpr& exp) {
   // We represent `nil` as constant 0
-  insns.push_back(Insn("movl", C{0}, EAX));
+  code.emit(Opcode::Movl, Imm{0}, EAX);
 }
 
 void CodeGen::VisitNewExpr(const NewExpr& exp) {
-  auto typeInfo = symbolTable.typeInfo.find(exp.type());
-  if (typeInfo == symbolTable.typeInfo.end()) {
-    throw CodeGenError { "Type " + exp.type() + " is not defined" };
-  }
-
-  auto size = static_cast<int32_t>(typeInfo->second.fields.size());
-  // call allocate(int32_t size)
-  insns.push_back("  // ALLOCATE FOR NEW " + exp.type());
-  insns.push_back(Insn("pushl", C{size}));
-  insns.push_back(Insn("call", L{"allocate"}));
-  insns.push_back(Insn("sub", C{4}, ESP));
-  insns.push_back("  // SET TAG");
+  auto & typeInfo = symbolTable.getTypeInfo(exp.type());
+
+  auto size = typeInfo.words();
+  // When profiling, an extra integer field after the declared ones holds the
+  // allocation site. Objects with the most fields a header allows are counted
+  // but left untagged.
+  int32_t site = -1;
+  int32_t fields = size;
+  if (allocationProfile) {
+    site = static_cast<int32_t>(allocationSites.size());
+    allocationSites.push_back({currentFunction + ":new#" + std::to_string(functionAllocations++) +
+                                   ":" + exp.type().str(),
+                               size + 1});
+    if (size < TypeInfo::MaxWords) {
+      fields = size + 1;
+    }
+  }
+  auto n = std::to_string(freshIndex());
+  auto slowLabel = code.newLabel("ALLOC_SLOW_" + n);
+  auto doneLabel = code.newLabel("ALLOC_DONE_" + n);
+  code.comment("ALLOCATE FOR NEW " + exp.type());
+  // bump the allocation pointer past the tag and the fields if they fit,
+  // large objects go to the runtime's large object space instead
+  if (fields + 1 < LargeObjectWords) {
+    code.emit(Opcode::Movl, Sym{code.symbol("L2AllocPtr")}, EAX);
+    code.emit(Opcode::Leal, Mem{(fields + 1) * 4, EAX}, EDX);
+    code.emit(Opcode::Cmpl, Sym{code.symbol("L2AllocLimit")}, EDX);
+    code.emit(Opcode::Ja, Sym{slowLabel});
+    code.emit(Opcode::Movl, EDX, Sym{code.symbol("L2AllocPtr")});
+    code.emit(Opcode::Addl, Imm{4}, EAX);
+    code.emit(Opcode::Jmp, Sym{doneLabel});
+  }
+  // otherwise call allocate(int32_t size), which collects garbage first
+  code.define(slowLabel);
+  code.emit(Opcode::Pushl, Imm{fields});
+  emitCall("allocate");
+  code.emit(Opcode::Addl, Imm{4}, ESP);
+  code.define(doneLabel);
+  code.comment("SET TAG");
   // set up the tag
-  insns.push_back(Insn("movl", H{typeInfo->second.tag()}, O{-4, EAX}));
-  insns.push_back("  // INITIALIZE FIELDS");
-  // initialize fields to 0
+  code.emit(Opcode::Movl, Imm{static_cast<int32_t>(typeInfo.tag(fields - size)), true}, Mem{-4, EAX});
+  code.comment("INITIALIZE FIELDS");
+  // initialize fields to 0, after the pointer bitmap of a wide type
+  auto initial = typeInfo.initialWords();
   for (int32_t i = 0; i < size; ++i) {
-    insns.push_back(Insn("movl", C{0}, O{i * 4, EAX}));
+    code.emit(Opcode::Movl, Imm{static_cast<int32_t>(initial[i]), initial[i] != 0}, Mem{i * 4, EAX});
   }
-  insns.push_back("  // END NEW " + exp.type());
+  if (site >= 0) {
+    code.comment("PROFILE ALLOCATION SITE");
+    if (fields > size) {
+      code.emit(Opcode::Movl, Imm{site}, Mem{size * 4, EAX});
+    }
+    auto counters = code.symbol("L2AllocSiteCounts");
+    code.emit(Opcode::Addl, Imm{1}, Sym{counters, 8 * site});
+    code.emit(Opcode::Adcl, Imm{0}, Sym{counters, 8 * site + 4});
+  }
+  code.comment("END NEW " + exp.type());
 }
 
 void CodeGen::VisitIntegerExpr(const IntegerExpr& exp) {
   // Store the constant in the result register
-  insns.push_back(Insn("movl", C{exp.value()}, EAX));
+  code.emit(Opcode::Movl, Imm{exp.value()}, EAX);
 }
 
 void CodeGen::VisitVariable(const Variable& exp) {
-  // Load the address of the variable to result register. More efficient code can
-  // be generated using LEA instruction.
+  // Load the address of the frame slot of the variable to result register
   auto varOffset = symbolTable.ctx.lookup(exp.name());
 
   if (!varOffset) {
     throw CodeGenError {"reference to undefined variable " + exp.name()};
   }
 
-  insns.push_back(Insn("movl", EBP, EAX));
-  insns.push_back(Insn("sub", C{varOffset->first}, EAX) + "  /* load address of " + exp.name() + " */");
+  code.emit(Opcode::Leal, Mem{-varOffset->first, EBP}, EAX); code.annotate("load address of " + exp.name() + "");
 }
 
 void CodeGen::VisitAccessPath(const AccessPath& exp) {
-  // Note: the algorithm here computes the address to the access path
-  // iteratively so it does dereferences and offset calculation in
-  // separate instructions. A more efficient algorithm could put all
-  // offset calculations to movl instructions, except for the last
-  // `add` instruction.
-  
-  exp.root().Visit(this);
-  // Dereference field addresses
-  auto type = symbolTable.ctx.lookup(exp.root().name())->second;
-  for (auto field : exp.fieldAccesses()) {
-    auto [offset, fieldType] = symbolTable.typeInfo[type].varInfoOf(field);
-    // dereference field address
-    insns.push_back(Insn("movl", O{0, EAX}, EAX) + " /* dereference the address at EAX */");
-    insns.push_back(Insn("add", C{offset * 4}, EAX) + " /* load address of field ." + field + " */");
-    // update the type
+  if (auto reg = registerOf(exp)) {
+    code.emit(Opcode::Movl, *reg, EAX);
+    return;
+  }
+
+  code.emit(Opcode::Movl, emitLocation(exp), EAX);
+  code.annotate("load " + pathName(exp, exp.fieldAccesses().size()));
+}
+
+Mem CodeGen::emitLocation(const AccessPath & path) {
+  auto varInfo = symbolTable.ctx.lookup(path.root().name());
+  if (!varInfo) {
+    throw CodeGenError {"reference to undefined variable " + path.root().name()};
+  }
+
+  // Each field is at a constant offset from the object holding it, so the
+  // offset goes into the operand that reads or writes the field and only
+  // the objects along the path are loaded
+  Mem location{-varInfo->first, EBP};
+  auto type = varInfo->second;
+  auto & fields = path.fieldAccesses();
+  for (size_t i = 0; i < fields.size(); ++i) {
+    auto [index, fieldType] = symbolTable.getTypeInfo(type).varInfoOf(fields[i]);
+    code.emit(Opcode::Movl, location, EAX); code.annotate("load " + pathName(path, i));
+    location = Mem{index * 4, EAX};
     type = fieldType;
   }
-  // Dereference the last part if we are not in lhs
-  if (! inLhsOfAssignment) {
-    insns.push_back("  // dereference the address because we are on rhs of an assignment");
-    insns.push_back(Insn("movl", O{0, EAX}, EAX));
+  return location;
+}
+
+std::string CodeGen::pathName(const AccessPath & path, size_t fields) {
+  std::string name = path.root().name().str();
+  for (size_t i = 0; i < fields; ++i) {
+    name += '.';
+    name += path.fieldAccesses()[i].str();
   }
+  return name;
 }
 
 void CodeGen::VisitAddExpr(const AddExpr& exp) {
-  auto tmpVar = freshTmp();
-  exp.lhs().Visit(this);
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  exp.rhs().Visit(this);
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
-
-  // LHS is at EDX, RHS is at EAX
-  insns.push_back(Insn("add", EDX, EAX));
+  emitBinaryOperator(NodeKind::Add, exp.lhs(), exp.rhs());
 }
 void CodeGen::VisitSubtractExpr(const SubtractExpr& exp) {
-  auto tmpVar = freshTmp();
-  exp.lhs().Visit(this);
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  exp.rhs().Visit(this);
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
-
-  // LHS is at EDX, RHS is at EAX
-  insns.push_back(Insn("sub", EAX, EDX));
-  insns.push_back(Insn("movl", EDX, EAX));
- }
+  emitBinaryOperator(NodeKind::Subtract, exp.lhs(), exp.rhs());
+}
 void CodeGen::VisitMultiplyExpr(const MultiplyExpr& exp) {
-  auto tmpVar = freshTmp();
-  exp.lhs().Visit(this);
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  exp.rhs().Visit(this);
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
-
-  // LHS is at EDX, RHS is at EAX
-  insns.push_back(Insn("imul", EDX, EAX));
+  emitBinaryOperator(NodeKind::Multiply, exp.lhs(), exp.rhs());
 }
 void CodeGen::VisitLessThanExpr(const LessThanExpr& exp) {
-  auto tmpVar = freshTmp();
-  exp.lhs().Visit(this);
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  exp.rhs().Visit(this);
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
-
-  // LHS is at EDX, RHS is at EAX
-  insns.push_back("  cmp %eax, %edx");
-  insns.push_back("  setl %al");
-  insns.push_back("  movzbl %al, %eax");
+  emitBinaryOperator(NodeKind::LessThan, exp.lhs(), exp.rhs());
 }
 void CodeGen::VisitLessThanEqualToExpr(const LessThanEqualToExpr& exp) {
-  auto tmpVar = freshTmp();
-  exp.lhs().Visit(this);
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  exp.rhs().Visit(this);
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
-
-  // LHS is at EDX, RHS is at EAX
-  insns.push_back("  cmp %eax, %edx");
-  insns.push_back("  setle %al");
-  insns.push_back("  movzbl %al, %eax");
+  emitBinaryOperator(NodeKind::LessThanEqualTo, exp.lhs(), exp.rhs());
 }
 void CodeGen::VisitEqualToExpr(const EqualToExpr& exp) {
-  auto tmpVar = freshTmp();
-  exp.lhs().Visit(this);
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  exp.rhs().Visit(this);
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
-
-  // LHS is at EDX, RHS is at EAX
-  insns.push_back("  cmp %eax, %edx");
-  insns.push_back("  sete %al");
-  insns.push_back("  movzbl %al, %eax");
+  emitBinaryOperator(NodeKind::EqualTo, exp.lhs(), exp.rhs());
 }
 void CodeGen::VisitLogicalAndExpr(const LogicalAndExpr& exp) {
-  auto tmpVar = freshTmp();
-  exp.lhs().Visit(this);
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  exp.rhs().Visit(this);
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
-
-  // LHS is at EDX, RHS is at EAX
-  insns.push_back(Insn("andl", EDX, EAX));
+  emitBinaryOperator(NodeKind::LogicalAnd, exp.lhs(), exp.rhs());
 }
 void CodeGen::VisitLogicalOrExpr(const LogicalOrExpr& exp) {
-  auto tmpVar = freshTmp();
-  exp.lhs().Visit(this);
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  exp.rhs().Visit(this);
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
+  emitBinaryOperator(NodeKind::LogicalOr, exp.lhs(), exp.rhs());
+}
+
+CodeGen::RegisterNeed CodeGen::registerNeed(const AstNode& exp) {
+  auto known = registerNeeds.find(&exp);
+  if (known != registerNeeds.end()) {
+    return known->second;
+  }
 
-  // LHS is at EDX, RHS is at EAX
-  insns.push_back(Insn("orl", EDX, EAX));
+  RegisterNeed need{1, false};
+  switch (exp.kind()) {
+    case NodeKind::New:
+      need.allocates = true;
+      break;
+    case NodeKind::LogicalNot:
+      need = registerNeed(static_cast<const LogicalNotExpr&>(exp).operand());
+      break;
+    case NodeKind::Add:
+    case NodeKind::Subtract:
+    case NodeKind::Multiply:
+    case NodeKind::LessThan:
+    case NodeKind::LessThanEqualTo:
+    case NodeKind::EqualTo:
+    case NodeKind::LogicalAnd:
+    case NodeKind::LogicalOr: {
+      auto [lhs, rhs] = operandsOf(exp);
+      auto l = registerNeed(*lhs);
+      auto r = registerNeed(*rhs);
+      need.allocates = l.allocates || r.allocates;
+      if (directOperand(*rhs)) {
+        need.registers = l.registers;
+      } else if (directOperand(*lhs)) {
+        need.registers = r.registers;
+      } else {
+        need.registers = l.registers == r.registers ? l.registers + 1 : std::max(l.registers, r.registers);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  registerNeeds.emplace(&exp, need);
+  return need;
+}
+
+std::pair<const AstNode*, const AstNode*> CodeGen::operandsOf(const AstNode& exp) {
+  switch (exp.kind()) {
+    case NodeKind::Add:
+    case NodeKind::Subtract:
+    case NodeKind::Multiply: {
+      auto & op = static_cast<const ArithmeticBinaryOperatorExpr&>(exp);
+      return {&op.lhs(), &op.rhs()};
+    }
+    case NodeKind::LessThan:
+    case NodeKind::LessThanEqualTo:
+    case NodeKind::EqualTo: {
+      auto & op = static_cast<const RelationalBinaryOperator&>(exp);
+      return {&op.lhs(), &op.rhs()};
+    }
+    default: {
+      auto & op = static_cast<const LogicalBinaryOperator&>(exp);
+      return {&op.lhs(), &op.rhs()};
+    }
+  }
+}
+
+std::optional<Reg> CodeGen::takeRegister(bool survivesCalls) {
+  for (auto reg : TemporaryRegisters) {
+    // allocate() may clobber ECX
+    if (survivesCalls && reg == Reg::ECX) {
+      continue;
+    }
+    auto bit = 1u << static_cast<unsigned>(reg);
+    if (!(busyRegisters & bit)) {
+      busyRegisters |= bit;
+      usedRegisters |= bit;
+      return reg;
+    }
+  }
+  return std::nullopt;
+}
+
+void CodeGen::releaseRegister(Reg reg) {
+  busyRegisters &= ~(1u << static_cast<unsigned>(reg));
+}
+
+void CodeGen::allocateVariables(const std::vector<std::pair<Symbol, Symbol>> & variables,
+                                const BlockStmt & body, const AstNode & result) {
+  // Only integers go to registers. A variable hides the ones before it with
+  // the same name, so the last one decides.
+  std::vector<Symbol> integers;
+  std::unordered_map<Symbol, bool> seen;
+  for (auto variable = variables.rbegin(); variable != variables.rend(); ++variable) {
+    if (seen.emplace(variable->first, true).second && variable->second == TypeExpr::IntName) {
+      integers.push_back(variable->first);
+    }
+  }
+  std::reverse(integers.begin(), integers.end());
+
+  registerVariables = allocateRegisters(
+      integers, body, &result,
+      std::vector<Reg>(std::begin(CalleeSavedRegisters), std::end(CalleeSavedRegisters)));
+  // The registers of variables are not used for temporaries in the whole
+  // function, even where the variables are dead
+  busyRegisters = 0;
+  for (auto & [_, variable] : registerVariables) {
+    busyRegisters |= 1u << static_cast<unsigned>(variable.reg);
+  }
+  usedRegisters = busyRegisters;
+}
+
+std::optional<Reg> CodeGen::registerOf(const AccessPath & path) const {
+  if (!path.fieldAccesses().empty()) {
+    return std::nullopt;
+  }
+  auto variable = registerVariables.find(path.root().name());
+  if (variable == registerVariables.end()) {
+    return std::nullopt;
+  }
+  return variable->second.reg;
+}
+
+std::optional<Operand> CodeGen::directOperand(const AstNode & exp) const {
+  if (exp.kind() == NodeKind::Integer) {
+    return Imm{static_cast<const IntegerExpr&>(exp).value()};
+  }
+  if (exp.kind() == NodeKind::Nil) {
+    return Imm{0};
+  }
+  if (exp.kind() == NodeKind::AccessPath) {
+    if (auto reg = registerOf(static_cast<const AccessPath&>(exp))) {
+      return *reg;
+    }
+  }
+  return std::nullopt;
+}
+
+void CodeGen::emitSaveRegisters(size_t at) {
+  auto from = code.instructions().size();
+  for (size_t i = 0; i < std::size(CalleeSavedRegisters); ++i) {
+    auto reg = CalleeSavedRegisters[i];
+    if (usedRegisters & (1u << static_cast<unsigned>(reg))) {
+      code.emit(Opcode::Movl, reg, Mem{-4 * static_cast<int32_t>(i + 1), EBP});
+    }
+  }
+  code.hoist(from, at);
+}
+
+void CodeGen::emitRestoreRegisters() {
+  for (size_t i = 0; i < std::size(CalleeSavedRegisters); ++i) {
+    auto reg = CalleeSavedRegisters[i];
+    if (usedRegisters & (1u << static_cast<unsigned>(reg))) {
+      code.emit(Opcode::Movl, Mem{-4 * static_cast<int32_t>(i + 1), EBP}, reg);
+    }
+  }
+}
+
+void CodeGen::emitBinaryOperator(NodeKind op, const AstNode& lhs, const AstNode& rhs) {
+  // Constants and variables in registers are operands as they are
+  if (auto operand = directOperand(rhs)) {
+    Walk(lhs);
+    emitOperator(op, EAX, *operand);
+    return;
+  }
+  if (auto operand = directOperand(lhs)) {
+    Walk(rhs);
+    emitOperator(op, *operand, EAX);
+    return;
+  }
+
+  // Evaluate the operand that needs more registers first so the other one
+  // has the most registers left (Sethi-Ullman). An operand that allocates
+  // goes first regardless, so the other operand is only held across a
+  // collection when both allocate.
+  auto l = registerNeed(lhs);
+  auto r = registerNeed(rhs);
+  bool lhsFirst = l.allocates != r.allocates ? l.allocates : l.registers >= r.registers;
+  auto & first = lhsFirst ? lhs : rhs;
+  auto & second = lhsFirst ? rhs : lhs;
+  bool secondAllocates = (lhsFirst ? r : l).allocates;
+  // Then a new object, the only pointer that allocates, may move while it is
+  // held, so it goes to a stack temporary the stack maps cover. Integers are
+  // safe in registers allocate() preserves.
+  bool movable = secondAllocates && first.kind() == NodeKind::New;
+
+  Walk(first);
+  auto reg = movable ? std::nullopt : takeRegister(secondAllocates);
+  if (reg) {
+    code.emit(Opcode::Movl, EAX, *reg);
+    Walk(second);
+    releaseRegister(*reg);
+    emitOperator(op, lhsFirst ? Operand{*reg} : EAX, lhsFirst ? EAX : Operand{*reg});
+  } else {
+    // Out of registers or a pointer, spill to a stack temporary
+    auto tmpVar = freshTmp(movable ? static_cast<const NewExpr&>(first).type() : TmpVar::IntT);
+    Mem slot{-(*tmpVar), EBP};
+    code.emit(Opcode::Movl, EAX, slot);
+    Walk(second);
+    emitOperator(op, lhsFirst ? Operand{slot} : EAX, lhsFirst ? EAX : Operand{slot});
+  }
+}
+
+void CodeGen::emitOperator(NodeKind op, Operand lhs, Operand rhs) {
+  // One of the operands is in EAX, the result goes there too
+  bool lhsInEax = lhs == Operand{EAX};
+  auto & other = lhsInEax ? rhs : lhs;
+  auto compare = [&](Opcode lhsFirst, Opcode rhsFirst) {
+    // cmpl computes its second operand minus its first, so the condition
+    // flips when the right hand side is in EAX
+    code.emit(Opcode::Cmpl, other, EAX);
+    code.emit(lhsInEax ? lhsFirst : rhsFirst, AL);
+    code.emit(Opcode::Movzbl, AL, EAX);
+  };
+
+  switch (op) {
+    case NodeKind::Add:
+      code.emit(Opcode::Addl, other, EAX);
+      break;
+    case NodeKind::Subtract:
+      if (lhsInEax) {
+        code.emit(Opcode::Subl, rhs, EAX);
+      } else {
+        code.emit(Opcode::Negl, EAX);
+        code.emit(Opcode::Addl, lhs, EAX);
+      }
+      break;
+    case NodeKind::Multiply:
+      code.emit(Opcode::Imull, other, EAX);
+      break;
+    case NodeKind::LessThan:
+      compare(Opcode::Setl, Opcode::Setg);
+      break;
+    case NodeKind::LessThanEqualTo:
+      compare(Opcode::Setle, Opcode::Setge);
+      break;
+    case NodeKind::EqualTo:
+      compare(Opcode::Sete, Opcode::Sete);
+      break;
+    case NodeKind::LogicalAnd:
+      code.emit(Opcode::Andl, other, EAX);
+      break;
+    case NodeKind::LogicalOr:
+      code.emit(Opcode::Orl, other, EAX);
+      break;
+    default:
+      throw std::logic_error {"Not a binary operator"};
+  }
 }
 void CodeGen::VisitLogicalNotExpr(const LogicalNotExpr& exp) {
-  exp.operand().Visit(this);
+  Walk(exp.operand());
   // Result is in eax, use branch-free not implementation
-  insns.push_back("  cmp $0, %eax");
-  insns.push_back("  sete %al");
-  insns.push_back("  movzbl %al, %eax");
+  code.emit(Opcode::Cmpl, Imm{0}, EAX);
+  code.emit(Opcode::Sete, AL);
+  code.emit(Opcode::Movzbl, AL, EAX);
 }
 void CodeGen::VisitTypeExpr(const TypeExpr& exp) {
   // No code is generated for types
@@ -379,8 +634,8 @@ void CodeGen::VisitBlockStmt(const BlockStmt& exp) {
   inTopLevelScope = false;
 
   // Reserve stack space
-  auto stackSize = C{static_cast<int32_t>(exp.decls().size()) * 4};
-  insns.push_back(Insn("sub", stackSize, ESP));
+  auto stackSize = Imm{static_cast<int32_t>(exp.decls().size()) * 4};
+  code.emit(Opcode::Subl, stackSize, ESP);
 
   // To simplify garbage collection, we do not allow variables
   // declared in inner scopes in L2
@@ -393,17 +648,22 @@ void CodeGen::VisitBlockStmt(const BlockStmt& exp) {
 
   // Insert declared variables to symbol table and initialize them to 0
   for (auto & d : exp.decls()) {
-    d.Visit(this);
-    insns.push_back(Insn("movl", C{0}, O{-(symbolTable.ctx.lookup(d.id().name())->first), EBP}));
+    Walk(d);
+    auto variable = registerVariables.find(d.id().name());
+    if (variable == registerVariables.end()) {
+      code.emit(Opcode::Movl, Imm{0}, Mem{-(symbolTable.ctx.lookup(d.id().name())->first), EBP});
+    } else if (variable->second.liveIn) {
+      code.emit(Opcode::Movl, Imm{0}, variable->second.reg);
+    }
   }
   // Generate code for the statements, note that this may create additional temporaries
   for (auto & s : exp.stmts()) {
-    s->Visit(this);
+    Walk(*s);
   }
 
   // Adjust the stack size back if we are not in global scope
   if (!wasInTopLevelScope) {
-    insns.push_back(Insn("add", stackSize, ESP));
+    code.emit(Opcode::Addl, stackSize, ESP);
     symbolTable.closeScope();
   }
   // Restore global status
@@ -421,46 +681,76 @@ void CodeGen::VisitAssignmentExpr(const Assignment& assignment) {
   // but we are doing the same for assignments as well to keep the
   // code gen uniform).
   
-  // generate code for rhs, this will put the result in EAX
-  assignment.rhs().Visit(this);
-  // create a temporary and save the result
-  auto tmpVar = freshTmp();
-  insns.push_back(Insn("movl", EAX, O{-(*tmpVar), EBP}));
-  // resolve address of LHS
-  inLhsOfAssignment = true;
-  assignment.lhs().Visit(this);
-  inLhsOfAssignment = false;
-  // Address of LHS should be in EAX
-  //
-  // move the result from the temporary to the lhs
-  insns.push_back(Insn("movl", O{-(*tmpVar), EBP}, EDX));
-  insns.push_back(Insn("movl", EDX, O{0, EAX}));
+  // Constants and variables in registers are stored as they are, anything
+  // else is evaluated to EAX
+  auto & lhs = assignment.lhs();
+  auto value = directOperand(assignment.rhs());
+  if (auto reg = registerOf(lhs)) {
+    if (!value) {
+      Walk(assignment.rhs());
+      value = EAX;
+    }
+    code.emit(Opcode::Movl, *value, *reg);
+    return;
+  }
+  if (!value) {
+    Walk(assignment.rhs());
+    // keep the result in EDX while the objects on the lhs path are loaded,
+    // that only uses EAX and doesn't allocate
+    code.emit(Opcode::Movl, EAX, EDX);
+    value = EDX;
+  }
+  auto location = emitLocation(lhs);
+  code.emit(Opcode::Movl, *value, location);
+  code.annotate("store " + pathName(lhs, lhs.fieldAccesses().size()));
+
+  // Storing a pointer into a field may create an old-to-young reference,
+  // integer fields, variables and nil don't need a barrier
+  if (writeBarriers && ! lhs.fieldAccesses().empty() && assignment.rhs().kind() != NodeKind::Nil) {
+    auto type = symbolTable.ctx.lookup(lhs.root().name())->second;
+    for (auto field : lhs.fieldAccesses()) {
+      type = symbolTable.getTypeInfo(type).typeOf(field);
+    }
+    if (type != TypeExpr::IntName) {
+      code.emit(Opcode::Leal, location, EAX);
+      emitWriteBarrier();
+    }
+  }
+}
+
+void CodeGen::emitWriteBarrier() {
+  // The field address is in EAX, mark its card dirty in the runtime's card
+  // table. The table is biased so the card index is just the shifted address.
+  code.comment("CARD MARKING BARRIER");
+  code.emit(Opcode::Shrl, Imm{CardShift}, EAX);
+  code.emit(Opcode::Addl, Sym{code.symbol("L2CardTable")}, EAX);
+  code.emit(Opcode::Movb, Imm{1}, Mem{0, EAX});
 }
 
 void CodeGen::VisitConditionalExpr(const Conditional& conditional) {
   auto n = std::to_string(freshIndex());
-  auto falseLabel = L{"IF_FALSE_" + n};
-  auto endLabel = L{"IF_END_" + n};
-  conditional.guard().Visit(this);
-  insns.push_back(Insn("cmp", C{0}, EAX));
-  insns.push_back(Insn("je", falseLabel));
-  conditional.true_branch().Visit(this);
-  insns.push_back(Insn("jmp", endLabel));
-  insns.push_back(falseLabel.value + ":");
-  conditional.false_branch().Visit(this);
-  insns.push_back(endLabel.value + ":");
+  auto falseLabel = code.newLabel("IF_FALSE_" + n);
+  auto endLabel = code.newLabel("IF_END_" + n);
+  Walk(conditional.guard());
+  code.emit(Opcode::Cmpl, Imm{0}, EAX);
+  code.emit(Opcode::Je, Sym{falseLabel});
+  Walk(conditional.true_branch());
+  code.emit(Opcode::Jmp, Sym{endLabel});
+  code.define(falseLabel);
+  Walk(conditional.false_branch());
+  code.define(endLabel);
 }
 void CodeGen::VisitLoopExpr(const Loop& loop) {
   auto n = std::to_string(freshIndex());
-  auto startLabel = L{"WHILE_START_" + n};
-  auto endLabel = L{"WHILE_END_" + n};
-  insns.push_back(startLabel.value + ":");
-  loop.guard().Visit(this);
-  insns.push_back(Insn("cmp", C{0}, EAX));
-  insns.push_back(Insn("je", endLabel));
-  loop.body().Visit(this);
-  insns.push_back(Insn("jmp", startLabel));
-  insns.push_back(endLabel.value + ":");
+  auto startLabel = code.newLabel("WHILE_START_" + n);
+  auto endLabel = code.newLabel("WHILE_END_" + n);
+  code.define(startLabel);
+  Walk(loop.guard());
+  code.emit(Opcode::Cmpl, Imm{0}, EAX);
+  code.emit(Opcode::Je, Sym{endLabel});
+  Walk(loop.body());
+  code.emit(Opcode::Jmp, Sym{startLabel});
+  code.define(endLabel);
 }
 
 void CodeGen::VisitFunctionCallExpr(const FunctionCall& call) {
@@ -470,94 +760,109 @@ void CodeGen::VisitFunctionCallExpr(const FunctionCall& call) {
     throw CodeGenError { std::string("The function ") + call.callee_name() + " expects " + std::to_string(arity) + " arguments but " + std::to_string(call.arguments().size()) + " arguments are given" };
   }
 
-  insns.push_back("  // CALL " + call.callee_name());
+  code.comment("CALL " + call.callee_name());
   
   // create temporaries for each argument, the code to deallocate them will be created when we are done.
   auto stackSpace = static_cast<int32_t>(call.arguments().size() * 4);
 
   // compute and push the arguments in reverse order
-  for (auto arg = call.arguments().rbegin(), end = call.arguments().rend(); arg != end; ++arg) {
-    // code to compute the argument
-    (*arg)->Visit(this);
-    // push the argument    
-    insns.push_back(Insn("push", EAX));
+  auto & argTypes = symbolTable.fnInfo.at(call.callee_name()).argTypes;
+  auto pendingBefore = pendingPointerArgs.size();
+  for (size_t i = call.arguments().size(); i-- > 0;) {
+    // code to compute the argument and push it, constants and variables in
+    // registers are pushed as they are
+    if (auto operand = directOperand(*call.arguments()[i])) {
+      code.emit(Opcode::Pushl, *operand);
+    } else {
+      Walk(*call.arguments()[i]);
+      code.emit(Opcode::Pushl, EAX);
+    }
+    // the GC has to update pushed pointers if computing the rest of the arguments allocates
+    if (argTypes[i] != TypeExpr::IntName) {
+      pendingPointerArgs.push_back(-static_cast<int32_t>(symbolTable.ctx.nextOffset) / 4);
+    }
     // increse the used stack space
     symbolTable.ctx.nextOffset += 4;
   }
+  // the arguments are the callee's parameters now, its stack maps cover them
+  pendingPointerArgs.resize(pendingBefore);
 
   // call the function
-  insns.push_back(Insn("call", L{call.callee_name()}));
+  emitCall(call.callee_name().str());
   // free the stack space
-  insns.push_back("  // POST-RETURN");
-  insns.push_back(Insn("add", C{stackSpace}, ESP));
+  code.comment("POST-RETURN");
+  code.emit(Opcode::Addl, Imm{stackSpace}, ESP);
   symbolTable.ctx.nextOffset -= stackSpace;
 }
 
 void CodeGen::VisitFunctionDefExpr(const FunctionDef& def) {
-  uint32_t argInfo = 0;
-  size_t i = 0;
-  for (auto & [type, _] : def.parameters()) {
-    if (! type->isIntType()) {
-      argInfo |= 1 << i;
-    }
-    ++i;
-  }
-  
-  uint32_t localsInfo = 0;
-  i = 0;
-  for (auto & decl : def.function_body().decls()) {
-    if (! decl.type().isIntType()) {
-      localsInfo |= 1 << i;
-    }
-    ++i;
-  }
-
   symbolTable.resetLocalsInfo();
-  insns.push_back(def.function_name() + ":");
+  currentFunction = def.function_name().str();
+  functionAllocations = 0;
+  code.define(code.symbol(def.function_name().str()));
   // prologue
-  insns.push_back("  // FUNCTION PROLOGUE");
+  code.comment("FUNCTION PROLOGUE");
   // save the stack frame
-  insns.push_back(Insn("push", EBP));
-  insns.push_back(Insn("movl", ESP, EBP));
-  // push argument and local info
-  insns.push_back("  // ARGUMENT INFO");
-  insns.push_back(Insn("pushl", H{argInfo}));
-  insns.push_back("  // LOCAL INFO");
-  insns.push_back(Insn("pushl", H{localsInfo}));
+  code.emit(Opcode::Pushl, EBP);
+  code.emit(Opcode::Movl, ESP, EBP);
+  // make room to save registers, the code saving them is added at the end
+  code.emit(Opcode::Subl, Imm{SavedRegistersSize}, ESP);
+  symbolTable.ctx.nextOffset += SavedRegistersSize;
+  auto saveAt = code.instructions().size();
   // end prologue
-  insns.push_back("  // BODY");
+  code.comment("BODY");
 
   // add parameters to current context
   symbolTable.openScope();
 
+  std::vector<std::pair<Symbol, Symbol>> variables;
   int32_t currentParamOffset = -8;
   for (auto & [type, param] : def.parameters()) {
     // we use offsets in the other direction (as if the stack is
     // growing up), we negate it when constructing offset arguments
-    // (objects of `O` class)
+    // (`Mem` operands)
     symbolTable.ctx.varInfo.insert({param.name(), VarInfo{currentParamOffset, type->name()}});
     currentParamOffset -= 4;
+    variables.emplace_back(param.name(), type->name());
+  }
+  for (auto & d : def.function_body().decls()) {
+    variables.emplace_back(d.id().name(), d.type().name());
+  }
+  allocateVariables(variables, def.function_body(), def.retval());
+
+  // load the parameters that live in registers, unless a local hides them
+  for (auto & [type, param] : def.parameters()) {
+    auto variable = registerVariables.find(param.name());
+    auto & decls = def.function_body().decls();
+    bool hidden = std::any_of(decls.begin(), decls.end(),
+                              [&](auto & d) { return d.id().name() == param.name(); });
+    if (variable != registerVariables.end() && variable->second.liveIn && !hidden) {
+      auto offset = symbolTable.ctx.lookup(param.name())->first;
+      code.emit(Opcode::Movl, Mem{-offset, EBP}, variable->second.reg);
+    }
   }
 
   // generate code for the body
-  def.function_body().Visit(this);
+  Walk(def.function_body());
   // generate code for the return expression, the result will be in EAX conveniently
-  def.retval().Visit(this);
+  Walk(def.retval());
 
   // free stack space
   auto stackSize = static_cast<int32_t>(def.function_body().decls().size()) * 4;
-  insns.push_back(Insn("add", C{stackSize}, ESP));
+  code.emit(Opcode::Addl, Imm{stackSize}, ESP);
 
   // epilogue
-  insns.push_back("  // EPILOGUE");
+  code.comment("EPILOGUE");
+  emitRestoreRegisters();
   // restore the stack frame
-  insns.push_back(Insn("movl", EBP, ESP));
-  insns.push_back(Insn("pop", EBP));
+  code.emit(Opcode::Movl, EBP, ESP);
+  code.emit(Opcode::Popl, EBP);
   // return
-  insns.push_back(Insn("ret"));
+  code.emit(Opcode::Ret);
+  emitSaveRegisters(saveAt);
   // end epilogue
-  insns.push_back("  // END OF " + def.function_name());
-  insns.push_back("");
+  code.comment("END OF " + def.function_name());
+  code.blank();
 
   // remove parameters from current context
   symbolTable.closeScope();
@@ -569,19 +874,23 @@ void CodeGen::VisitTypeDef(const TypeDef& def) {
     throw CodeGenError { "Type " + def.type_name() + " is already defined" };
   }
   
-  std::vector<std::pair<std::string, std::string>> fields;
+  std::vector<std::pair<Symbol, Symbol>> fields;
 
   for (auto & decl : def.fields()) {
     fields.push_back({decl.id().name(), decl.type().name()});
   }
   
-  symbolTable.typeInfo.emplace(std::string(def.type_name()), TypeInfo{std::string(def.type_name()), std::move(fields)});
+  TypeInfo info{def.type_name(), std::move(fields)};
+  if (info.words() > TypeInfo::MaxWords) {
+    throw CodeGenError { "Type " + def.type_name() + " has more fields than an object can hold" };
+  }
+  symbolTable.typeInfo.emplace(def.type_name(), std::move(info));
 }
 
 void CodeGen::VisitProgramExpr(const Program& program) {
   // fill the type definitions
   for (const auto & typeDef : program.type_defs()) {
-    typeDef.Visit(this);
+    Walk(typeDef);
   }
 
   // fill the function symbol table
@@ -591,43 +900,45 @@ void CodeGen::VisitProgramExpr(const Program& program) {
 
   // generate definitions
   for (const auto & fnDef : program.function_defs()) {
-    fnDef->Visit(this);
+    Walk(*fnDef);
   }
 
-  uint32_t localsInfo = 0;
-  size_t i = 0;
-  for (auto & decl : program.statements().decls()) {
-    if (! decl.type().isIntType()) {
-      localsInfo |= 1 << i;
-    }
-    ++i;
-  }
-
-  insns.push_back("  .globl Entry");
-  insns.push_back("  .type Entry, @function");
-  insns.push_back("Entry:");
+  currentFunction = "Entry";
+  functionAllocations = 0;
+  code.directive(".globl Entry");
+  code.directive(".type Entry, @function");
+  code.define(code.symbol("Entry"));
   //program entry prologue
-  insns.push_back("  // BOOTSTRAP ENTRY");
-  insns.push_back(Insn("push", EBP));
-  insns.push_back(Insn("movl", ESP, EBP));
-  insns.push_back("  // ARGUMENT INFO");
-  insns.push_back(Insn("pushl", H{0}));
-  insns.push_back("  // LOCAL INFO");
-  insns.push_back(Insn("pushl", H{localsInfo}));
+  code.comment("BOOTSTRAP ENTRY");
+  code.emit(Opcode::Pushl, EBP);
+  code.emit(Opcode::Movl, ESP, EBP);
+  // Entry is called from C++, which expects the callee-saved registers to be
+  // preserved just like L2 functions do
+  symbolTable.resetLocalsInfo();
+  code.emit(Opcode::Subl, Imm{SavedRegistersSize}, ESP);
+  symbolTable.ctx.nextOffset += SavedRegistersSize;
+  auto saveAt = code.instructions().size();
+  std::vector<std::pair<Symbol, Symbol>> variables;
+  for (auto & d : program.statements().decls()) {
+    variables.emplace_back(d.id().name(), d.type().name());
+  }
+  allocateVariables(variables, program.statements(), program.arithmetic_exp());
   //end prologue
-  insns.push_back("");
-  insns.push_back("  // MAIN PROGRAM STATEMENTS");
-  program.statements().Visit(this);
-  insns.push_back("");
-  insns.push_back("  // OUTPUT EXPRESSION");
-  program.arithmetic_exp().Visit(this);
+  code.blank();
+  code.comment("MAIN PROGRAM STATEMENTS");
+  Walk(program.statements());
+  code.blank();
+  code.comment("OUTPUT EXPRESSION");
+  Walk(program.arithmetic_exp());
   // free stack space
   auto stackSize = static_cast<int32_t>(program.statements().decls().size()) * 4;
-  insns.push_back(Insn("add", C{stackSize}, ESP));
+  code.emit(Opcode::Addl, Imm{stackSize}, ESP);
   // program exit epilogue
-  insns.push_back(Insn("movl", EBP, ESP));
-  insns.push_back(Insn("pop", EBP));
-  insns.push_back(Insn("ret"));
+  emitRestoreRegisters();
+  code.emit(Opcode::Movl, EBP, ESP);
+  code.emit(Opcode::Popl, EBP);
+  code.emit(Opcode::Ret);
+  emitSaveRegisters(saveAt);
 }
 
 }  // namespace cs160::backend
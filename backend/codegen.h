@@ -2,6 +2,10 @@
 
 #include "frontend/ast.h"
 #include "frontend/ast_visitor.h"
+#include "frontend/ast_walker.h"
+#include "backend/machine_ir.h"
+#include "backend/register_allocator.h"
+#include "gc_abi.h"
 #include <string>
 #include <vector>
 #include <stdexcept>
@@ -9,6 +13,7 @@
 #include <unordered_map>
 #include <optional>
 #include <cstdint>
+#include <iterator>
 
 using namespace cs160::frontend;
 
@@ -18,56 +23,101 @@ struct CodeGenError : public std::runtime_error {
   explicit CodeGenError(const std::string & message) : runtime_error(message) {}
 };
 
-using VarInfo = std::pair<int32_t, const std::string &>;
+// Offset and type of a variable or a field
+using VarInfo = std::pair<int32_t, Symbol>;
 
 // A nested context containing variable information with lexical scoping
 struct Context {
-  std::unordered_map<std::string, VarInfo> varInfo;
+  std::unordered_map<Symbol, VarInfo> varInfo;
   std::unique_ptr<Context> parent;
-  // Information about the stack space and the current local variable context
-  uint32_t nextOffset = 12;
+  // Information about the stack space and the current local variable context.
+  // Locals start right below the saved frame pointer, functions reserve the
+  // words there to save registers first.
+  uint32_t nextOffset = 4;
 
-  std::optional<VarInfo> lookup(std::string const & x);
+  std::optional<VarInfo> lookup(Symbol x);
+
+  // Add the frame slots of variables in this context and its parents that
+  // hold pointers, in words relative to the frame pointer
+  void pointerSlots(std::vector<int32_t> & slots) const;
 };
 
 // Function information that keeps track of argument and return types
 struct FnInfo {
-  std::vector<std::string> argTypes;
-  std::string retType;
+  std::vector<Symbol> argTypes;
+  Symbol retType;
 };
 
 // Type information that keeps track of offsets and types of each field
 struct TypeInfo {
+  // Fields with a pointer bit in the tag, a type with a pointer field after
+  // them is wide: its objects start with a bitmap of their pointer fields
+  static constexpr size_t TagPointerBits = 22;
+  // The tag has 8 bits for the number of words in an object
+  static constexpr int32_t MaxWords = 255;
+
   // Type name information is for debugging purposes
-  const std::string name;
+  const Symbol name;
   // Fields are represented as pairs of variables and types
-  const std::vector<std::pair<std::string, std::string>> fields;
+  const std::vector<std::pair<Symbol, Symbol>> fields;
+  // Number of words of the pointer bitmap before the fields, 0 unless wide
+  const int32_t bitmapWords;
+  // Index and type of each field, keyed by field name
+  const std::unordered_map<Symbol, VarInfo> fieldInfo;
+
+  TypeInfo(Symbol name, std::vector<std::pair<Symbol, Symbol>> fields)
+      : name(name), fields(std::move(fields)), bitmapWords(countBitmapWords(this->fields)),
+        fieldInfo(indexFields(this->fields, bitmapWords)) {}
 
-  int32_t offsetOf(std::string const & field) const {
+  int32_t offsetOf(Symbol field) const {
     return varInfoOf(field).first;
   }
 
-  const std::string & typeOf(std::string const & field) const {
+  Symbol typeOf(Symbol field) const {
     return varInfoOf(field).second;
   }
 
-  VarInfo varInfoOf(std::string const & field) const {
-    for (size_t i = 0; i < fields.size(); ++i) {
-      if (fields[i].first == field) {
-        return VarInfo{static_cast<int32_t>(i), fields[i].second};
-      }
+  VarInfo varInfoOf(Symbol field) const {
+    auto info = fieldInfo.find(field);
+    if (info != fieldInfo.end()) {
+      return info->second;
     }
 
-    throw std::logic_error { std::string("Field ") + field + " is not found in struct " + name };
+    throw std::logic_error { "Field " + field + " is not found in struct " + name };
   }
 
-  // Compute the tag needed by GC
-  uint32_t tag() const {
-    auto tag = (uint32_t)fields.size() << 24;
-    for (size_t i = 0; i < fields.size(); ++i) {
-      if (fields[i].second != "int") {
-        // the field is a pointer set the relevant bit in tag
-        tag |= 1 << (i + 1);
+  // Number of words in an object, the bitmap included but not the tag
+  int32_t words() const {
+    return bitmapWords + static_cast<int32_t>(fields.size());
+  }
+
+  // The initial value of each word of an object, the bitmap followed by zeros
+  std::vector<uint32_t> initialWords() const {
+    std::vector<uint32_t> words(this->words(), 0);
+    if (bitmapWords > 0) {
+      for (size_t i = 0; i < fields.size(); ++i) {
+        if (isPointer(i)) {
+          auto index = bitmapWords + i;
+          words[index / 32] |= 1u << (index % 32);
+        }
+      }
+    }
+    return words;
+  }
+
+  // Compute the tag needed by GC, `extraFields` integer fields are added
+  // after the declared ones
+  uint32_t tag(uint32_t extraFields = 0) const {
+    auto tag = (uint32_t)(words() + extraFields) << 24;
+    if (bitmapWords > 0) {
+      // the GC finds the pointers in the bitmap
+      tag |= 1u << 23 | (uint32_t)bitmapWords << 1;
+    } else {
+      for (size_t i = 0; i < fields.size(); ++i) {
+        if (isPointer(i)) {
+          // the field is a pointer set the relevant bit in tag
+          tag |= 1 << (i + 1);
+        }
       }
     }
 
@@ -76,12 +126,44 @@ struct TypeInfo {
 
     return tag;
   }
+
+ private:
+  bool isPointer(size_t i) const {
+    return fields[i].second != TypeExpr::IntName;
+  }
+
+  static int32_t countBitmapWords(const std::vector<std::pair<Symbol, Symbol>> & fields) {
+    size_t end = 0;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (fields[i].second != TypeExpr::IntName) {
+        end = i + 1;
+      }
+    }
+    if (end <= TagPointerBits) {
+      return 0;
+    }
+    // the bitmap covers itself too
+    int32_t words = 1;
+    while (32 * words < words + static_cast<int32_t>(fields.size())) {
+      ++words;
+    }
+    return words;
+  }
+
+  static std::unordered_map<Symbol, VarInfo> indexFields(const std::vector<std::pair<Symbol, Symbol>> & fields,
+                                                         int32_t bitmapWords) {
+    std::unordered_map<Symbol, VarInfo> result;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      result.emplace(fields[i].first, VarInfo{bitmapWords + static_cast<int32_t>(i), fields[i].second});
+    }
+    return result;
+  }
 };
 
 // Symbol table, implementation detail
 struct SymbolTable {
-  std::unordered_map<std::string, TypeInfo> typeInfo;
-  std::unordered_map<std::string, FnInfo> fnInfo;
+  std::unordered_map<Symbol, TypeInfo> typeInfo;
+  std::unordered_map<Symbol, FnInfo> fnInfo;
 
   Context ctx;
   static const std::string tmpPrefix;
@@ -90,13 +172,19 @@ struct SymbolTable {
   // Check and add function definition
   void addFnDef(const FunctionDef & fnDef);
 
-  uint32_t getArity(const std::string & f);
+  uint32_t getArity(Symbol f);
+
+  // Get the information for a defined type, throws CodeGenError if the type is not defined
+  const TypeInfo & getTypeInfo(Symbol type);
+
+  // Frame slots that hold pointers in the current context, in words relative to the frame pointer
+  std::vector<int32_t> pointerSlots() const;
 
   // Reset local variable information, used when entering a new function definition
   void resetLocalsInfo();
 
   // Allocate stack space for a new local variable
-  void allocateVar(std::string x, const std::string & type);
+  void allocateVar(Symbol x, Symbol type);
 
   // Create a new scope, used when entering a block
   void openScope();
@@ -105,11 +193,20 @@ struct SymbolTable {
   void closeScope();
 };
 
-// The code generator is implemented as an AST visitor that will generate the relevant pieces of code as it traverses a node
-class CodeGen final : public AstVisitor {
+// The code generator is implemented as an AST visitor that will generate the relevant pieces of code as it traverses a node.
+// Subtrees are traversed with the statically dispatched AstWalker; the AstVisitor interface is kept for callers that use AstNode::Visit.
+class CodeGen final : public AstVisitor, public AstWalker<CodeGen> {
  public:
+  // `writeBarriers` controls whether pointer stores into fields mark cards,
+  // the generational collector refuses to run programs compiled without them.
+  // With `allocationProfile` every `new` counts its allocations and tags the
+  // object with its allocation site, see emitAllocationSites().
+  explicit CodeGen(bool writeBarriers = true, bool allocationProfile = false)
+      : writeBarriers(writeBarriers), allocationProfile(allocationProfile) {}
+
   // Entry point of the code generator. This function should visit given program and return generated code as a list of instructions and labels.
-  std::vector<std::string> generateCode(const Program & program);
+  // Use printAsm() to get the assembly text.
+  MachineCode generateCode(const Program & program);
 
   // Visitor functions
   void VisitNil(const NilExpr& exp) override;
@@ -147,13 +244,48 @@ class CodeGen final : public AstVisitor {
     return nextIndex++;
   }
 
-  // Whether we are currently generating left hand-side of an
-  // assignment. This flag is used for keeping the address for an
-  // access path.
-  bool inLhsOfAssignment = false;
+  // Instructions generated so far
+  MachineCode code;
 
-  // List of instructions generated so far
-  std::vector<std::string> insns;
+  // The GC stack map of a call site: the frame slots that hold pointers
+  // while the callee runs, keyed by the return address of the call.
+  struct StackMapEntry {
+    Label returnLabel;
+    std::vector<int32_t> pointerSlots;
+  };
+  std::vector<StackMapEntry> stackMaps;
+  // Frame slots of pointer arguments that are pushed for calls whose
+  // remaining arguments are still being evaluated
+  std::vector<int32_t> pendingPointerArgs;
+
+  // Generate a call and record the stack map for its return address
+  void emitCall(const std::string & callee);
+  // Generate the stack map table read by the GC
+  void emitStackMaps();
+  // Generate the card marking barrier after a pointer is stored into a field
+  void emitWriteBarrier();
+  // Generate the data the runtime reads about how the code was compiled
+  void emitRuntimeInfo();
+  // Generate the allocation site table and the counters of the sites
+  void emitAllocationSites();
+
+  // Whether to emit write barriers
+  bool writeBarriers;
+  // Whether to profile allocation sites
+  bool allocationProfile;
+
+  // A `new` expression when profiling. Sites are named after the function,
+  // the position of the `new` among the ones in that function and the type.
+  struct AllocationSite {
+    std::string name;
+    // Size of the object without the site word, header included
+    int32_t words;
+  };
+  std::vector<AllocationSite> allocationSites;
+  // Name of the function being generated and the number of `new`
+  // expressions seen in it so far
+  std::string currentFunction = "Entry";
+  uint32_t functionAllocations = 0;
   // Symbol table
   SymbolTable symbolTable;
   // A flag to check if we are in the global scope or top level of a function body, this is needed for the top-level variables to be alive until the argument of `output`/`return`.
@@ -161,20 +293,79 @@ class CodeGen final : public AstVisitor {
 
   // allocated temporary variable, this class is used with RAII to generate code to remove the temporary when it is longer used
   class TmpVar {
-    std::string name;
+    Symbol name;
     CodeGen & codegen;
    public:
-    explicit TmpVar(const std::string & name, CodeGen &codegen);
+    // A temporary of a pointer `type` is in the stack maps of the calls made
+    // while it lives
+    TmpVar(Symbol name, Symbol type, CodeGen &codegen);
     TmpVar(const TmpVar&) = delete;
     ~TmpVar();
     int32_t operator * () const;
 
     // We use this type for temporaries
-    static const std::string IntT;
+    static const Symbol IntT;
   };
 
   // Create a fresh temporary variable that is managed via RAII
-  TmpVar freshTmp();
+  TmpVar freshTmp(Symbol type = TmpVar::IntT);
+
+  // Expression temporaries live in these registers while they last and in
+  // stack temporaries after that. allocate() preserves all but ECX; L2
+  // functions preserve the callee-saved ones like C functions do, and no
+  // temporary is live across an L2 call since calls are statements.
+  static constexpr Reg TemporaryRegisters[] = {Reg::ECX, Reg::EBX, Reg::ESI, Reg::EDI};
+  // Registers for integer variables, each function saves the ones it uses
+  // in the words right below the saved frame pointer
+  static constexpr Reg CalleeSavedRegisters[] = {Reg::EBX, Reg::ESI, Reg::EDI};
+  static constexpr int32_t SavedRegistersSize = 4 * std::size(CalleeSavedRegisters);
+  // Bit i is set while Reg(i) holds a temporary or a variable
+  uint32_t busyRegisters = 0;
+  // Bit i is set if the current function writes to Reg(i)
+  uint32_t usedRegisters = 0;
+
+  // Integer variables of the current function that live in registers.
+  // Pointers stay in their frame slots where the GC finds them.
+  std::unordered_map<Symbol, RegisterVariable> registerVariables;
+  // Allocate registers to the integer `variables` of a function with given
+  // body and result, the registers they get are not used for temporaries
+  void allocateVariables(const std::vector<std::pair<Symbol, Symbol>> & variables,
+                         const BlockStmt & body, const AstNode & result);
+  // The register of a plain variable access
+  std::optional<Reg> registerOf(const AccessPath & path) const;
+  // The memory operand for the location an access path denotes, either the
+  // frame slot of the variable or a field at an offset from EAX after the
+  // code loading the objects on the path. Only EAX is written.
+  Mem emitLocation(const AccessPath & path);
+  // The source text of `path` up to its first `fields` field accesses
+  static std::string pathName(const AccessPath & path, size_t fields);
+  // The register of a variable, or a constant or nil as an immediate: an
+  // operand used without evaluating it to EAX first
+  std::optional<Operand> directOperand(const AstNode & exp) const;
+  // Generate the code to save the callee-saved registers the function uses,
+  // the code is placed at instruction index `at`, right after the prologue
+  void emitSaveRegisters(size_t at);
+  // Generate the code to restore them before returning
+  void emitRestoreRegisters();
+
+  // The Sethi-Ullman number of an expression, the registers needed to
+  // evaluate it without spilling counting EAX, and whether it allocates
+  struct RegisterNeed {
+    int32_t registers;
+    bool allocates;
+  };
+  std::unordered_map<const AstNode*, RegisterNeed> registerNeeds;
+  RegisterNeed registerNeed(const AstNode& exp);
+  static std::pair<const AstNode*, const AstNode*> operandsOf(const AstNode& exp);
+
+  // A free temporary register, one allocate() preserves if `survivesCalls`
+  std::optional<Reg> takeRegister(bool survivesCalls);
+  void releaseRegister(Reg reg);
+
+  // Generate code for a binary operator, the result goes to EAX
+  void emitBinaryOperator(NodeKind op, const AstNode& lhs, const AstNode& rhs);
+  // Apply `op` to its operands, one of which is EAX, and put the result in EAX
+  void emitOperator(NodeKind op, Operand lhs, Operand rhs);
 };
 
 }
@@ -4,8 +4,331 @@
 #include "catch2/catch.hpp"
 #include "frontend/lexer.h"
 #include "backend/codegen.h"
+#include "backend/peephole.h"
 
 using namespace cs160::frontend;
 using Catch::Matchers::Equals;
 using Catch::Matchers::Message;
 
+using namespace cs160::backend;
+
+TEST_CASE("Printing machine code", "[machine_ir]") {
+  MachineCode code;
+  auto loop = code.newLabel("WHILE_START_0");
+  code.directive(".globl Entry");
+  code.define(code.symbol("Entry"));
+  code.comment("BODY");
+  code.define(loop);
+  code.emit(Opcode::Movl, Mem{-8, Reg::EBP}, Reg::EAX);
+  code.annotate("load x");
+  code.emit(Opcode::Movl, Imm{0x02000003, true}, Mem{-4, Reg::EAX});
+  code.emit(Opcode::Addl, Imm{1}, Sym{code.symbol("L2AllocSiteCounts"), 8});
+  code.emit(Opcode::Jmp, Sym{loop});
+  code.blank();
+  code.emit(Opcode::Ret);
+
+  std::string out;
+  printAsm(code, out);
+  REQUIRE(out ==
+          "  .globl Entry\n"
+          "Entry:\n"
+          "  // BODY\n"
+          "WHILE_START_0:\n"
+          "  movl -8(%ebp), %eax /* load x */\n"
+          "  movl $0x02000003, -4(%eax)\n"
+          "  addl $1, L2AllocSiteCounts+8\n"
+          "  jmp WHILE_START_0\n"
+          "\n"
+          "  ret\n");
+  // symbols are interned, labels are not
+  REQUIRE(code.symbol("Entry") == code.symbol("Entry"));
+  REQUIRE(!(code.newLabel("X") == code.newLabel("X")));
+}
+
+TEST_CASE("Code generation emits stack maps for calls", "[codegen]") {
+  auto program = Parser{Lexer().tokenize(
+      "struct %list { int num; %list next; };"
+      "%list head; head := new %list; output 0;")}.parse();
+  auto code = CodeGen{}.generateCode(*program);
+  std::string out;
+  printAsm(code, out);
+  REQUIRE_THAT(out, Catch::Matchers::Contains("call allocate\n.LRET_0:\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains(".long 1\n  .long .LRET_0, 1, -4\n"));
+}
+
+TEST_CASE("Live intervals cover loops and start at entry unless assigned first", "[regalloc]") {
+  auto program = Parser{Lexer().tokenize(
+      "int a; int b; int c;"
+      "a := 1;"
+      "while (a < 3) { b := a; a := a + 1; }"
+      "output b;")}.parse();
+  auto intervals = liveIntervals({"a", "b", "c"}, program->statements(), &program->arithmetic_exp());
+  REQUIRE(intervals.size() == 2);
+  // a is assigned before the loop and lives until the loop ends
+  REQUIRE(intervals[0].variable == Symbol("a"));
+  REQUIRE(intervals[0].start == 1);
+  REQUIRE(intervals[0].end == 6);
+  // b is first assigned in the loop, which may not run, so it is live on entry
+  REQUIRE(intervals[1].variable == Symbol("b"));
+  REQUIRE(intervals[1].start == 0);
+  REQUIRE(intervals[1].end == 7);
+}
+
+TEST_CASE("Linear scan reuses registers and spills the longest interval", "[regalloc]") {
+  auto shared = linearScan({{"a", 0, 4}, {"b", 1, 2}, {"c", 3, 6}, {"d", 5, 9}}, {Reg::EBX, Reg::ESI});
+  REQUIRE(shared.size() == 4);
+  REQUIRE(shared.at("a") == Reg::EBX);
+  REQUIRE(shared.at("b") == Reg::ESI);
+  REQUIRE(shared.at("c") == Reg::ESI);
+  REQUIRE(shared.at("d") == Reg::EBX);
+
+  auto spilled = linearScan({{"a", 0, 10}, {"b", 1, 3}, {"c", 2, 4}}, {Reg::EBX});
+  REQUIRE(spilled.size() == 1);
+  REQUIRE(spilled.at("b") == Reg::EBX);
+}
+
+TEST_CASE("Integer variables live in callee-saved registers, pointers in the frame", "[codegen]") {
+  auto program = Parser{Lexer().tokenize(
+      "struct %list { int num; %list next; };"
+      "int i; %list head;"
+      "while (i < 10) { head := new %list; i := i + 1; }"
+      "output i;")}.parse();
+  auto code = CodeGen{}.generateCode(*program);
+  std::string out;
+  printAsm(code, out);
+  REQUIRE_THAT(out, Catch::Matchers::Contains("  subl $12, %esp\n  movl %ebx, -4(%ebp)\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains("  movl $0, %ebx\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains("  movl %ebx, %eax\n  addl $1, %eax\n  movl %eax, %ebx\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains("  movl -4(%ebp), %ebx\n  movl %ebp, %esp\n"));
+  // head is in the stack map, the slot of i below the saved registers isn't
+  REQUIRE_THAT(out, Catch::Matchers::Contains(".long .LRET_0, 1, -5\n"));
+}
+
+TEST_CASE("Peephole rules fold moves and stack adjustments", "[peephole]") {
+  MachineCode code;
+  auto loop = code.newLabel("WHILE_START_0");
+  code.emit(Opcode::Movl, Reg::EAX, Reg::EDX);
+  code.comment("store");
+  code.emit(Opcode::Movl, Reg::EDX, Mem{-16, Reg::EBP});
+  code.annotate("store p");
+  // the address is computed from EDX
+  code.emit(Opcode::Movl, Reg::EAX, Reg::EDX);
+  code.emit(Opcode::Movl, Reg::EDX, Mem{4, Reg::EDX});
+  code.emit(Opcode::Movl, Reg::EBX, Reg::EAX);
+  code.emit(Opcode::Addl, Imm{1}, Reg::EAX);
+  code.emit(Opcode::Movl, Reg::EAX, Reg::EBX);
+  // the operand is the register being updated
+  code.emit(Opcode::Movl, Reg::EBX, Reg::EAX);
+  code.emit(Opcode::Imull, Reg::EAX, Reg::EAX);
+  code.emit(Opcode::Movl, Reg::EAX, Reg::EBX);
+  code.emit(Opcode::Subl, Imm{0}, Reg::ESP);
+  code.emit(Opcode::Subl, Imm{4}, Reg::ESP);
+  code.emit(Opcode::Addl, Imm{4}, Reg::ESP);
+  code.emit(Opcode::Subl, Imm{8}, Reg::ESP);
+  code.emit(Opcode::Movl, Reg::EAX, Reg::ESI);
+  code.emit(Opcode::Movl, Reg::ESI, Reg::EAX);
+  // a label ends a match
+  code.emit(Opcode::Addl, Imm{4}, Reg::ESP);
+  code.define(loop);
+  code.emit(Opcode::Addl, Imm{4}, Reg::ESP);
+  // the flags of the comparison are read
+  code.emit(Opcode::Cmpl, Imm{0}, Reg::EAX);
+  code.emit(Opcode::Addl, Imm{0}, Reg::ESP);
+  code.emit(Opcode::Sete, Reg::AL);
+
+  PeepholeOptimizer peephole;
+  peephole.run(code);
+  std::string out;
+  printAsm(code, out);
+  REQUIRE(out ==
+          "  // store\n"
+          "  movl %eax, -16(%ebp) /* store p */\n"
+          "  movl %eax, %edx\n"
+          "  movl %edx, 4(%edx)\n"
+          "  addl $1, %ebx\n"
+          "  movl %ebx, %eax\n"
+          "  movl %ebx, %eax\n"
+          "  imull %eax, %eax\n"
+          "  movl %eax, %ebx\n"
+          "  subl $8, %esp\n"
+          "  movl %eax, %esi\n"
+          "  addl $4, %esp\n"
+          "WHILE_START_0:\n"
+          "  addl $4, %esp\n"
+          "  cmpl $0, %eax\n"
+          "  addl $0, %esp\n"
+          "  sete %al\n");
+
+  // in the order of peepholeRules()
+  REQUIRE(peephole.counts() == std::vector<uint64_t>{1, 1, 1, 1, 0, 1});
+
+  std::ostringstream stats;
+  peephole.printStats(stats);
+  REQUIRE_THAT(stats.str(), Catch::Matchers::Contains("Peephole rule update-in-place: 1\n"));
+}
+
+TEST_CASE("Peephole rules are selected by name", "[peephole]") {
+  auto rules = peepholeRules({"self-move"});
+  REQUIRE(rules.size() == 1);
+  REQUIRE(rules[0].name == "self-move");
+  REQUIRE_THROWS_AS(peepholeRules({"no-such-rule"}), std::invalid_argument);
+
+  MachineCode code;
+  code.emit(Opcode::Movl, Reg::EBX, Reg::EBX);
+  code.emit(Opcode::Addl, Imm{0}, Reg::ESP);
+  code.emit(Opcode::Ret);
+  PeepholeOptimizer peephole{rules};
+  peephole.run(code);
+  std::string out;
+  printAsm(code, out);
+  REQUIRE(out == "  addl $0, %esp\n  ret\n");
+}
+
+TEST_CASE("Field offsets are folded into the loads and stores of access paths", "[codegen]") {
+  auto program = Parser{Lexer().tokenize(
+      "struct %list { int num; %list next; };"
+      "%list p; int x;"
+      "x := p.next.num;"
+      "p.next.next := p;"
+      "p.next := nil;"
+      "output x;")}.parse();
+  auto code = CodeGen{}.generateCode(*program);
+  std::string out;
+  printAsm(code, out);
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  movl -16(%ebp), %eax /* load p */\n"
+      "  movl 4(%eax), %eax /* load p.next */\n"
+      "  movl 0(%eax), %eax /* load p.next.num */\n"
+      "  movl %eax, %ebx\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  movl %eax, %edx\n"
+      "  movl -16(%ebp), %eax /* load p */\n"
+      "  movl 4(%eax), %eax /* load p.next */\n"
+      "  movl %edx, 4(%eax) /* store p.next.next */\n"
+      "  leal 4(%eax), %eax\n"
+      "  // CARD MARKING BARRIER\n"));
+  // storing nil needs no barrier
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  movb $1, 0(%eax)\n"
+      "  movl -16(%ebp), %eax /* load p */\n"
+      "  movl $0, 4(%eax) /* store p.next */\n"
+      "\n"));
+}
+
+TEST_CASE("Types with pointers past the tag bits start with a pointer bitmap", "[codegen]") {
+  std::string fields;
+  for (int i = 0; i < 23; ++i) {
+    fields += "int f" + std::to_string(i) + "; ";
+  }
+  auto program = Parser{Lexer().tokenize(
+      "struct %wide { " + fields + "%wide p; };"
+      "%wide w; w := new %wide; w.p := w; output 0;")}.parse();
+  auto code = CodeGen{}.generateCode(*program);
+  std::string out;
+  printAsm(code, out);
+  // 25 words with one bitmap word, field 23 is word 24
+  REQUIRE_THAT(out, Catch::Matchers::Contains("  movl $0x19800003, -4(%eax)\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains("  movl $0x01000000, 0(%eax)\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains("/* load w */\n  movl %edx, 96(%eax) /* store w.p */\n"));
+
+  // the tag can't count more than 255 words
+  for (int i = 23; i < 255; ++i) {
+    fields += "int f" + std::to_string(i) + "; ";
+  }
+  auto tooWide = Parser{Lexer().tokenize(
+      "struct %wide { " + fields + "%wide p; };"
+      "output 0;")}.parse();
+  REQUIRE_THROWS_MATCHES(CodeGen{}.generateCode(*tooWide), CodeGenError,
+                         Message("Type %wide has more fields than an object can hold"));
+}
+
+TEST_CASE("Temporaries stay in registers unless a collection may move them", "[codegen]") {
+  auto program = Parser{Lexer().tokenize(
+      "struct %list { int num; %list next; };"
+      "%list p; int x;"
+      "if (new %list = new %list) { x := 1; } else { x := 2; }"
+      "if ([new %list = nil] || [new %list = nil]) { x := 3; } else { x := 4; }"
+      "output x + (p.num * 2) * (p.num * 3);")}.parse();
+  auto code = CodeGen{}.generateCode(*program);
+  std::string out;
+  printAsm(code, out);
+  // a new object held while the other operand allocates is in the stack map
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  // END NEW %list\n"
+      "  subl $4, %esp\n"
+      "  movl %eax, -24(%ebp)\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains(".long .LRET_1, 2, -6, -4\n"));
+  // an integer held across allocate() skips ECX, which allocate() clobbers
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  movzbl %al, %eax\n"
+      "  movl %eax, %esi\n"
+      "  // ALLOCATE FOR NEW %list\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains("  orl %esi, %eax\n"));
+  // and one that isn't can use it
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  imull $2, %eax\n"
+      "  movl %eax, %ecx\n"
+      "  movl -16(%ebp), %eax /* load p */\n"
+      "  movl 0(%eax), %eax /* load p.num */\n"
+      "  imull $3, %eax\n"
+      "  imull %ecx, %eax\n"));
+}
+
+TEST_CASE("Peephole rules drop the stack adjustments at the end of blocks", "[peephole]") {
+  auto program = Parser{Lexer().tokenize(
+      "int x;"
+      "if (x < 1) { x := 1; } else { x := 2; }"
+      "output x;")}.parse();
+  auto code = CodeGen{}.generateCode(*program);
+  std::string before;
+  printAsm(code, before);
+  REQUIRE_THAT(before, Catch::Matchers::Contains("  addl $0, %esp\n  jmp IF_END_0\n"));
+  REQUIRE_THAT(before, Catch::Matchers::Contains("  addl $0, %esp\nIF_END_0:\n"));
+
+  PeepholeOptimizer peephole;
+  peephole.run(code);
+  std::string out;
+  printAsm(code, out);
+  REQUIRE_THAT(out, !Catch::Matchers::Contains("addl $0, %esp"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  movl $1, %ebx\n"
+      "  jmp IF_END_0\n"
+      "IF_FALSE_0:\n"
+      "  movl $2, %ebx\n"
+      "IF_END_0:\n"));
+}
+
+TEST_CASE("Peephole rules fold the moves of stores and register updates", "[peephole]") {
+  auto program = Parser{Lexer().tokenize(
+      "struct %list { int num; %list next; };"
+      "%list p; int x;"
+      "p := new %list;"
+      "x := x + 10;"
+      "output x;")}.parse();
+  auto code = CodeGen{}.generateCode(*program);
+  std::string before;
+  printAsm(code, before);
+  REQUIRE_THAT(before, Catch::Matchers::Contains(
+      "  movl %eax, %edx\n"
+      "  movl %edx, -16(%ebp) /* store p */\n"));
+  REQUIRE_THAT(before, Catch::Matchers::Contains(
+      "  movl %ebx, %eax\n"
+      "  addl $10, %eax\n"
+      "  movl %eax, %ebx\n"));
+
+  PeepholeOptimizer peephole;
+  peephole.run(code);
+  std::string out;
+  printAsm(code, out);
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  // END NEW %list\n"
+      "  movl %eax, -16(%ebp) /* store p */\n"));
+  REQUIRE_THAT(out, Catch::Matchers::Contains(
+      "  addl $10, %ebx\n"
+      "  movl %ebx, %eax\n"));
+
+  std::ostringstream stats;
+  peephole.printStats(stats);
+  REQUIRE_THAT(stats.str(), Catch::Matchers::Contains("Peephole rule store-through-scratch: 1\n"));
+  REQUIRE_THAT(stats.str(), Catch::Matchers::Contains("Peephole rule update-in-place: 1\n"));
+}
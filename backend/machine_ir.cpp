@@ -0,0 +1,145 @@
+#include "backend/machine_ir.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace cs160::backend {
+
+namespace {
+
+constexpr std::string_view RegNames[] = {"%eax", "%ecx", "%edx", "%ebx", "%esp",
+                                         "%ebp", "%esi", "%edi", "%al"};
+
+// Indexed by Opcode, empty for the pseudo instructions
+constexpr std::string_view Mnemonics[] = {
+    "",      "",      "",      "",     "movl", "movb", "movzbl", "leal", "addl",
+    "adcl",  "subl",  "negl",  "imull", "andl", "orl", "shrl",   "cmpl", "sete",
+    "setl",  "setle", "setg",  "setge", "pushl", "popl", "call", "ret",  "jmp",
+    "je",    "ja"};
+
+static_assert(sizeof(Mnemonics) / sizeof(Mnemonics[0]) == size_t(Opcode::Ja) + 1,
+              "every opcode needs a mnemonic");
+
+void appendInt(std::string& out, int32_t value) {
+  char digits[16];
+  auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+  out.append(digits, end);
+}
+
+void appendHex(std::string& out, uint32_t value) {
+  static constexpr char Digits[] = "0123456789abcdef";
+  out += "0x";
+  for (int shift = 28; shift >= 0; shift -= 4) {
+    out += Digits[(value >> shift) & 0xf];
+  }
+}
+
+struct OperandPrinter {
+  const MachineCode& code;
+  std::string& out;
+
+  void operator()(Reg reg) { out += RegNames[size_t(reg)]; }
+  void operator()(const Imm& imm) {
+    out += '$';
+    if (imm.hex) {
+      appendHex(out, static_cast<uint32_t>(imm.value));
+    } else {
+      appendInt(out, imm.value);
+    }
+  }
+  void operator()(const Mem& mem) {
+    appendInt(out, mem.offset);
+    out += '(';
+    out += RegNames[size_t(mem.base)];
+    out += ')';
+  }
+  void operator()(const Sym& sym) {
+    out += code.name(sym.label);
+    if (sym.offset != 0) {
+      out += '+';
+      appendInt(out, sym.offset);
+    }
+  }
+};
+
+}  // namespace
+
+MachineCode::MachineCode() : strings{""} {}
+
+Label MachineCode::newLabel(std::string name) {
+  labelNames.push_back(std::move(name));
+  return Label{static_cast<uint32_t>(labelNames.size() - 1)};
+}
+
+Label MachineCode::symbol(const std::string& name) {
+  auto found = symbols.find(name);
+  if (found != symbols.end()) {
+    return found->second;
+  }
+  auto label = newLabel(name);
+  symbols.emplace(name, label);
+  return label;
+}
+
+void MachineCode::comment(std::string text) {
+  Instruction insn{Opcode::Comment};
+  insn.text = addString(std::move(text));
+  insns.push_back(insn);
+}
+
+void MachineCode::directive(std::string text) {
+  Instruction insn{Opcode::Directive};
+  insn.text = addString(std::move(text));
+  insns.push_back(insn);
+}
+
+void MachineCode::hoist(size_t from, size_t at) {
+  std::rotate(insns.begin() + at, insns.begin() + from, insns.end());
+}
+
+uint32_t MachineCode::addString(std::string text) {
+  strings.push_back(std::move(text));
+  return static_cast<uint32_t>(strings.size() - 1);
+}
+
+void printAsm(const MachineCode& code, std::string& out) {
+  OperandPrinter printOperand{code, out};
+  for (auto& insn : code.instructions()) {
+    switch (insn.op) {
+      case Opcode::Label:
+        printOperand(std::get<Sym>(insn.operands[0]));
+        out += ":\n";
+        continue;
+      case Opcode::Comment:
+        out += "  // ";
+        out += code.string(insn.text);
+        out += '\n';
+        continue;
+      case Opcode::Directive:
+        out += "  ";
+        out += code.string(insn.text);
+        out += '\n';
+        continue;
+      case Opcode::Blank:
+        out += '\n';
+        continue;
+      default:
+        break;
+    }
+
+    out += "  ";
+    out += Mnemonics[size_t(insn.op)];
+    for (uint8_t i = 0; i < insn.numOperands; ++i) {
+      out += i == 0 ? " " : ", ";
+      std::visit(printOperand, insn.operands[i]);
+    }
+    if (insn.text != 0) {
+      out += " /* ";
+      out += code.string(insn.text);
+      out += " */";
+    }
+    out += '\n';
+  }
+}
+
+}  // namespace cs160::backend
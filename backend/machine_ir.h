@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace cs160::backend {
+
+// A typed representation of the x86 assembly the code generator produces.
+// Instructions are plain values that later passes can inspect and rewrite;
+// text is only produced once, by printAsm().
+
+enum class Reg : uint8_t { EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI, AL };
+
+enum class Opcode : uint8_t {
+  // Pseudo instructions: a label definition, a line comment, an assembler
+  // directive and an empty line
+  Label,
+  Comment,
+  Directive,
+  Blank,
+  // Machine instructions, printed with their AT&T mnemonics
+  Movl,
+  Movb,
+  Movzbl,
+  Leal,
+  Addl,
+  Adcl,
+  Subl,
+  Negl,
+  Imull,
+  Andl,
+  Orl,
+  Shrl,
+  Cmpl,
+  Sete,
+  Setl,
+  Setle,
+  Setg,
+  Setge,
+  Pushl,
+  Popl,
+  Call,
+  Ret,
+  Jmp,
+  Je,
+  Ja,
+};
+
+// A label, an index into the label names of a MachineCode
+struct Label {
+  uint32_t id;
+
+  bool operator==(Label that) const { return id == that.id; }
+  bool operator!=(Label that) const { return id != that.id; }
+};
+
+// Immediate operand, `hex` only changes how it is printed
+struct Imm {
+  int32_t value;
+  bool hex = false;
+
+  bool operator==(const Imm& that) const { return value == that.value; }
+  bool operator!=(const Imm& that) const { return !(*this == that); }
+};
+
+// Memory operand offset(base)
+struct Mem {
+  int32_t offset;
+  Reg base;
+
+  bool operator==(const Mem& that) const {
+    return offset == that.offset && base == that.base;
+  }
+  bool operator!=(const Mem& that) const { return !(*this == that); }
+};
+
+// The address of a label plus an offset, used for jump and call targets and
+// for absolute memory operands
+struct Sym {
+  Label label;
+  int32_t offset = 0;
+
+  bool operator==(const Sym& that) const {
+    return label == that.label && offset == that.offset;
+  }
+  bool operator!=(const Sym& that) const { return !(*this == that); }
+};
+
+using Operand = std::variant<Reg, Imm, Mem, Sym>;
+
+struct Instruction {
+  Opcode op;
+  uint8_t numOperands = 0;
+  // For Comment and Directive the text, for machine instructions an optional
+  // trailing comment. An index into the strings of a MachineCode, 0 is none.
+  uint32_t text = 0;
+  // AT&T order: source first
+  Operand operands[2] = {Reg::EAX, Reg::EAX};
+
+  bool isPseudo() const { return op <= Opcode::Blank; }
+};
+
+// A program as a list of instructions, with the names of its labels and the
+// text of its comments and directives
+class MachineCode {
+ public:
+  MachineCode();
+
+  // A new label with given name, the name must be unique
+  Label newLabel(std::string name);
+  // The label of a symbol defined elsewhere, or by a directive, returns the
+  // same label for the same name
+  Label symbol(const std::string& name);
+
+  void emit(Opcode op) { insns.push_back(Instruction{op}); }
+  void emit(Opcode op, Operand a) {
+    Instruction insn{op, 1};
+    insn.operands[0] = a;
+    insns.push_back(insn);
+  }
+  void emit(Opcode op, Operand a, Operand b) {
+    Instruction insn{op, 2};
+    insn.operands[0] = a;
+    insn.operands[1] = b;
+    insns.push_back(insn);
+  }
+  // Attach a trailing comment to the last instruction
+  void annotate(std::string text) { insns.back().text = addString(std::move(text)); }
+
+  void define(Label label) { emit(Opcode::Label, Sym{label}); }
+  void comment(std::string text);
+  void directive(std::string text);
+  void blank() { emit(Opcode::Blank); }
+  // Move the instructions from index `from` to the end so they start at
+  // index `at`, before the ones emitted in between
+  void hoist(size_t from, size_t at);
+
+  std::vector<Instruction>& instructions() { return insns; }
+  const std::vector<Instruction>& instructions() const { return insns; }
+  std::string_view name(Label label) const { return labelNames[label.id]; }
+  std::string_view string(uint32_t text) const { return strings[text]; }
+
+ private:
+  uint32_t addString(std::string text);
+
+  std::vector<Instruction> insns;
+  std::vector<std::string> labelNames;
+  std::unordered_map<std::string, Label> symbols;
+  // strings[0] is the empty string
+  std::vector<std::string> strings;
+};
+
+// Append the AT&T syntax for `code` to `out`, one line per instruction
+void printAsm(const MachineCode& code, std::string& out);
+
+}  // namespace cs160::backend
@@ -0,0 +1,274 @@
+#include "backend/peephole.h"
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+
+namespace cs160::backend {
+
+namespace {
+
+constexpr Reg EDX = Reg::EDX;
+constexpr Reg ESP = Reg::ESP;
+
+Instruction make(Opcode op, Operand a, Operand b, uint32_t text = 0) {
+  Instruction insn{op, 2, text};
+  insn.operands[0] = a;
+  insn.operands[1] = b;
+  return insn;
+}
+
+bool readsFlags(Opcode op) {
+  switch (op) {
+    case Opcode::Adcl:
+    case Opcode::Sete:
+    case Opcode::Setl:
+    case Opcode::Setle:
+    case Opcode::Setg:
+    case Opcode::Setge:
+    case Opcode::Je:
+    case Opcode::Ja:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Whether the flags left by the matched instructions may be changed, the
+// instruction after them must not read them. The code generator sets the
+// flags right before every instruction that reads them, so they are never
+// live where control leaves or joins at a jump or a label.
+bool flagsUnused(const Instruction* next) {
+  return !next || !readsFlags(next->op);
+}
+
+// addl $n, %esp or subl $n, %esp, the amount added to ESP
+std::optional<int32_t> stackAdjustment(const Instruction& insn) {
+  auto amount = std::get_if<Imm>(&insn.operands[0]);
+  if ((insn.op != Opcode::Addl && insn.op != Opcode::Subl) || !amount ||
+      insn.operands[1] != Operand{ESP}) {
+    return std::nullopt;
+  }
+  return insn.op == Opcode::Addl ? amount->value : -amount->value;
+}
+
+// Whether an operand is `reg` or an address based on it
+bool mentions(const Operand& operand, Reg reg) {
+  if (auto r = std::get_if<Reg>(&operand)) {
+    return *r == reg;
+  }
+  auto address = std::get_if<Mem>(&operand);
+  return address && address->base == reg;
+}
+
+// movl S, %edx; movl %edx, D => movl S, D
+// The code generator only uses EDX as a scratch register that holds a value
+// on its way to a store, nothing reads it after that store.
+bool storeThroughScratch(const Instruction* const* insns, const Instruction*,
+                         std::vector<Instruction>& replacement) {
+  auto& copy = *insns[0];
+  auto& store = *insns[1];
+  auto& source = copy.operands[0];
+  if (copy.op != Opcode::Movl || copy.operands[1] != Operand{EDX} ||
+      store.op != Opcode::Movl || store.operands[0] != Operand{EDX} ||
+      mentions(store.operands[1], EDX)) {
+    return false;
+  }
+  // there is no move from memory to memory
+  if (!std::holds_alternative<Reg>(source) && !std::holds_alternative<Imm>(source)) {
+    return false;
+  }
+  replacement.push_back(make(Opcode::Movl, source, store.operands[1], store.text));
+  return true;
+}
+
+// movl A, R; op X, R; movl R, A => op X, A; movl A, R
+// for registers A and R when X doesn't read R. Both leave the same values in
+// A and R and the same flags.
+bool updateInPlace(const Instruction* const* insns, const Instruction*,
+                   std::vector<Instruction>& replacement) {
+  auto& load = *insns[0];
+  auto& update = *insns[1];
+  auto& store = *insns[2];
+  auto target = std::get_if<Reg>(&load.operands[0]);
+  auto reg = std::get_if<Reg>(&load.operands[1]);
+  if (load.op != Opcode::Movl || !target || !reg || store.op != Opcode::Movl ||
+      store.operands[0] != Operand{*reg} || store.operands[1] != Operand{*target} ||
+      update.operands[1] != Operand{*reg} || mentions(update.operands[0], *reg)) {
+    return false;
+  }
+  switch (update.op) {
+    case Opcode::Addl:
+    case Opcode::Subl:
+    case Opcode::Imull:
+    case Opcode::Andl:
+    case Opcode::Orl:
+      break;
+    default:
+      return false;
+  }
+  replacement.push_back(make(update.op, update.operands[0], *target, update.text));
+  replacement.push_back(make(Opcode::Movl, *target, *reg, store.text));
+  return true;
+}
+
+// addl $0, %esp => nothing
+bool dropZeroAdjustment(const Instruction* const* insns, const Instruction* next,
+                        std::vector<Instruction>&) {
+  return stackAdjustment(*insns[0]) == 0 && flagsUnused(next);
+}
+
+// subl $a, %esp; addl $b, %esp => subl $(a-b), %esp, and so on
+bool mergeStackAdjustments(const Instruction* const* insns, const Instruction* next,
+                           std::vector<Instruction>& replacement) {
+  auto first = stackAdjustment(*insns[0]);
+  auto second = stackAdjustment(*insns[1]);
+  if (!first || !second || !flagsUnused(next)) {
+    return false;
+  }
+  auto total = *first + *second;
+  if (total > 0) {
+    replacement.push_back(make(Opcode::Addl, Imm{total}, ESP));
+  } else if (total < 0) {
+    replacement.push_back(make(Opcode::Subl, Imm{-total}, ESP));
+  }
+  return true;
+}
+
+// movl X, X => nothing
+bool selfMove(const Instruction* const* insns, const Instruction*, std::vector<Instruction>&) {
+  return insns[0]->op == Opcode::Movl && insns[0]->operands[0] == insns[0]->operands[1];
+}
+
+// movl A, B; movl B, A => movl A, B
+bool redundantMove(const Instruction* const* insns, const Instruction*,
+                   std::vector<Instruction>& replacement) {
+  auto& first = *insns[0];
+  auto& second = *insns[1];
+  if (first.op != Opcode::Movl || second.op != Opcode::Movl ||
+      first.operands[0] != second.operands[1] || first.operands[1] != second.operands[0]) {
+    return false;
+  }
+  // movl 4(%eax), %eax; movl %eax, 4(%eax) stores to a different address
+  auto source = std::get_if<Mem>(&first.operands[0]);
+  if (source && first.operands[1] == Operand{source->base}) {
+    return false;
+  }
+  replacement.push_back(first);
+  return true;
+}
+
+}  // namespace
+
+const std::vector<PeepholeRule>& peepholeRules() {
+  static const std::vector<PeepholeRule> rules = {
+      {"store-through-scratch", 2, storeThroughScratch},
+      {"update-in-place", 3, updateInPlace},
+      {"drop-zero-adjustment", 1, dropZeroAdjustment},
+      {"merge-stack-adjustments", 2, mergeStackAdjustments},
+      {"self-move", 1, selfMove},
+      {"redundant-move", 2, redundantMove},
+  };
+  return rules;
+}
+
+std::vector<PeepholeRule> peepholeRules(const std::vector<std::string>& names) {
+  std::vector<PeepholeRule> selected;
+  for (auto& name : names) {
+    auto& all = peepholeRules();
+    auto rule = std::find_if(all.begin(), all.end(), [&](auto& r) { return r.name == name; });
+    if (rule == all.end()) {
+      throw std::invalid_argument{"unknown peephole rule " + name};
+    }
+    selected.push_back(*rule);
+  }
+  return selected;
+}
+
+PeepholeOptimizer::PeepholeOptimizer(std::vector<PeepholeRule> rules)
+    : rules(std::move(rules)), fired(this->rules.size(), 0) {
+  for (auto& rule : this->rules) {
+    if (rule.length == 0 || rule.length > MaxLength) {
+      throw std::invalid_argument{"peephole rule " + rule.name + " matches too many instructions"};
+    }
+  }
+}
+
+void PeepholeOptimizer::run(MachineCode& code) {
+  auto& insns = code.instructions();
+  // Instructions are copied to `out` one by one and the rules are tried on
+  // the end of it after each, so a rewrite can enable the next one right
+  // away. Passes repeat until none of the rules fires.
+  for (bool changed = true; changed;) {
+    auto before = std::accumulate(fired.begin(), fired.end(), uint64_t{0});
+    std::vector<Instruction> out;
+    out.reserve(insns.size());
+    for (size_t i = 0; i < insns.size(); ++i) {
+      out.push_back(insns[i]);
+      if (insns[i].isPseudo()) {
+        continue;
+      }
+      // the instruction that runs next, unless there is a label in between
+      const Instruction* next = nullptr;
+      for (auto j = i + 1; j < insns.size(); ++j) {
+        auto op = insns[j].op;
+        if (op != Opcode::Comment && op != Opcode::Blank) {
+          next = op == Opcode::Label || op == Opcode::Directive ? nullptr : &insns[j];
+          break;
+        }
+      }
+      while (rewriteTail(out, next)) {
+      }
+    }
+    insns = std::move(out);
+    changed = std::accumulate(fired.begin(), fired.end(), uint64_t{0}) != before;
+  }
+}
+
+bool PeepholeOptimizer::rewriteTail(std::vector<Instruction>& out, const Instruction* next) {
+  // The last machine instructions of `out` after the last label, last first
+  size_t tail[MaxLength];
+  size_t found = 0;
+  for (auto j = out.size(); j-- > 0 && found < MaxLength;) {
+    auto op = out[j].op;
+    if (op == Opcode::Label || op == Opcode::Directive) {
+      break;
+    }
+    if (op != Opcode::Comment && op != Opcode::Blank) {
+      tail[found++] = j;
+    }
+  }
+
+  std::vector<Instruction> replacement;
+  for (size_t r = 0; r < rules.size(); ++r) {
+    auto length = rules[r].length;
+    if (length > found) {
+      continue;
+    }
+    const Instruction* window[MaxLength];
+    for (size_t k = 0; k < length; ++k) {
+      window[k] = &out[tail[length - 1 - k]];
+    }
+    if (!rules[r].rewrite(window, next, replacement)) {
+      continue;
+    }
+    ++fired[r];
+    // the comments between the matched instructions stay before the
+    // replacement
+    for (size_t k = 0; k < length; ++k) {
+      out.erase(out.begin() + tail[k]);
+    }
+    out.insert(out.end(), replacement.begin(), replacement.end());
+    return true;
+  }
+  return false;
+}
+
+void PeepholeOptimizer::printStats(std::ostream& out) const {
+  for (size_t r = 0; r < rules.size(); ++r) {
+    out << "Peephole rule " << rules[r].name << ": " << fired[r] << "\n";
+  }
+}
+
+}  // namespace cs160::backend
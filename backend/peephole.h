@@ -0,0 +1,55 @@
+#pragma once
+
+#include "backend/machine_ir.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cs160::backend {
+
+// A rewrite of a few adjacent machine instructions. Comments and blank lines
+// between them are skipped, labels and directives are never part of a match
+// since control may join there.
+struct PeepholeRule {
+  std::string name;
+  // Number of instructions the rule matches, at most
+  // PeepholeOptimizer::MaxLength
+  size_t length;
+  // If `insns` match the rule, put what they are replaced with, possibly
+  // nothing, into `replacement` and return true. `next` is the instruction
+  // that follows them, or null if control may join or leave there.
+  bool (*rewrite)(const Instruction* const* insns, const Instruction* next,
+                  std::vector<Instruction>& replacement);
+};
+
+// All rules, in the order they are tried
+const std::vector<PeepholeRule>& peepholeRules();
+
+// The rules with given names, throws std::invalid_argument for an unknown name
+std::vector<PeepholeRule> peepholeRules(const std::vector<std::string>& names);
+
+// Rewrites generated code with a set of rules until none of them matches.
+// Every rewrite makes the code shorter, so this terminates.
+class PeepholeOptimizer {
+ public:
+  static constexpr size_t MaxLength = 4;
+
+  explicit PeepholeOptimizer(std::vector<PeepholeRule> rules = peepholeRules());
+
+  void run(MachineCode& code);
+
+  // The number of times each rule fired so far, in the order of the rules
+  const std::vector<uint64_t>& counts() const { return fired; }
+  void printStats(std::ostream& out) const;
+
+ private:
+  // Try the rules on the instructions at the end of `out`, return whether
+  // one of them fired
+  bool rewriteTail(std::vector<Instruction>& out, const Instruction* next);
+
+  std::vector<PeepholeRule> rules;
+  std::vector<uint64_t> fired;
+};
+
+}  // namespace cs160::backend
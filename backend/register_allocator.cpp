@@ -0,0 +1,198 @@
+#include "backend/register_allocator.h"
+#include "frontend/ast_walker.h"
+
+#include <algorithm>
+
+namespace cs160::backend {
+
+namespace {
+
+// Numbers the occurrences of the tracked variables in evaluation order
+class Liveness : public AstWalker<Liveness> {
+ public:
+  explicit Liveness(const std::vector<Symbol>& variables) {
+    for (auto variable : variables) {
+      tracked.emplace(variable, intervals.size());
+      intervals.push_back({variable, 0, 0});
+      seen.push_back(false);
+    }
+  }
+
+  std::vector<LiveInterval> result() {
+    // A value flows around the back edge of a loop, so a variable that is live
+    // somewhere in a loop stays live until the loop is done. Intervals that
+    // start in a loop start at the entry, see occurrence().
+    for (auto [start, end] : loops) {
+      for (auto& interval : intervals) {
+        if (interval.start <= end && interval.end >= start) {
+          interval.end = std::max(interval.end, end);
+        }
+      }
+    }
+    std::vector<LiveInterval> used;
+    for (size_t i = 0; i < intervals.size(); ++i) {
+      if (seen[i]) {
+        used.push_back(intervals[i]);
+      }
+    }
+    return used;
+  }
+
+  void VisitNil(const NilExpr&) {}
+  void VisitNewExpr(const NewExpr&) {}
+  void VisitIntegerExpr(const IntegerExpr&) {}
+  void VisitVariable(const Variable& exp) { occurrence(exp.name(), false); }
+  void VisitAccessPath(const AccessPath& exp) { Walk(exp.root()); }
+  void VisitAddExpr(const AddExpr& exp) { binary(exp.lhs(), exp.rhs()); }
+  void VisitSubtractExpr(const SubtractExpr& exp) { binary(exp.lhs(), exp.rhs()); }
+  void VisitMultiplyExpr(const MultiplyExpr& exp) { binary(exp.lhs(), exp.rhs()); }
+  void VisitLessThanExpr(const LessThanExpr& exp) { binary(exp.lhs(), exp.rhs()); }
+  void VisitLessThanEqualToExpr(const LessThanEqualToExpr& exp) { binary(exp.lhs(), exp.rhs()); }
+  void VisitEqualToExpr(const EqualToExpr& exp) { binary(exp.lhs(), exp.rhs()); }
+  void VisitLogicalAndExpr(const LogicalAndExpr& exp) { binary(exp.lhs(), exp.rhs()); }
+  void VisitLogicalOrExpr(const LogicalOrExpr& exp) { binary(exp.lhs(), exp.rhs()); }
+  void VisitLogicalNotExpr(const LogicalNotExpr& exp) { Walk(exp.operand()); }
+  void VisitTypeExpr(const TypeExpr&) {}
+  void VisitDeclarationExpr(const Declaration&) {}
+  void VisitTypeDef(const TypeDef&) {}
+  void VisitFunctionDefExpr(const FunctionDef&) {}
+  void VisitProgramExpr(const Program&) {}
+
+  void VisitBlockStmt(const BlockStmt& block) {
+    for (auto& s : block.stmts()) {
+      Walk(*s);
+    }
+  }
+
+  void VisitAssignmentExpr(const Assignment& assignment) {
+    // the right hand side is evaluated before the store
+    Walk(assignment.rhs());
+    auto& lhs = assignment.lhs();
+    if (lhs.fieldAccesses().empty()) {
+      occurrence(lhs.root().name(), true);
+    } else {
+      Walk(lhs);
+    }
+  }
+
+  void VisitConditionalExpr(const Conditional& conditional) {
+    Walk(conditional.guard());
+    ++depth;
+    Walk(conditional.true_branch());
+    Walk(conditional.false_branch());
+    --depth;
+  }
+
+  void VisitLoopExpr(const Loop& loop) {
+    auto start = position + 1;
+    ++depth;
+    Walk(loop.guard());
+    Walk(loop.body());
+    --depth;
+    loops.emplace_back(start, position);
+  }
+
+  void VisitFunctionCallExpr(const FunctionCall& call) {
+    for (auto argument : call.arguments()) {
+      Walk(*argument);
+    }
+  }
+
+ private:
+  void binary(const AstNode& lhs, const AstNode& rhs) {
+    Walk(lhs);
+    Walk(rhs);
+  }
+
+  void occurrence(Symbol variable, bool assigned) {
+    auto found = tracked.find(variable);
+    if (found == tracked.end()) {
+      return;
+    }
+    auto i = found->second;
+    ++position;
+    if (!seen[i]) {
+      seen[i] = true;
+      // Only an assignment outside of conditionals and loops is sure to
+      // overwrite the initial value before it is read
+      intervals[i].start = assigned && depth == 0 ? position : 0;
+    }
+    intervals[i].end = position;
+  }
+
+  std::unordered_map<Symbol, size_t> tracked;
+  std::vector<LiveInterval> intervals;
+  std::vector<bool> seen;
+  // First and last positions of each loop
+  std::vector<std::pair<uint32_t, uint32_t>> loops;
+  uint32_t position = 0;
+  // Number of enclosing conditionals and loops
+  uint32_t depth = 0;
+};
+
+}  // namespace
+
+std::vector<LiveInterval> liveIntervals(const std::vector<Symbol>& variables,
+                                        const BlockStmt& body,
+                                        const AstNode* result) {
+  Liveness liveness(variables);
+  liveness.Walk(body);
+  if (result) {
+    liveness.Walk(*result);
+  }
+  return liveness.result();
+}
+
+std::unordered_map<Symbol, Reg> linearScan(std::vector<LiveInterval> intervals,
+                                           const std::vector<Reg>& registers) {
+  std::stable_sort(intervals.begin(), intervals.end(),
+                   [](auto& a, auto& b) { return a.start < b.start; });
+
+  std::unordered_map<Symbol, Reg> assignment;
+  // Intervals holding a register, by increasing end
+  std::vector<LiveInterval> active;
+  std::vector<Reg> free(registers.rbegin(), registers.rend());
+  auto byEnd = [](auto& a, auto& b) { return a.end < b.end; };
+
+  for (auto& interval : intervals) {
+    // expire the intervals that ended before this one starts
+    while (!active.empty() && active.front().end < interval.start) {
+      free.push_back(assignment.at(active.front().variable));
+      active.erase(active.begin());
+    }
+
+    if (free.empty()) {
+      // take the register of the interval that ends last, if it is not this one
+      if (active.empty() || active.back().end <= interval.end) {
+        continue;
+      }
+      auto spilled = active.back();
+      active.pop_back();
+      assignment[interval.variable] = assignment.at(spilled.variable);
+      assignment.erase(spilled.variable);
+    } else {
+      assignment[interval.variable] = free.back();
+      free.pop_back();
+    }
+    active.insert(std::upper_bound(active.begin(), active.end(), interval, byEnd), interval);
+  }
+  return assignment;
+}
+
+std::unordered_map<Symbol, RegisterVariable> allocateRegisters(
+    const std::vector<Symbol>& variables, const BlockStmt& body,
+    const AstNode* result, const std::vector<Reg>& registers) {
+  auto intervals = liveIntervals(variables, body, result);
+  auto assignment = linearScan(intervals, registers);
+
+  std::unordered_map<Symbol, RegisterVariable> allocation;
+  for (auto& interval : intervals) {
+    auto reg = assignment.find(interval.variable);
+    if (reg != assignment.end()) {
+      allocation.emplace(interval.variable, RegisterVariable{reg->second, interval.start == 0});
+    }
+  }
+  return allocation;
+}
+
+}  // namespace cs160::backend
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "frontend/ast.h"
+#include "backend/machine_ir.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace cs160::frontend;
+
+namespace cs160::backend {
+
+// Register allocation for the variables of a function. Liveness is computed
+// on the AST: occurrences of variables are numbered in evaluation order and a
+// variable is live from its first to its last occurrence, or from the entry
+// of the function when its initial value may be read. Loops extend the
+// intervals of the variables used in them to the end of the loop, since the
+// value flows around the back edge.
+
+// The positions where a variable is live, position 0 is the entry of the
+// function
+struct LiveInterval {
+  Symbol variable;
+  uint32_t start;
+  uint32_t end;
+};
+
+// The register of a variable that doesn't live in its frame slot
+struct RegisterVariable {
+  Reg reg;
+  // Whether the value the variable has on entry is read, a parameter then has
+  // to be loaded into the register and a local cleared. It isn't when the
+  // first occurrence of the variable is an assignment that runs on all paths.
+  bool liveIn;
+};
+
+// The live intervals of `variables` in a function body followed by the
+// expression `result`, which may be null. Unused variables get no interval.
+std::vector<LiveInterval> liveIntervals(const std::vector<Symbol>& variables,
+                                        const BlockStmt& body,
+                                        const AstNode* result);
+
+// Assign `registers` to the intervals with linear scan: walk the intervals by
+// start, free the registers of the intervals that ended and when none is
+// left, spill the interval that ends last. Spilled variables are missing from
+// the result.
+std::unordered_map<Symbol, Reg> linearScan(std::vector<LiveInterval> intervals,
+                                           const std::vector<Reg>& registers);
+
+// Both of the above
+std::unordered_map<Symbol, RegisterVariable> allocateRegisters(
+    const std::vector<Symbol>& variables, const BlockStmt& body,
+    const AstNode* result, const std::vector<Reg>& registers);
+
+}  // namespace cs160::backend
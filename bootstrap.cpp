@@ -2,10 +2,13 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <string>
 
 // The runtime memory manager.
-GcSemiSpace *gc;
+GarbageCollector *gc;
 
 // 'Entry' is the entry point of an L2 program.
 extern "C" {
@@ -17,9 +20,11 @@ int32_t Entry(void);
 extern "C" intptr_t *allocate(int32_t num_words) {
   // The current frame pointer is for allocate(), which is called from
   // the L2 program so we dereference the frame pointer once to get
-  // the L2 program's frame pointer.
+  // the L2 program's frame pointer. The return address tells the GC
+  // which stack map describes that frame.
   intptr_t* curr_frame_ptr = *(intptr_t**)__builtin_frame_address(0);
-  return gc->Alloc(num_words, curr_frame_ptr);
+  intptr_t return_addr = (intptr_t)__builtin_return_address(0);
+  return gc->Alloc(num_words, curr_frame_ptr, return_addr);
 }
 
 // Called by the garbage collector after each collection to report the
@@ -29,21 +34,103 @@ void ReportGCStats(size_t liveObjects, size_t liveWords) {
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
+  if (argc != 2 && argc != 3) {
     std::cerr <<
         "Must pass the total size of the heap in terms of the number of 32-bit "
-        "words (must be a positive even number).";
+        "words (must be a positive even number) or a target GC overhead such "
+        "as 5%, optionally followed by the collector to use (semispace, "
+        "generational or markcompact).";
     exit(1);
   }
 
   // Initialize the garbage collector.
-  gc = new GcSemiSpace(/*frame_ptr=*/(intptr_t *)__builtin_frame_address(0),
-                       /*heap_sizein_words=*/atoi(argv[1]));
+  intptr_t *frame_ptr = (intptr_t *)__builtin_frame_address(0);
+  std::string heap_size = argv[1];
+  int heap_size_in_words = atoi(argv[1]);
+  std::string collector = argc == 3 ? argv[2] : "semispace";
+  // L2_MIN_HEAP and L2_MAX_HEAP bound the size in words the heap may shrink
+  // and grow to
+  const char *min_heap = getenv("L2_MIN_HEAP");
+  const char *max_heap = getenv("L2_MAX_HEAP");
+  // With a target GC overhead instead of a size, the heap starts at the
+  // minimum size and the semispace collector adapts it to the program
+  std::optional<HeapSizingPolicy> sizing;
+  if (!heap_size.empty() && heap_size.back() == '%') {
+    sizing.emplace(min_heap ? atoi(min_heap) : 1024,
+                   max_heap ? atoi(max_heap) : 64 * 1024 * 1024,
+                   atof(argv[1]) / 100);
+    heap_size_in_words = sizing->minHeapWords();
+  }
+  if (sizing && collector != "semispace") {
+    std::cerr << "Only the semispace collector supports a target GC overhead\n";
+    exit(1);
+  }
+
+  if (collector == "semispace") {
+    // L2_GC_THREADS sets the number of threads that copy objects
+    const char *gc_threads = getenv("L2_GC_THREADS");
+    auto semispace = new GcSemiSpace(
+        frame_ptr, heap_size_in_words, gc_threads ? atoi(gc_threads) : 1,
+        sizing ? sizing->maxHeapWords() : max_heap ? atoi(max_heap) : 0);
+    if (sizing) {
+      semispace->setSizingPolicy(*sizing);
+    }
+    gc = semispace;
+  } else if (collector == "generational") {
+    // Minor collections find old-to-young pointers through the card table
+    if (!L2WriteBarriers) {
+      std::cerr << "The generational collector needs a program compiled with "
+                   "write barriers\n";
+      exit(1);
+    }
+    gc = new GcGenerational(frame_ptr, heap_size_in_words);
+  } else if (collector == "markcompact") {
+    gc = new GcMarkCompact(frame_ptr, heap_size_in_words);
+  } else {
+    std::cerr << "Unknown collector: " << collector << "\n";
+    exit(1);
+  }
+
+  // With L2_GC_STRESS set the collector runs at every allocation
+  if (getenv("L2_GC_STRESS")) {
+    gc->collectEveryAllocation();
+  }
+
+  // L2_GC_TELEMETRY names a file to write the collection statistics to as
+  // JSON when the program ends, or - for standard error
+  const char *telemetry_file = getenv("L2_GC_TELEMETRY");
+  std::optional<GcTelemetry> telemetry;
+  if (telemetry_file) {
+    gc->setTelemetry(&telemetry.emplace());
+  }
+  // Programs compiled with --alloc-profile report their allocation sites to
+  // L2_ALLOC_PROFILE, or standard error if it isn't set
+  AllocationProfile profile;
+  if (!profile.empty()) {
+    gc->setAllocationProfile(&profile);
+  }
 
   // Run the L2 program.
   std::cout << Entry() << "\n";
   // printf("%d\n", Entry());
 
+  if (telemetry) {
+    if (std::string(telemetry_file) == "-") {
+      telemetry->writeJson(std::cerr);
+    } else {
+      std::ofstream out(telemetry_file);
+      telemetry->writeJson(out);
+    }
+  }
+  if (!profile.empty()) {
+    if (const char *profile_file = getenv("L2_ALLOC_PROFILE")) {
+      std::ofstream out(profile_file);
+      profile.writeReport(out);
+    } else {
+      profile.writeReport(std::cerr);
+    }
+  }
+
   delete gc;
   return 0;
 }
@@ -5,9 +5,11 @@
 
 namespace cs160::frontend {
 
+const Symbol TypeExpr::IntName{"int"};
+
 std::string AstNode::toString() const {
   PrintVisitor pv;
-  this->Visit(&pv);
+  pv.Walk(*this);
   return pv.GetOutput();
 }
 
@@ -35,58 +35,91 @@
 // sequence of arithmetic expressions as arguments, and a function definition
 // has a (possibly empty) sequence of variables as parameters.
 
-#include <memory>
+#include <cstdint>
 #include <string>
 #include <typeindex>
 #include <typeinfo>
+#include <utility>
 #include <variant>
-#include <vector>
+#include "frontend/ast_arena.h"
+#include "frontend/symbol.h"
 
 namespace cs160::frontend {
 
-template <class T>
-using vec_of_ptrs = std::vector<std::unique_ptr<T>>;
-
-template <class T>
-bool pointeesEqual(const vec_of_ptrs<const T>& lhs,
-                   const vec_of_ptrs<const T>& rhs) {
-  if (lhs.size() != rhs.size()) {
-    return false;
-  }
-  for (auto lIt = lhs.begin(), rIt = rhs.begin(); lIt != lhs.end();
-       ++lIt, ++rIt) {
-    // check whether the objects the elements point to are equal
-    if (**lIt != **rIt) {
-      return false;
-    }
-  }
-  return true;
-}
-
 // forward declaration
 class AstVisitor;
 
+// The concrete node classes, so that a traversal can dispatch on a node with a
+// switch instead of a pair of virtual calls (see frontend/ast_walker.h).
+enum class NodeKind : uint8_t {
+  Nil,
+  Integer,
+  New,
+  Variable,
+  AccessPath,
+  Add,
+  Subtract,
+  Multiply,
+  LessThan,
+  LessThanEqualTo,
+  EqualTo,
+  LogicalAnd,
+  LogicalOr,
+  LogicalNot,
+  Type,
+  Block,
+  Declaration,
+  Assignment,
+  Conditional,
+  Loop,
+  FunctionCall,
+  FunctionDef,
+  TypeDef,
+  Program,
+};
+
 // The definition of the abstract syntax tree abstract base class.
+//
+// Nodes are allocated in an AstArena and are never destroyed one by one, so
+// they must stay trivially destructible: they hold symbols, values,
+// NodeLists and pointers to other nodes but no owning members.
 class AstNode {
  public:
-  virtual ~AstNode() {}
+  ~AstNode() = default;
 
   std::string toString() const;
 
   virtual void Visit(AstVisitor* visitor) const = 0;
+
+  NodeKind kind() const { return kind_; }
+
+ protected:
+  explicit AstNode(NodeKind kind) : kind_(kind) {}
+
+ private:
+  // Which concrete class this node is
+  NodeKind kind_;
 };
 
 // This is the abstract base class from which all arithmetic expressions will
 // inherit (integers, variables, and binary arithmetic operations) as well as
 // the humble function call.
-class RhsExpr : public AstNode {};
+class RhsExpr : public AstNode {
+ protected:
+  using AstNode::AstNode;
+};
 
-class ArithmeticExpr : public RhsExpr {};
+class ArithmeticExpr : public RhsExpr {
+ protected:
+  using RhsExpr::RhsExpr;
+};
 
 // An integer constant expression.
 class IntegerExpr final : public ArithmeticExpr {
  public:
-  explicit IntegerExpr(int value) : value_(value) {}
+  static constexpr NodeKind Kind = NodeKind::Integer;
+
+  explicit IntegerExpr(int value) : ArithmeticExpr(Kind), value_(value) {}
 
   void Visit(AstVisitor* visitor) const override;
 
@@ -100,82 +133,91 @@ class IntegerExpr final : public ArithmeticExpr {
 // New struct value expression
 class NewExpr final : public ArithmeticExpr {
  public:
-  explicit NewExpr(std::string type) : type_(type) {}
+  static constexpr NodeKind Kind = NodeKind::New;
+
+  explicit NewExpr(Symbol type) : ArithmeticExpr(Kind), type_(type) {}
 
   void Visit(AstVisitor* visitor) const override;
 
-  const std::string & type() const { return type_; }
+  Symbol type() const { return type_; }
 
  private:
   // The type of the allocated value
-  const std::string type_;
+  const Symbol type_;
 };
 
 // A nil constant
 class NilExpr final : public ArithmeticExpr {
  public:
-  NilExpr() {}
+  static constexpr NodeKind Kind = NodeKind::Nil;
+
+  NilExpr() : ArithmeticExpr(Kind) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
 
 // A program variable
-class Variable final : AstNode {
+class Variable final : public AstNode {
  public:
-  explicit Variable(const std::string& name) : name_(name) {}
+  static constexpr NodeKind Kind = NodeKind::Variable;
+
+  explicit Variable(Symbol name) : AstNode(Kind), name_(name) {}
 
   void Visit(AstVisitor* visitor) const override;
 
-  const std::string& name() const { return name_; }
+  Symbol name() const { return name_; }
 
  private:
   // The name of the variable.
-  std::string name_;
+  Symbol name_;
 };
 
 // An access path
 class AccessPath final : public ArithmeticExpr {
  public:
-  AccessPath(const Variable & root, const std::vector<std::string> & fieldAccesses) : root_(root), fieldAccesses_(fieldAccesses) {}
-  AccessPath(Variable && root, std::vector<std::string> && fieldAccesses) : root_(root), fieldAccesses_(fieldAccesses) {}
+  static constexpr NodeKind Kind = NodeKind::AccessPath;
+
+  AccessPath(const Variable & root, NodeList<Symbol> fieldAccesses) : ArithmeticExpr(Kind), root_(root), fieldAccesses_(fieldAccesses) {}
 
   // convenience constructor for the case with no fields
-  explicit AccessPath(Variable && root) : root_(root), fieldAccesses_() {}
+  explicit AccessPath(const Variable & root) : ArithmeticExpr(Kind), root_(root), fieldAccesses_() {}
 
   void Visit(AstVisitor* visitor) const override;
 
   const Variable & root() const { return root_; }
-  const std::vector<std::string> & fieldAccesses() const { return fieldAccesses_; }
+  const NodeList<Symbol> & fieldAccesses() const { return fieldAccesses_; }
 
  private:
   // The name of the root variable.
   Variable root_;
   // The sequence of field accesses
-  std::vector<std::string> fieldAccesses_;
+  NodeList<Symbol> fieldAccesses_;
 };
 
 // An abstract arithmetic binary operator node.
 class ArithmeticBinaryOperatorExpr : public ArithmeticExpr {
  public:
-  ArithmeticBinaryOperatorExpr(std::unique_ptr<const ArithmeticExpr> lhs,
-                               std::unique_ptr<const ArithmeticExpr> rhs)
-      : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
+  ArithmeticBinaryOperatorExpr(NodeKind kind, const ArithmeticExpr* lhs,
+                               const ArithmeticExpr* rhs)
+      : ArithmeticExpr(kind), lhs_(lhs), rhs_(rhs) {}
 
   const ArithmeticExpr& lhs() const { return *lhs_; }
   const ArithmeticExpr& rhs() const { return *rhs_; }
 
  protected:
   // The left-hand side and right-hand side of the expression.
-  const std::unique_ptr<const ArithmeticExpr> lhs_;
-  const std::unique_ptr<const ArithmeticExpr> rhs_;
+  const ArithmeticExpr* lhs_;
+  const ArithmeticExpr* rhs_;
 };
 
 // An addition expression.
 class AddExpr final : public ArithmeticBinaryOperatorExpr {
  public:
-  AddExpr(std::unique_ptr<const ArithmeticExpr> lhs,
-          std::unique_ptr<const ArithmeticExpr> rhs)
-      : ArithmeticBinaryOperatorExpr(std::move(lhs), std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::Add;
+
+  AddExpr(const ArithmeticExpr* lhs,
+          const ArithmeticExpr* rhs)
+      : ArithmeticBinaryOperatorExpr(Kind, lhs, rhs) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
@@ -183,9 +225,11 @@ class AddExpr final : public ArithmeticBinaryOperatorExpr {
 // A subtraction expression.
 class SubtractExpr final : public ArithmeticBinaryOperatorExpr {
  public:
-  SubtractExpr(std::unique_ptr<const ArithmeticExpr> lhs,
-               std::unique_ptr<const ArithmeticExpr> rhs)
-      : ArithmeticBinaryOperatorExpr(std::move(lhs), std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::Subtract;
+
+  SubtractExpr(const ArithmeticExpr* lhs,
+               const ArithmeticExpr* rhs)
+      : ArithmeticBinaryOperatorExpr(Kind, lhs, rhs) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
@@ -193,39 +237,46 @@ class SubtractExpr final : public ArithmeticBinaryOperatorExpr {
 // A multiplication expression.
 class MultiplyExpr final : public ArithmeticBinaryOperatorExpr {
  public:
-  MultiplyExpr(std::unique_ptr<const ArithmeticExpr> lhs,
-               std::unique_ptr<const ArithmeticExpr> rhs)
-      : ArithmeticBinaryOperatorExpr(std::move(lhs), std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::Multiply;
+
+  MultiplyExpr(const ArithmeticExpr* lhs,
+               const ArithmeticExpr* rhs)
+      : ArithmeticBinaryOperatorExpr(Kind, lhs, rhs) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
 
 // This is the abstract base class from which all relational expressions will
 // inherit (relational and logical operations).
-class RelationalExpr : public AstNode {};
+class RelationalExpr : public AstNode {
+ protected:
+  using AstNode::AstNode;
+};
 
 // An abstract relational binary operator node (<, <=, =).
 class RelationalBinaryOperator : public RelationalExpr {
  public:
-  RelationalBinaryOperator(std::unique_ptr<const ArithmeticExpr> lhs,
-                           std::unique_ptr<const ArithmeticExpr> rhs)
-      : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
+  RelationalBinaryOperator(NodeKind kind, const ArithmeticExpr* lhs,
+                           const ArithmeticExpr* rhs)
+      : RelationalExpr(kind), lhs_(lhs), rhs_(rhs) {}
 
   const ArithmeticExpr& lhs() const { return *lhs_; }
   const ArithmeticExpr& rhs() const { return *rhs_; }
 
  protected:
   // The left-hand side and right-hand side of the expression.
-  const std::unique_ptr<const ArithmeticExpr> lhs_;
-  const std::unique_ptr<const ArithmeticExpr> rhs_;
+  const ArithmeticExpr* lhs_;
+  const ArithmeticExpr* rhs_;
 };
 
 // A less-than relational expression.
 class LessThanExpr final : public RelationalBinaryOperator {
  public:
-  LessThanExpr(std::unique_ptr<const ArithmeticExpr> lhs,
-               std::unique_ptr<const ArithmeticExpr> rhs)
-      : RelationalBinaryOperator(std::move(lhs), std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::LessThan;
+
+  LessThanExpr(const ArithmeticExpr* lhs,
+               const ArithmeticExpr* rhs)
+      : RelationalBinaryOperator(Kind, lhs, rhs) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
@@ -233,9 +284,11 @@ class LessThanExpr final : public RelationalBinaryOperator {
 // A less-than-or-equal-to relational expression.
 class LessThanEqualToExpr final : public RelationalBinaryOperator {
  public:
-  LessThanEqualToExpr(std::unique_ptr<const ArithmeticExpr> lhs,
-                      std::unique_ptr<const ArithmeticExpr> rhs)
-      : RelationalBinaryOperator(std::move(lhs), std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::LessThanEqualTo;
+
+  LessThanEqualToExpr(const ArithmeticExpr* lhs,
+                      const ArithmeticExpr* rhs)
+      : RelationalBinaryOperator(Kind, lhs, rhs) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
@@ -243,9 +296,11 @@ class LessThanEqualToExpr final : public RelationalBinaryOperator {
 // An equal-to relational expression.
 class EqualToExpr final : public RelationalBinaryOperator {
  public:
-  EqualToExpr(std::unique_ptr<const ArithmeticExpr> lhs,
-              std::unique_ptr<const ArithmeticExpr> rhs)
-      : RelationalBinaryOperator(std::move(lhs), std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::EqualTo;
+
+  EqualToExpr(const ArithmeticExpr* lhs,
+              const ArithmeticExpr* rhs)
+      : RelationalBinaryOperator(Kind, lhs, rhs) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
@@ -253,25 +308,27 @@ class EqualToExpr final : public RelationalBinaryOperator {
 // An abstract logical binary operator node (&&, ||).
 class LogicalBinaryOperator : public RelationalExpr {
  public:
-  LogicalBinaryOperator(std::unique_ptr<const RelationalExpr> lhs,
-                        std::unique_ptr<const RelationalExpr> rhs)
-      : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
+  LogicalBinaryOperator(NodeKind kind, const RelationalExpr* lhs,
+                        const RelationalExpr* rhs)
+      : RelationalExpr(kind), lhs_(lhs), rhs_(rhs) {}
 
   const RelationalExpr& lhs() const { return *lhs_; }
   const RelationalExpr& rhs() const { return *rhs_; }
 
  protected:
   // The left-hand side and right-hand side of the expression.
-  const std::unique_ptr<const RelationalExpr> lhs_;
-  const std::unique_ptr<const RelationalExpr> rhs_;
+  const RelationalExpr* lhs_;
+  const RelationalExpr* rhs_;
 };
 
 // a logical-and expression.
 class LogicalAndExpr final : public LogicalBinaryOperator {
  public:
-  LogicalAndExpr(std::unique_ptr<const RelationalExpr> lhs,
-                 std::unique_ptr<const RelationalExpr> rhs)
-      : LogicalBinaryOperator(std::move(lhs), std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::LogicalAnd;
+
+  LogicalAndExpr(const RelationalExpr* lhs,
+                 const RelationalExpr* rhs)
+      : LogicalBinaryOperator(Kind, lhs, rhs) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
@@ -279,9 +336,11 @@ class LogicalAndExpr final : public LogicalBinaryOperator {
 // a logical-or expression.
 class LogicalOrExpr final : public LogicalBinaryOperator {
  public:
-  LogicalOrExpr(std::unique_ptr<const RelationalExpr> lhs,
-                std::unique_ptr<const RelationalExpr> rhs)
-      : LogicalBinaryOperator(std::move(lhs), std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::LogicalOr;
+
+  LogicalOrExpr(const RelationalExpr* lhs,
+                const RelationalExpr* rhs)
+      : LogicalBinaryOperator(Kind, lhs, rhs) {}
 
   void Visit(AstVisitor* visitor) const override;
 };
@@ -289,8 +348,10 @@ class LogicalOrExpr final : public LogicalBinaryOperator {
 // A logical negation expression.
 class LogicalNotExpr final : public RelationalExpr {
  public:
-  explicit LogicalNotExpr(std::unique_ptr<const RelationalExpr> operand)
-      : operand_(std::move(operand)) {}
+  static constexpr NodeKind Kind = NodeKind::LogicalNot;
+
+  explicit LogicalNotExpr(const RelationalExpr* operand)
+      : RelationalExpr(Kind), operand_(operand) {}
 
   void Visit(AstVisitor* visitor) const override;
 
@@ -298,37 +359,47 @@ class LogicalNotExpr final : public RelationalExpr {
 
  private:
   // The expression being negated.
-  const std::unique_ptr<const RelationalExpr> operand_;
+  const RelationalExpr* operand_;
 };
 
 class TypeExpr final : public AstNode {
  public:
-  explicit TypeExpr(const std::string & name) : name_(name) {}
+  static constexpr NodeKind Kind = NodeKind::Type;
+
+  explicit TypeExpr(Symbol name) : AstNode(Kind), name_(name) {}
 
   void Visit(AstVisitor* visitor) const override;
 
-  const std::string & name() const { return name_; }
+  Symbol name() const { return name_; }
+
+  bool isIntType() const { return name_ == IntName; }
 
-  bool isIntType() const { return name_ == "int"; }
+  // The name of the built-in int type
+  static const Symbol IntName;
 
  private:
-  // string repr of type
-  const std::string name_;
+  // interned name of type
+  const Symbol name_;
 };
 
 // A statement can be an assignment, a conditional, a loop
 class Statement : public AstNode {
  public:
   // A block is a (possibly empty) sequence of statements.
-  using Block = std::vector<std::unique_ptr<const Statement>>;
+  using Block = NodeList<const Statement*>;
+
+ protected:
+  using AstNode::AstNode;
 };
 
 // An assignment: id := ae.
 class Assignment final : public Statement {
  public:
-  Assignment(std::unique_ptr<const AccessPath> lhs,
-             std::unique_ptr<const RhsExpr> rhs)
-      : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
+  static constexpr NodeKind Kind = NodeKind::Assignment;
+
+  Assignment(const AccessPath* lhs,
+             const RhsExpr* rhs)
+      : Statement(Kind), lhs_(lhs), rhs_(rhs) {}
 
   const AccessPath& lhs() const { return *lhs_; }
   const RhsExpr& rhs() const { return *rhs_; }
@@ -337,17 +408,19 @@ class Assignment final : public Statement {
 
  private:
   // The left-hand side and right-hand side of the assignment.
-  const std::unique_ptr<const AccessPath> lhs_;
-  const std::unique_ptr<const RhsExpr> rhs_;
+  const AccessPath* lhs_;
+  const RhsExpr* rhs_;
 };
 
 class Declaration final : public AstNode {
  public:
-  using Block = std::vector<Declaration>;
+  static constexpr NodeKind Kind = NodeKind::Declaration;
+
+  using Block = NodeList<Declaration>;
 
-  Declaration(TypeExpr && type,
+  Declaration(const TypeExpr & type,
               Variable id)
-      : type_(std::move(type)), id_(std::move(id)) {}
+      : AstNode(Kind), type_(type), id_(id) {}
 
   const TypeExpr& type() const { return type_; }
   const Variable& id() const { return id_; }
@@ -363,14 +436,16 @@ class Declaration final : public AstNode {
 // block node for both decls and stmts
 class BlockStmt final : public AstNode {
  public:
-  BlockStmt(Declaration::Block && decls,
-            std::vector<std::unique_ptr<const Statement>> && stmts)
-      : decls_(std::move(decls)), stmts_(std::move(stmts)) {}
+  static constexpr NodeKind Kind = NodeKind::Block;
+
+  BlockStmt(Declaration::Block decls,
+            Statement::Block stmts)
+      : AstNode(Kind), decls_(decls), stmts_(stmts) {}
 
   const Declaration::Block & decls() const {
     return decls_;
   }
-  const std::vector<std::unique_ptr<const Statement>>& stmts() const {
+  const Statement::Block& stmts() const {
     return stmts_;
   }
 
@@ -378,18 +453,20 @@ class BlockStmt final : public AstNode {
 
  private:
   const Declaration::Block decls_;
-  const std::vector<std::unique_ptr<const Statement>> stmts_;
+  const Statement::Block stmts_;
 };
 
 // A conditional statement: if re block1 block2
 class Conditional final : public Statement {
  public:
-  Conditional(std::unique_ptr<const RelationalExpr> guard,
-              std::unique_ptr<const BlockStmt> true_branch,
-              std::unique_ptr<const BlockStmt> false_branch)
-      : guard_(std::move(guard)),
-        true_branch_(std::move(true_branch)),
-        false_branch_(std::move(false_branch)) {}
+  static constexpr NodeKind Kind = NodeKind::Conditional;
+
+  Conditional(const RelationalExpr* guard,
+              const BlockStmt* true_branch,
+              const BlockStmt* false_branch)
+      : Statement(Kind), guard_(guard),
+        true_branch_(true_branch),
+        false_branch_(false_branch) {}
 
   void Visit(AstVisitor* visitor) const override;
 
@@ -400,19 +477,21 @@ class Conditional final : public Statement {
 
  private:
   // The guard expression of the conditional.
-  std::unique_ptr<const RelationalExpr> guard_;
+  const RelationalExpr* guard_;
 
   // The true and false branches of the conditional.
-  std::unique_ptr<const BlockStmt> true_branch_;
-  std::unique_ptr<const BlockStmt> false_branch_;
+  const BlockStmt* true_branch_;
+  const BlockStmt* false_branch_;
 };
 
 // A loop statement: while re block
 class Loop final : public Statement {
  public:
-  Loop(std::unique_ptr<const RelationalExpr> guard,
-       std::unique_ptr<const BlockStmt> body)
-      : guard_(std::move(guard)), body_(std::move(body)) {}
+  static constexpr NodeKind Kind = NodeKind::Loop;
+
+  Loop(const RelationalExpr* guard,
+       const BlockStmt* body)
+      : Statement(Kind), guard_(guard), body_(body) {}
 
   const RelationalExpr& guard() const { return *guard_; }
 
@@ -422,10 +501,10 @@ class Loop final : public Statement {
 
  private:
   // The guard expression of the loop.
-  std::unique_ptr<const RelationalExpr> guard_;
+  const RelationalExpr* guard_;
 
   // The body of the loop.
-  std::unique_ptr<const BlockStmt> body_;
+  const BlockStmt* body_;
 };
 
 // A type definition: struct typename { decls };. `typename` is the
@@ -433,26 +512,28 @@ class Loop final : public Statement {
 // defined data type.
 class TypeDef final : public AstNode {
  public:
+  static constexpr NodeKind Kind = NodeKind::TypeDef;
+
   // A block is a (possibly empty) sequence of type definitions.
-  using Block = std::vector<TypeDef>;
+  using Block = NodeList<TypeDef>;
 
   // A name is a type identifier; it is assumed to be unique.
-  using Name = std::string;
+  using Name = Symbol;
 
   TypeDef(
       const Name & type_name, 
-      std::vector<Declaration> && fields)
-      : type_name_(type_name), fields_(std::move(fields)) {}
+      Declaration::Block fields)
+      : AstNode(Kind), type_name_(type_name), fields_(fields) {}
 
   const Name& type_name() const { return type_name_; }
 
-  const std::vector<Declaration> & fields() const { return fields_; }
+  const Declaration::Block & fields() const { return fields_; }
 
   void Visit(AstVisitor* visitor) const override;
 
  private:
   Name type_name_;
-  std::vector<Declaration> fields_;
+  Declaration::Block fields_;
 };
 
 // A function definition: def id(v...) type block ae. The 'v...' are the
@@ -460,39 +541,40 @@ class TypeDef final : public AstNode {
 // return value of the function. "type" is the return type
 class FunctionDef final : public AstNode {
  public:
+  static constexpr NodeKind Kind = NodeKind::FunctionDef;
+
   // A block is a (possibly empty) sequence of function definitions.
-  using Block = std::vector<std::unique_ptr<const FunctionDef>>;
+  using Block = NodeList<const FunctionDef*>;
 
   // A name is a function identifier; it is assumed to be unique.
-  using Name = std::string;
+  using Name = Symbol;
+
+  // The typed parameters of a function.
+  using Parameters = NodeList<std::pair<const TypeExpr*, Variable>>;
 
   // originally third param was just std::vector<std::unique_ptr<const
   // Variable>> parameters,
   // type expr and arithexpr had two ampersands after them...
   // e.g. std::unique_ptr<ArithmeticExpr>&& retval)
   FunctionDef(
-      const Name& function_name, std::unique_ptr<const TypeExpr> && type,
-      // std::vector<std::unique_ptr<const Declaration>> parameters, // todo
-      std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                            Variable>>
-          parameters,
-      std::unique_ptr<const BlockStmt> function_body,
-      std::unique_ptr<const ArithmeticExpr> retval)
-      : function_name_(function_name),
-        parameters_(std::move(parameters)),
-        type_(std::move(type)),
-        function_body_(std::move(function_body)),
-        retval_(std::move(retval)) {}
+      const Name& function_name, const TypeExpr* type,
+      // std::vector<const Declaration*> parameters, // todo
+      Parameters parameters,
+      const BlockStmt* function_body,
+      const ArithmeticExpr* retval)
+      : AstNode(Kind), function_name_(function_name),
+        parameters_(parameters),
+        type_(type),
+        function_body_(function_body),
+        retval_(retval) {}
 
   const Name& function_name() const { return function_name_; }
 
-  /* const std::vector<std::unique_ptr<const Declaration>>& parameters() const {
+  /* const std::vector<const Declaration*>& parameters() const {
    */
   /*   return parameters_; */
   /* } */
-  const std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                              Variable>>&
-  parameters() const {
+  const Parameters& parameters() const {
     return parameters_;
   }
 
@@ -509,30 +591,30 @@ class FunctionDef final : public AstNode {
   Name function_name_;
 
   // The parameters of the function being defined.
-  std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                        Variable>>
-      parameters_;
+  Parameters parameters_;
 
   // return type
-  std::unique_ptr<const TypeExpr> type_;
+  const TypeExpr* type_;
 
   // The body of the function being defined.
-  std::unique_ptr<const BlockStmt> function_body_;
+  const BlockStmt* function_body_;
 
   // The return value of the function being defined.
-  std::unique_ptr<const ArithmeticExpr> retval_;
+  const ArithmeticExpr* retval_;
 };
 
 // A function call: id(ae...)
 class FunctionCall final : public RhsExpr {
  public:
+  static constexpr NodeKind Kind = NodeKind::FunctionCall;
+
   FunctionCall(const FunctionDef::Name& callee_name,
-               std::vector<std::unique_ptr<const ArithmeticExpr>> arguments)
-      : callee_name_(callee_name), arguments_(std::move(arguments)) {}
+               NodeList<const ArithmeticExpr*> arguments)
+      : RhsExpr(Kind), callee_name_(callee_name), arguments_(arguments) {}
 
   const FunctionDef::Name& callee_name() const { return callee_name_; }
 
-  const std::vector<std::unique_ptr<const ArithmeticExpr>>& arguments() const {
+  const NodeList<const ArithmeticExpr*>& arguments() const {
     return arguments_;
   }
 
@@ -543,19 +625,21 @@ class FunctionCall final : public RhsExpr {
   FunctionDef::Name callee_name_;
 
   // The arguments to the function being called.
-  std::vector<std::unique_ptr<const ArithmeticExpr>> arguments_;
+  NodeList<const ArithmeticExpr*> arguments_;
 };
 
 class Program final : public AstNode {
  public:
-  Program(TypeDef::Block && type_defs,
+  static constexpr NodeKind Kind = NodeKind::Program;
+
+  Program(TypeDef::Block type_defs,
           FunctionDef::Block function_defs,
-          std::unique_ptr<const BlockStmt> statements,
-          std::unique_ptr<const ArithmeticExpr> arithmetic_exp)
-      : type_defs_(std::move(type_defs)),
-        function_defs_(std::move(function_defs)),
-        statements_(std::move(statements)),
-        arithmetic_exp_(std::move(arithmetic_exp)) {}
+          const BlockStmt* statements,
+          const ArithmeticExpr* arithmetic_exp)
+      : AstNode(Kind), type_defs_(type_defs),
+        function_defs_(function_defs),
+        statements_(statements),
+        arithmetic_exp_(arithmetic_exp) {}
 
   const TypeDef::Block& type_defs() const { return type_defs_; }
   const FunctionDef::Block& function_defs() const { return function_defs_; }
@@ -569,8 +653,8 @@ class Program final : public AstNode {
  private:
   TypeDef::Block type_defs_;
   FunctionDef::Block function_defs_;
-  std::unique_ptr<const BlockStmt> statements_;
-  std::unique_ptr<const ArithmeticExpr> arithmetic_exp_;
+  const BlockStmt* statements_;
+  const ArithmeticExpr* arithmetic_exp_;
 };
 
 inline std::ostream& operator<<(std::ostream& out, const AstNode& node) {
@@ -578,31 +662,32 @@ inline std::ostream& operator<<(std::ostream& out, const AstNode& node) {
 }
 
 // just a bunch of aliases
-using ProgramExprP = std::unique_ptr<const Program>;
-using TypeDefP = std::unique_ptr<const TypeDef>;
-using FunctionDefP = std::unique_ptr<const FunctionDef>;
-using FunctionCallP = std::unique_ptr<const FunctionCall>;
-using StatementP = std::unique_ptr<const Statement>;
-using ArithmeticExprP = std::unique_ptr<const ArithmeticExpr>;
+using ProgramExprP = ArenaPtr<Program>;
+using TypeDefP = const TypeDef*;
+using FunctionDefP = const FunctionDef*;
+using FunctionCallP = const FunctionCall*;
+using StatementP = const Statement*;
+using ArithmeticExprP = const ArithmeticExpr*;
+using AccessPathP = const AccessPath*;
 using ArithmeticBinaryOpExprP =
-    std::unique_ptr<const ArithmeticBinaryOperatorExpr>;
-using RelationalExprP = std::unique_ptr<const RelationalExpr>;
-using RelationalBinaryOpExprP = std::unique_ptr<const RelationalBinaryOperator>;
-using LogicalBinaryOpExprP = std::unique_ptr<const LogicalBinaryOperator>;
-using IntegerExprP = std::unique_ptr<const IntegerExpr>;
-using AddExprP = std::unique_ptr<const AddExpr>;
-using MultiplyExprP = std::unique_ptr<const MultiplyExpr>;
-using SubtractExprP = std::unique_ptr<const SubtractExpr>;
-using LessThanExprP = std::unique_ptr<const LessThanExpr>;
-using LessThanEqualToP = std::unique_ptr<const LessThanEqualToExpr>;
-using EqualToExprP = std::unique_ptr<const EqualToExpr>;
-using LogicalAndExprP = std::unique_ptr<const LogicalAndExpr>;
-using LogicalOrExprP = std::unique_ptr<const LogicalOrExpr>;
-using LogicalNotExprP = std::unique_ptr<const LogicalNotExpr>;
-using AssignmentExprP = std::unique_ptr<const Assignment>;
-using ConditionalExprP = std::unique_ptr<const Conditional>;
-using LoopExprP = std::unique_ptr<const Loop>;
-using DeclarationExprP = std::unique_ptr<const Declaration>;
-using BlockStmtP = std::unique_ptr<const BlockStmt>;
+    const ArithmeticBinaryOperatorExpr*;
+using RelationalExprP = const RelationalExpr*;
+using RelationalBinaryOpExprP = const RelationalBinaryOperator*;
+using LogicalBinaryOpExprP = const LogicalBinaryOperator*;
+using IntegerExprP = const IntegerExpr*;
+using AddExprP = const AddExpr*;
+using MultiplyExprP = const MultiplyExpr*;
+using SubtractExprP = const SubtractExpr*;
+using LessThanExprP = const LessThanExpr*;
+using LessThanEqualToP = const LessThanEqualToExpr*;
+using EqualToExprP = const EqualToExpr*;
+using LogicalAndExprP = const LogicalAndExpr*;
+using LogicalOrExprP = const LogicalOrExpr*;
+using LogicalNotExprP = const LogicalNotExpr*;
+using AssignmentExprP = const Assignment*;
+using ConditionalExprP = const Conditional*;
+using LoopExprP = const Loop*;
+using DeclarationExprP = const Declaration*;
+using BlockStmtP = const BlockStmt*;
 
 }  // namespace cs160::frontend
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cs160::frontend {
+
+// An immutable sequence of AST elements. The elements live in the AstArena
+// that owns the tree, so lists are cheap to copy and never free anything
+// themselves.
+template <class T>
+class NodeList final {
+ public:
+  using value_type = T;
+  using const_iterator = const T*;
+  using const_reverse_iterator = std::reverse_iterator<const T*>;
+
+  NodeList() = default;
+  NodeList(const T* data, size_t size) : data_(data), size_(size) {}
+
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T& operator[](size_t i) const { return data_[i]; }
+
+ private:
+  const T* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// A bump allocator for AST nodes. Memory is carved out of large chunks and
+// released all at once when the arena dies; nothing allocated here ever has
+// its destructor run, which is why only trivially destructible types may be
+// placed in it.
+class AstArena final {
+ public:
+  AstArena() = default;
+  AstArena(const AstArena&) = delete;
+  AstArena& operator=(const AstArena&) = delete;
+
+  template <class T, class... Args>
+  const T* make(Args&&... args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena allocated nodes are never destroyed");
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // Copies the elements into the arena.
+  template <class T>
+  NodeList<T> makeList(std::vector<T>&& elements) {
+    return copyList<T>(elements.begin(), elements.end(), elements.size());
+  }
+
+  template <class T>
+  NodeList<T> makeList(std::initializer_list<T> elements) {
+    return copyList<T>(elements.begin(), elements.end(), elements.size());
+  }
+
+  // Number of bytes handed out so far.
+  size_t bytesUsed() const { return bytesUsed_; }
+
+ private:
+  static constexpr size_t ChunkSize = 64 * 1024;
+
+  struct Chunk {
+    std::unique_ptr<std::byte[]> memory;
+    size_t size;
+  };
+
+  template <class T, class It>
+  NodeList<T> copyList(It first, It last, size_t size) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena allocated nodes are never destroyed");
+    if (size == 0) return NodeList<T>();
+    T* data = static_cast<T*>(allocate(sizeof(T) * size, alignof(T)));
+    std::uninitialized_move(first, last, data);
+    return NodeList<T>(data, size);
+  }
+
+  void* allocate(size_t size, size_t align) {
+    if (chunks_.empty() || alignedCursor(align) + size > chunks_.back().size) {
+      // Requests larger than a chunk get a chunk of their own.
+      size_t chunkSize = std::max(ChunkSize, size + align);
+      chunks_.push_back({std::make_unique<std::byte[]>(chunkSize), chunkSize});
+      cursor_ = 0;
+    }
+    size_t offset = alignedCursor(align);
+    cursor_ = offset + size;
+    bytesUsed_ += size;
+    return chunks_.back().memory.get() + offset;
+  }
+
+  // Offset of the next suitably aligned address in the current chunk.
+  size_t alignedCursor(size_t align) const {
+    uintptr_t address =
+        reinterpret_cast<uintptr_t>(chunks_.back().memory.get()) + cursor_;
+    return cursor_ + (align - address % align) % align;
+  }
+
+  std::vector<Chunk> chunks_;
+  size_t cursor_ = 0;
+  size_t bytesUsed_ = 0;
+};
+
+// Owning handle to the root of a tree allocated in an AstArena. It behaves
+// like the unique_ptr it replaces; the whole tree is freed with the handle.
+template <class T>
+class ArenaPtr final {
+ public:
+  ArenaPtr() = default;
+  ArenaPtr(std::unique_ptr<AstArena> arena, const T* root)
+      : arena_(std::move(arena)), root_(root) {}
+
+  const T* get() const { return root_; }
+  const T* operator->() const { return root_; }
+  const T& operator*() const { return *root_; }
+  explicit operator bool() const { return root_ != nullptr; }
+
+  AstArena& arena() const { return *arena_; }
+
+ private:
+  std::unique_ptr<AstArena> arena_;
+  const T* root_ = nullptr;
+};
+
+}  // namespace cs160::frontend
@@ -0,0 +1,77 @@
+#pragma once
+#include "frontend/ast.h"
+
+namespace cs160::frontend {
+
+// A statically dispatched traversal of abstract syntax trees. `Walk` switches
+// on the kind tag of a node and calls the matching Visit function of
+// `Derived` directly, so recursive traversals don't pay for the two virtual
+// calls of AstNode::Visit and AstVisitor at every node, and the compiler is
+// free to inline the visit functions into the walk.
+//
+// `Derived` provides the same Visit functions as AstVisitor. A class may
+// derive from both so it keeps working with code that still goes through
+// AstNode::Visit; if it is final the calls below are not virtual.
+template <class Derived>
+class AstWalker {
+ public:
+  void Walk(const AstNode& node) {
+    auto& self = static_cast<Derived&>(*this);
+    switch (node.kind()) {
+      case NodeKind::Nil:
+        return self.VisitNil(static_cast<const NilExpr&>(node));
+      case NodeKind::Integer:
+        return self.VisitIntegerExpr(static_cast<const IntegerExpr&>(node));
+      case NodeKind::New:
+        return self.VisitNewExpr(static_cast<const NewExpr&>(node));
+      case NodeKind::Variable:
+        return self.VisitVariable(static_cast<const Variable&>(node));
+      case NodeKind::AccessPath:
+        return self.VisitAccessPath(static_cast<const AccessPath&>(node));
+      case NodeKind::Add:
+        return self.VisitAddExpr(static_cast<const AddExpr&>(node));
+      case NodeKind::Subtract:
+        return self.VisitSubtractExpr(static_cast<const SubtractExpr&>(node));
+      case NodeKind::Multiply:
+        return self.VisitMultiplyExpr(static_cast<const MultiplyExpr&>(node));
+      case NodeKind::LessThan:
+        return self.VisitLessThanExpr(static_cast<const LessThanExpr&>(node));
+      case NodeKind::LessThanEqualTo:
+        return self.VisitLessThanEqualToExpr(
+            static_cast<const LessThanEqualToExpr&>(node));
+      case NodeKind::EqualTo:
+        return self.VisitEqualToExpr(static_cast<const EqualToExpr&>(node));
+      case NodeKind::LogicalAnd:
+        return self.VisitLogicalAndExpr(
+            static_cast<const LogicalAndExpr&>(node));
+      case NodeKind::LogicalOr:
+        return self.VisitLogicalOrExpr(static_cast<const LogicalOrExpr&>(node));
+      case NodeKind::LogicalNot:
+        return self.VisitLogicalNotExpr(
+            static_cast<const LogicalNotExpr&>(node));
+      case NodeKind::Type:
+        return self.VisitTypeExpr(static_cast<const TypeExpr&>(node));
+      case NodeKind::Block:
+        return self.VisitBlockStmt(static_cast<const BlockStmt&>(node));
+      case NodeKind::Declaration:
+        return self.VisitDeclarationExpr(static_cast<const Declaration&>(node));
+      case NodeKind::Assignment:
+        return self.VisitAssignmentExpr(static_cast<const Assignment&>(node));
+      case NodeKind::Conditional:
+        return self.VisitConditionalExpr(static_cast<const Conditional&>(node));
+      case NodeKind::Loop:
+        return self.VisitLoopExpr(static_cast<const Loop&>(node));
+      case NodeKind::FunctionCall:
+        return self.VisitFunctionCallExpr(
+            static_cast<const FunctionCall&>(node));
+      case NodeKind::FunctionDef:
+        return self.VisitFunctionDefExpr(static_cast<const FunctionDef&>(node));
+      case NodeKind::TypeDef:
+        return self.VisitTypeDef(static_cast<const TypeDef&>(node));
+      case NodeKind::Program:
+        return self.VisitProgramExpr(static_cast<const Program&>(node));
+    }
+  }
+};
+
+}  // namespace cs160::frontend
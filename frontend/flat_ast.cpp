@@ -0,0 +1,548 @@
+#include "frontend/flat_ast.h"
+#include <cstring>
+#include "frontend/ast_walker.h"
+
+namespace cs160::frontend {
+
+namespace {
+
+bool isArithmetic(NodeKind kind) {
+  switch (kind) {
+    case NodeKind::Nil:
+    case NodeKind::Integer:
+    case NodeKind::New:
+    case NodeKind::AccessPath:
+    case NodeKind::Add:
+    case NodeKind::Subtract:
+    case NodeKind::Multiply:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool isRelational(NodeKind kind) {
+  switch (kind) {
+    case NodeKind::LessThan:
+    case NodeKind::LessThanEqualTo:
+    case NodeKind::EqualTo:
+    case NodeKind::LogicalAnd:
+    case NodeKind::LogicalOr:
+    case NodeKind::LogicalNot:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool isStatement(NodeKind kind) {
+  return kind == NodeKind::Assignment || kind == NodeKind::Conditional ||
+         kind == NodeKind::Loop;
+}
+
+bool isRhs(NodeKind kind) {
+  return isArithmetic(kind) || kind == NodeKind::FunctionCall;
+}
+
+// Appends the nodes of a tree in post order
+class FlatAstBuilder final : public AstWalker<FlatAstBuilder> {
+ public:
+  explicit FlatAstBuilder(FlatAst& ast) : ast(ast) {}
+
+  // The id of the node visited last
+  FlatAst::NodeId last = FlatAst::NoNode;
+
+  FlatAst::NodeId build(const AstNode& node) {
+    Walk(node);
+    return last;
+  }
+
+  void VisitNil(const NilExpr&) { last = ast.add(NodeKind::Nil, 0); }
+  void VisitIntegerExpr(const IntegerExpr& exp) {
+    last = ast.add(NodeKind::Integer, exp.value());
+  }
+  void VisitNewExpr(const NewExpr& exp) {
+    last = ast.add(NodeKind::New, symbol(exp.type()));
+  }
+  void VisitVariable(const Variable& exp) {
+    last = ast.add(NodeKind::Variable, symbol(exp.name()));
+  }
+  void VisitAccessPath(const AccessPath& exp) {
+    std::vector<uint32_t> fields;
+    for (auto field : exp.fieldAccesses()) {
+      fields.push_back(field.id());
+    }
+    last = ast.add(NodeKind::AccessPath, symbol(exp.root().name()), fields);
+  }
+  void VisitAddExpr(const AddExpr& exp) {
+    binary(exp.kind(), exp.lhs(), exp.rhs());
+  }
+  void VisitSubtractExpr(const SubtractExpr& exp) {
+    binary(exp.kind(), exp.lhs(), exp.rhs());
+  }
+  void VisitMultiplyExpr(const MultiplyExpr& exp) {
+    binary(exp.kind(), exp.lhs(), exp.rhs());
+  }
+  void VisitLessThanExpr(const LessThanExpr& exp) {
+    binary(exp.kind(), exp.lhs(), exp.rhs());
+  }
+  void VisitLessThanEqualToExpr(const LessThanEqualToExpr& exp) {
+    binary(exp.kind(), exp.lhs(), exp.rhs());
+  }
+  void VisitEqualToExpr(const EqualToExpr& exp) {
+    binary(exp.kind(), exp.lhs(), exp.rhs());
+  }
+  void VisitLogicalAndExpr(const LogicalAndExpr& exp) {
+    binary(exp.kind(), exp.lhs(), exp.rhs());
+  }
+  void VisitLogicalOrExpr(const LogicalOrExpr& exp) {
+    binary(exp.kind(), exp.lhs(), exp.rhs());
+  }
+  void VisitLogicalNotExpr(const LogicalNotExpr& exp) {
+    auto operand = build(exp.operand());
+    last = ast.add(NodeKind::LogicalNot, 0, {operand});
+  }
+  void VisitTypeExpr(const TypeExpr& exp) {
+    last = ast.add(NodeKind::Type, symbol(exp.name()));
+  }
+  void VisitBlockStmt(const BlockStmt& exp) {
+    std::vector<uint32_t> operands;
+    for (auto& decl : exp.decls()) {
+      operands.push_back(build(decl));
+    }
+    for (auto stmt : exp.stmts()) {
+      operands.push_back(build(*stmt));
+    }
+    last = ast.add(NodeKind::Block, static_cast<int32_t>(exp.decls().size()),
+                   operands);
+  }
+  void VisitDeclarationExpr(const Declaration& exp) {
+    auto type = build(exp.type());
+    auto id = build(exp.id());
+    last = ast.add(NodeKind::Declaration, 0, {type, id});
+  }
+  void VisitAssignmentExpr(const Assignment& exp) {
+    auto lhs = build(exp.lhs());
+    auto rhs = build(exp.rhs());
+    last = ast.add(NodeKind::Assignment, 0, {lhs, rhs});
+  }
+  void VisitConditionalExpr(const Conditional& exp) {
+    auto guard = build(exp.guard());
+    auto trueBranch = build(exp.true_branch());
+    auto falseBranch = build(exp.false_branch());
+    last = ast.add(NodeKind::Conditional, 0, {guard, trueBranch, falseBranch});
+  }
+  void VisitLoopExpr(const Loop& exp) {
+    auto guard = build(exp.guard());
+    auto body = build(exp.body());
+    last = ast.add(NodeKind::Loop, 0, {guard, body});
+  }
+  void VisitFunctionCallExpr(const FunctionCall& exp) {
+    std::vector<uint32_t> args;
+    for (auto arg : exp.arguments()) {
+      args.push_back(build(*arg));
+    }
+    last = ast.add(NodeKind::FunctionCall, symbol(exp.callee_name()), args);
+  }
+  void VisitFunctionDefExpr(const FunctionDef& exp) {
+    // Nodes are added in source order
+    std::vector<uint32_t> params;
+    for (auto& [type, var] : exp.parameters()) {
+      params.push_back(build(*type));
+      params.push_back(build(var));
+    }
+    std::vector<uint32_t> operands;
+    operands.push_back(build(exp.type()));
+    operands.push_back(build(exp.function_body()));
+    operands.push_back(build(exp.retval()));
+    operands.insert(operands.end(), params.begin(), params.end());
+    last =
+        ast.add(NodeKind::FunctionDef, symbol(exp.function_name()), operands);
+  }
+  void VisitTypeDef(const TypeDef& exp) {
+    std::vector<uint32_t> fields;
+    for (auto& decl : exp.fields()) {
+      fields.push_back(build(decl));
+    }
+    last = ast.add(NodeKind::TypeDef, symbol(exp.type_name()), fields);
+  }
+  void VisitProgramExpr(const Program& exp) {
+    std::vector<uint32_t> operands;
+    for (auto& typeDef : exp.type_defs()) {
+      operands.push_back(build(typeDef));
+    }
+    for (auto fnDef : exp.function_defs()) {
+      operands.push_back(build(*fnDef));
+    }
+    operands.push_back(build(exp.statements()));
+    operands.push_back(build(exp.arithmetic_exp()));
+    last = ast.add(NodeKind::Program,
+                   static_cast<int32_t>(exp.type_defs().size()), operands);
+  }
+
+ private:
+  static int32_t symbol(Symbol s) { return static_cast<int32_t>(s.id()); }
+
+  void binary(NodeKind kind, const AstNode& lhs, const AstNode& rhs) {
+    auto l = build(lhs);
+    auto r = build(rhs);
+    last = ast.add(kind, 0, {l, r});
+  }
+
+  FlatAst& ast;
+};
+
+// Builds the tree for a flat AST one node at a time. Since operands come
+// before the nodes using them, every operand has been built when it is needed.
+class TreeBuilder final {
+ public:
+  TreeBuilder(const FlatAst& ast, AstArena& arena)
+      : ast(ast), arena(arena), nodes(ast.size(), nullptr) {}
+
+  const AstNode* build(FlatAst::NodeId id) {
+    auto ops = ast.operands(id);
+    switch (ast.kind(id)) {
+      case NodeKind::Nil:
+        expectOperands(id, ops, 0);
+        return arena.make<NilExpr>();
+      case NodeKind::Integer:
+        expectOperands(id, ops, 0);
+        return arena.make<IntegerExpr>(ast.value(id));
+      case NodeKind::New:
+        expectOperands(id, ops, 0);
+        return arena.make<NewExpr>(symbol(id));
+      case NodeKind::Variable:
+        expectOperands(id, ops, 0);
+        return arena.make<Variable>(symbol(id));
+      case NodeKind::AccessPath: {
+        std::vector<Symbol> fields;
+        for (auto field : ops) {
+          fields.push_back(checkedSymbol(id, field));
+        }
+        return arena.make<AccessPath>(Variable{symbol(id)},
+                                      arena.makeList(std::move(fields)));
+      }
+      case NodeKind::Add:
+        expectOperands(id, ops, 2);
+        return arena.make<AddExpr>(arithmetic(id, ops, 0),
+                                   arithmetic(id, ops, 1));
+      case NodeKind::Subtract:
+        expectOperands(id, ops, 2);
+        return arena.make<SubtractExpr>(arithmetic(id, ops, 0),
+                                        arithmetic(id, ops, 1));
+      case NodeKind::Multiply:
+        expectOperands(id, ops, 2);
+        return arena.make<MultiplyExpr>(arithmetic(id, ops, 0),
+                                        arithmetic(id, ops, 1));
+      case NodeKind::LessThan:
+        expectOperands(id, ops, 2);
+        return arena.make<LessThanExpr>(arithmetic(id, ops, 0),
+                                        arithmetic(id, ops, 1));
+      case NodeKind::LessThanEqualTo:
+        expectOperands(id, ops, 2);
+        return arena.make<LessThanEqualToExpr>(arithmetic(id, ops, 0),
+                                               arithmetic(id, ops, 1));
+      case NodeKind::EqualTo:
+        expectOperands(id, ops, 2);
+        return arena.make<EqualToExpr>(arithmetic(id, ops, 0),
+                                       arithmetic(id, ops, 1));
+      case NodeKind::LogicalAnd:
+        expectOperands(id, ops, 2);
+        return arena.make<LogicalAndExpr>(relational(id, ops, 0),
+                                          relational(id, ops, 1));
+      case NodeKind::LogicalOr:
+        expectOperands(id, ops, 2);
+        return arena.make<LogicalOrExpr>(relational(id, ops, 0),
+                                         relational(id, ops, 1));
+      case NodeKind::LogicalNot:
+        expectOperands(id, ops, 1);
+        return arena.make<LogicalNotExpr>(relational(id, ops, 0));
+      case NodeKind::Type:
+        expectOperands(id, ops, 0);
+        return arena.make<TypeExpr>(symbol(id));
+      case NodeKind::Declaration:
+        expectOperands(id, ops, 2);
+        return arena.make<Declaration>(*operand<TypeExpr>(id, ops, 0),
+                                       *operand<Variable>(id, ops, 1));
+      case NodeKind::Block: {
+        auto numDecls = static_cast<size_t>(ast.value(id));
+        if (numDecls > ops.size()) {
+          throw InvalidFlatAstError("block " + std::to_string(id) +
+                                    " has too few operands");
+        }
+        std::vector<Declaration> decls;
+        std::vector<const Statement*> stmts;
+        for (size_t i = 0; i < numDecls; ++i) {
+          decls.push_back(*operand<Declaration>(id, ops, i));
+        }
+        for (size_t i = numDecls; i < ops.size(); ++i) {
+          stmts.push_back(statement(id, ops, i));
+        }
+        return arena.make<BlockStmt>(arena.makeList(std::move(decls)),
+                                     arena.makeList(std::move(stmts)));
+      }
+      case NodeKind::Assignment: {
+        expectOperands(id, ops, 2);
+        auto rhs = checked(id, ops, 1, isRhs(kindOf(id, ops, 1)),
+                           "a right-hand side");
+        return arena.make<Assignment>(operand<AccessPath>(id, ops, 0),
+                                      static_cast<const RhsExpr*>(rhs));
+      }
+      case NodeKind::Conditional:
+        expectOperands(id, ops, 3);
+        return arena.make<Conditional>(relational(id, ops, 0),
+                                       operand<BlockStmt>(id, ops, 1),
+                                       operand<BlockStmt>(id, ops, 2));
+      case NodeKind::Loop:
+        expectOperands(id, ops, 2);
+        return arena.make<Loop>(relational(id, ops, 0),
+                                operand<BlockStmt>(id, ops, 1));
+      case NodeKind::FunctionCall: {
+        std::vector<const ArithmeticExpr*> args;
+        for (size_t i = 0; i < ops.size(); ++i) {
+          args.push_back(arithmetic(id, ops, i));
+        }
+        return arena.make<FunctionCall>(symbol(id),
+                                        arena.makeList(std::move(args)));
+      }
+      case NodeKind::FunctionDef: {
+        if (ops.size() < 3 || ops.size() % 2 != 1) {
+          throw InvalidFlatAstError("function definition " +
+                                    std::to_string(id) +
+                                    " has a wrong number of operands");
+        }
+        std::vector<std::pair<const TypeExpr*, Variable>> params;
+        for (size_t i = 3; i < ops.size(); i += 2) {
+          params.emplace_back(operand<TypeExpr>(id, ops, i),
+                              *operand<Variable>(id, ops, i + 1));
+        }
+        return arena.make<FunctionDef>(symbol(id),
+                                       operand<TypeExpr>(id, ops, 0),
+                                       arena.makeList(std::move(params)),
+                                       operand<BlockStmt>(id, ops, 1),
+                                       arithmetic(id, ops, 2));
+      }
+      case NodeKind::TypeDef: {
+        std::vector<Declaration> fields;
+        for (size_t i = 0; i < ops.size(); ++i) {
+          fields.push_back(*operand<Declaration>(id, ops, i));
+        }
+        return arena.make<TypeDef>(symbol(id),
+                                   arena.makeList(std::move(fields)));
+      }
+      case NodeKind::Program: {
+        auto numTypeDefs = static_cast<size_t>(ast.value(id));
+        if (ops.size() < 2 || numTypeDefs > ops.size() - 2) {
+          throw InvalidFlatAstError("program " + std::to_string(id) +
+                                    " has a wrong number of operands");
+        }
+        std::vector<TypeDef> typeDefs;
+        std::vector<const FunctionDef*> fnDefs;
+        for (size_t i = 0; i < numTypeDefs; ++i) {
+          typeDefs.push_back(*operand<TypeDef>(id, ops, i));
+        }
+        for (size_t i = numTypeDefs; i < ops.size() - 2; ++i) {
+          fnDefs.push_back(operand<FunctionDef>(id, ops, i));
+        }
+        return arena.make<Program>(arena.makeList(std::move(typeDefs)),
+                                   arena.makeList(std::move(fnDefs)),
+                                   operand<BlockStmt>(id, ops, ops.size() - 2),
+                                   arithmetic(id, ops, ops.size() - 1));
+      }
+    }
+    throw InvalidFlatAstError("node " + std::to_string(id) +
+                              " has an unknown kind");
+  }
+
+  const FlatAst& ast;
+  AstArena& arena;
+  // The tree node built for each flat node
+  std::vector<const AstNode*> nodes;
+
+ private:
+  Symbol symbol(FlatAst::NodeId id) {
+    return checkedSymbol(id, static_cast<uint32_t>(ast.value(id)));
+  }
+
+  Symbol checkedSymbol(FlatAst::NodeId id, uint32_t symbolId) {
+    if (symbolId >= Symbol::count()) {
+      throw InvalidFlatAstError("node " + std::to_string(id) +
+                                " refers to an unknown symbol");
+    }
+    return Symbol::fromId(symbolId);
+  }
+
+  void expectOperands(FlatAst::NodeId id, NodeList<uint32_t> ops,
+                      size_t count) {
+    if (ops.size() != count) {
+      throw InvalidFlatAstError("node " + std::to_string(id) + " should have " +
+                                std::to_string(count) + " operands");
+    }
+  }
+
+  NodeKind kindOf(FlatAst::NodeId id, NodeList<uint32_t> ops, size_t i) {
+    if (i >= ops.size() || ops[i] >= id) {
+      throw InvalidFlatAstError("node " + std::to_string(id) +
+                                " has a bad operand");
+    }
+    return ast.kind(ops[i]);
+  }
+
+  const AstNode* checked(FlatAst::NodeId id, NodeList<uint32_t> ops, size_t i,
+                         bool ok, const char* expected) {
+    if (!ok) {
+      throw InvalidFlatAstError("operand " + std::to_string(i) + " of node " +
+                                std::to_string(id) + " should be " + expected);
+    }
+    return nodes[ops[i]];
+  }
+
+  template <class T>
+  const T* operand(FlatAst::NodeId id, NodeList<uint32_t> ops, size_t i) {
+    auto node = checked(id, ops, i, kindOf(id, ops, i) == T::Kind,
+                        "another kind of node");
+    return static_cast<const T*>(node);
+  }
+
+  const ArithmeticExpr* arithmetic(FlatAst::NodeId id, NodeList<uint32_t> ops,
+                                   size_t i) {
+    auto node = checked(id, ops, i, isArithmetic(kindOf(id, ops, i)),
+                        "an arithmetic expression");
+    return static_cast<const ArithmeticExpr*>(node);
+  }
+
+  const RelationalExpr* relational(FlatAst::NodeId id, NodeList<uint32_t> ops,
+                                   size_t i) {
+    auto node = checked(id, ops, i, isRelational(kindOf(id, ops, i)),
+                        "a relational expression");
+    return static_cast<const RelationalExpr*>(node);
+  }
+
+  const Statement* statement(FlatAst::NodeId id, NodeList<uint32_t> ops,
+                             size_t i) {
+    auto node =
+        checked(id, ops, i, isStatement(kindOf(id, ops, i)), "a statement");
+    return static_cast<const Statement*>(node);
+  }
+};
+
+// Layout of a serialized flat AST: this header followed by the kinds, values,
+// operand starts and operands arrays
+struct SerializedHeader {
+  uint32_t magic;
+  uint32_t numNodes;
+  uint32_t numOperands;
+};
+
+constexpr uint32_t SerializedMagic = 0x4c32'4153;  // "L2AS"
+
+template <class T>
+void append(std::vector<std::byte>& out, const T* data, size_t count) {
+  auto offset = out.size();
+  out.resize(offset + sizeof(T) * count);
+  if (count > 0) {
+    std::memcpy(out.data() + offset, data, sizeof(T) * count);
+  }
+}
+
+template <class T>
+const std::byte* extract(const std::byte* in, const std::byte* end,
+                         std::vector<T>& out, size_t count) {
+  if (static_cast<size_t>(end - in) < sizeof(T) * count) {
+    throw InvalidFlatAstError("serialized data is truncated");
+  }
+  out.resize(count);
+  if (count > 0) {
+    std::memcpy(out.data(), in, sizeof(T) * count);
+  }
+  return in + sizeof(T) * count;
+}
+
+}  // namespace
+
+FlatAst::NodeId FlatAst::add(NodeKind kind, int32_t value,
+                             std::initializer_list<uint32_t> operands) {
+  kinds_.push_back(kind);
+  values_.push_back(value);
+  operands_.insert(operands_.end(), operands);
+  operandStart_.push_back(static_cast<uint32_t>(operands_.size()));
+  return static_cast<NodeId>(kinds_.size() - 1);
+}
+
+FlatAst::NodeId FlatAst::add(NodeKind kind, int32_t value,
+                             const std::vector<uint32_t>& operands) {
+  kinds_.push_back(kind);
+  values_.push_back(value);
+  operands_.insert(operands_.end(), operands.begin(), operands.end());
+  operandStart_.push_back(static_cast<uint32_t>(operands_.size()));
+  return static_cast<NodeId>(kinds_.size() - 1);
+}
+
+FlatAst FlatAst::fromTree(const AstNode& root) {
+  FlatAst result;
+  FlatAstBuilder builder{result};
+  builder.build(root);
+  return result;
+}
+
+ProgramExprP FlatAst::toTree() const {
+  if (empty() || kind(root()) != NodeKind::Program) {
+    throw InvalidFlatAstError("the last node should be a program");
+  }
+  auto arena = std::make_unique<AstArena>();
+  TreeBuilder builder{*this, *arena};
+  for (NodeId id = 0; id < size(); ++id) {
+    builder.nodes[id] = builder.build(id);
+  }
+  auto program = static_cast<const Program*>(builder.nodes[root()]);
+  return ProgramExprP(std::move(arena), program);
+}
+
+std::vector<std::byte> FlatAst::serialize() const {
+  std::vector<std::byte> out;
+  SerializedHeader header{SerializedMagic, static_cast<uint32_t>(size()),
+                          static_cast<uint32_t>(operands_.size())};
+  append(out, &header, 1);
+  append(out, kinds_.data(), kinds_.size());
+  append(out, values_.data(), values_.size());
+  append(out, operandStart_.data(), operandStart_.size());
+  append(out, operands_.data(), operands_.size());
+  return out;
+}
+
+FlatAst FlatAst::deserialize(const std::byte* data, size_t size) {
+  const std::byte* end = data + size;
+  SerializedHeader header;
+  if (size < sizeof(header)) {
+    throw InvalidFlatAstError("serialized data is truncated");
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != SerializedMagic) {
+    throw InvalidFlatAstError("bad magic number");
+  }
+
+  FlatAst result;
+  auto in = data + sizeof(header);
+  in = extract(in, end, result.kinds_, header.numNodes);
+  in = extract(in, end, result.values_, header.numNodes);
+  in = extract(in, end, result.operandStart_, size_t{header.numNodes} + 1);
+  in = extract(in, end, result.operands_, header.numOperands);
+  if (in != end) {
+    throw InvalidFlatAstError("trailing bytes after serialized data");
+  }
+  for (size_t i = 0; i < header.numNodes; ++i) {
+    auto start = result.operandStart_[i];
+    auto stop = result.operandStart_[i + 1];
+    if (start > stop || stop > header.numOperands) {
+      throw InvalidFlatAstError("bad operand range for node " +
+                                std::to_string(i));
+    }
+  }
+  if (result.operandStart_[0] != 0 ||
+      result.operandStart_[header.numNodes] != header.numOperands) {
+    throw InvalidFlatAstError("bad operand ranges");
+  }
+  return result;
+}
+
+}  // namespace cs160::frontend
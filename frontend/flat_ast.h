@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "frontend/ast.h"
+
+namespace cs160::frontend {
+
+// A compact, index based encoding of the abstract syntax tree. Nodes are
+// numbered densely and their parts are stored as a struct of arrays: a kind,
+// an integer value and a run of operands per node. Children always come
+// before their parents, so the root is the last node and a pass that does not
+// care about nesting can just loop over the node ids.
+//
+// What the value and the operands of a node mean depends on its kind:
+//
+//   kind             value             operands
+//   Nil                                -
+//   Integer          the integer       -
+//   New              type symbol       -
+//   Variable         name symbol       -
+//   AccessPath       root symbol       field symbols...
+//   Add ... Or                         lhs rhs
+//   LogicalNot                         operand
+//   Type             name symbol       -
+//   Declaration                        type variable
+//   Block            # declarations    declarations... statements...
+//   Assignment                         lhs rhs
+//   Conditional                        guard true-branch false-branch
+//   Loop                               guard body
+//   FunctionCall     callee symbol     arguments...
+//   FunctionDef      name symbol       return-type body retval
+//                                        (param-type param-variable)...
+//   TypeDef          name symbol       declarations...
+//   Program          # type defs       type-defs... function-defs... block ae
+//
+// Symbols are stored as their ids, so the arrays are plain integers and the
+// whole encoding can be copied with memcpy (see serialize()). The ids are
+// only meaningful to the process that interned them.
+class FlatAst final {
+ public:
+  using NodeId = uint32_t;
+
+  // Marks the absence of a node
+  static constexpr NodeId NoNode = std::numeric_limits<NodeId>::max();
+
+  FlatAst() = default;
+
+  // Convert a tree to the flat encoding
+  static FlatAst fromTree(const AstNode& root);
+
+  // Rebuild a tree rooted at the last node, which should be a program
+  ProgramExprP toTree() const;
+
+  // Append a node. Operands that are nodes should already have been added.
+  NodeId add(NodeKind kind, int32_t value,
+             std::initializer_list<uint32_t> operands = {});
+  NodeId add(NodeKind kind, int32_t value,
+             const std::vector<uint32_t>& operands);
+
+  size_t size() const { return kinds_.size(); }
+  bool empty() const { return kinds_.empty(); }
+  NodeId root() const {
+    return empty() ? NoNode : static_cast<NodeId>(size() - 1);
+  }
+
+  NodeKind kind(NodeId node) const { return kinds_[node]; }
+  int32_t value(NodeId node) const { return values_[node]; }
+  Symbol symbol(NodeId node) const {
+    return Symbol::fromId(static_cast<uint32_t>(values_[node]));
+  }
+
+  // The operands of a node. The list is invalidated by adding nodes.
+  NodeList<uint32_t> operands(NodeId node) const {
+    return NodeList<uint32_t>(operands_.data() + operandStart_[node],
+                              operandStart_[node + 1] - operandStart_[node]);
+  }
+
+  // Copy the encoding into a single buffer, and back
+  std::vector<std::byte> serialize() const;
+  static FlatAst deserialize(const std::byte* data, size_t size);
+
+  bool operator==(const FlatAst& that) const {
+    return kinds_ == that.kinds_ && values_ == that.values_ &&
+           operandStart_ == that.operandStart_ && operands_ == that.operands_;
+  }
+
+ private:
+  std::vector<NodeKind> kinds_;
+  std::vector<int32_t> values_;
+  // Operands of node i are operands_[operandStart_[i] .. operandStart_[i + 1])
+  std::vector<uint32_t> operandStart_{0};
+  std::vector<uint32_t> operands_;
+};
+
+// Thrown when a flat AST is malformed
+struct InvalidFlatAstError : public std::runtime_error {
+  explicit InvalidFlatAstError(const std::string& message)
+      : runtime_error("Invalid flat AST: " + message) {}
+};
+
+}  // namespace cs160::frontend
@@ -1,8 +1,13 @@
 #pragma once
+#include <deque>
+#include <istream>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "frontend/token.h"
+#include "frontend/token_stream.h"
 
 namespace cs160::frontend {
 
@@ -24,11 +29,57 @@ class Lexer final {
   // text as the argument and produces a vector of tokens as the result of
   // lexing the program text.
   //
+  // The tokens refer to their lexemes inside programText instead of copying
+  // them, so the buffer holding the program text must outlive the tokens.
+  //
   // If the input program contains invalid lexemes (lexemes that are outside our
   // specification), this method should throw InvalidLexemeError.
   //
   // The implementation of this method should go into lexer.cpp
-  std::vector<Token> tokenize(const std::string& programText);
+  std::vector<Token> tokenize(std::string_view programText);
+};
+
+// A token stream that runs the lexer lazily, only as far as the lookahead
+// requested by the consumer, so only the lookahead window is kept in memory.
+//
+// When lexing a string_view, tokens refer to their lexemes inside that text
+// like the ones tokenize() produces. When lexing an input stream the text is
+// read in chunks and discarded, so Id and Type tokens refer to their interned
+// names instead.
+//
+// Throws InvalidLexemeError when the lexer reaches an invalid lexeme.
+class LexingTokenStream final : public TokenStream {
+ public:
+  explicit LexingTokenStream(std::string_view programText);
+  // `chunkSize` is the number of characters read from the input at once
+  explicit LexingTokenStream(std::istream &input,
+                             size_t chunkSize = DefaultChunkSize);
+
+  std::optional<Token> peek(size_t k = 1) override;
+  void advance() override;
+
+ private:
+  // Lex the next token into the lookahead, returns false at the end of input
+  bool lexNext();
+  // Read the next chunk of the input stream, returns false if there is no more
+  // input
+  bool refill();
+
+  static const size_t DefaultChunkSize = 1 << 16;
+
+  // The input stream, or nullptr if we are lexing a string_view
+  std::istream *input = nullptr;
+  size_t chunkSize = DefaultChunkSize;
+  // The text read from the input stream that is not lexed yet
+  std::string buffer;
+  // Position of the buffer in the input stream
+  size_t bufferOffset = 0;
+  // The text being lexed, either the whole program or the buffer
+  std::string_view text;
+  // The index of the next character to lex in text
+  size_t currentIndex = 0;
+  // Tokens lexed but not consumed yet
+  std::deque<Token> lookahead;
 };
 
 }  // namespace cs160::frontend
\ No newline at end of file
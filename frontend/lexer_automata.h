@@ -0,0 +1,622 @@
+// The lexer automata: the lexemes of L2 described as NFAs and the minimized
+// DFAs built from them. build/lexer_gen prints the DFAs as the constexpr
+// tables of build/lexer_tables.h, and lexer_gen_test checks that the tables
+// are what the construction gives.
+#pragma once
+
+#include "frontend/token.h"
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace cs160::frontend::lexer_automata {
+
+using State = int;
+
+// Generate a fresh state
+inline State genState() {
+  static State nextState = 0;
+  return nextState += 1;
+}
+
+// A set of ASCII chars with an internal bitvector representation. A bitvector
+// of size 256 is only 32 bytes large and allows fast implementation of most set
+// operations. We have some space overhead because we use a vector-based
+// implementation.
+struct CharSet {
+ private:
+  static const size_t BitvectorSize =
+      size_t(std::numeric_limits<unsigned char>::max()) + 1;
+
+ public:
+  CharSet() : bits(BitvectorSize, false) {}
+
+  explicit CharSet(char c) : bits(BitvectorSize, false) { add(c); }
+
+  CharSet(char begin, char end) : bits(BitvectorSize, false) {
+    addRange(begin, end);
+  }
+
+  bool empty() const {
+    return std::find(bits.begin(), bits.end(), true) == bits.end();
+  }
+
+  bool operator[](char c) const { return bits[(unsigned char)c]; }
+
+  void add(char c) { bits[(unsigned char)c] = true; }
+
+  void remove(char c) { bits[(unsigned char)c] = true; }
+
+  void addRange(char begin, char end) {
+    for (auto i = (unsigned char)begin, end_ = (unsigned char)end; i <= end_;
+         ++i) {
+      bits[i] = true;
+    }
+  }
+
+  void removeRange(char begin, char end) {
+    for (auto i = (unsigned char)begin, end_ = (unsigned char)end; i <= end_;
+         ++i) {
+      bits[i] = false;
+    }
+  }
+
+  void flip() {
+    for (auto i = bits.begin(), end = bits.end(); i != end; ++i) {
+      (*i).flip();
+    }
+  }
+
+  void operator&=(CharSet const &that) {
+    for (size_t i = 0; i < BitvectorSize; ++i) {
+      bits[i] = bits[i] && that.bits[i];
+    }
+  }
+
+  void operator|=(CharSet const &that) {
+    for (size_t i = 0; i < BitvectorSize; ++i) {
+      bits[i] = bits[i] || that.bits[i];
+    }
+  }
+
+  void operator-=(CharSet const &that) {
+    for (size_t i = 0; i < BitvectorSize; ++i) {
+      bits[i] = bits[i] && !that.bits[i];
+    }
+  }
+
+  CharSet operator~() const {
+    CharSet result = *this;
+    result.flip();
+    return result;
+  }
+
+  CharSet operator&(CharSet const &that) const {
+    CharSet result = *this;
+    result &= that;
+    return result;
+  }
+
+  CharSet operator|(CharSet const &that) const {
+    CharSet result = *this;
+    result |= that;
+    return result;
+  }
+
+  CharSet operator-(CharSet const &that) const {
+    CharSet result = *this;
+    result -= that;
+    return result;
+  }
+
+  static const CharSet alpha;
+  static const CharSet digits;
+  static const CharSet alnum;
+
+ private:
+  std::vector<bool> bits;
+};
+
+inline const CharSet CharSet::alpha = CharSet('a', 'z') | CharSet('A', 'Z');
+inline const CharSet CharSet::digits = CharSet('0', '9');
+inline const CharSet CharSet::alnum =
+    CharSet('a', 'z') | CharSet('A', 'Z') | CharSet('0', '9');
+
+struct NFA {
+  // Some type aliases to reduce typing
+  using Transition = std::pair<CharSet, State>;
+  using Transitions = std::map<State, std::vector<Transition>>;
+
+  // delete the empty constructor
+  NFA() = delete;
+
+  // NFA for empty language
+  static NFA emptyLang() { return NFA{genState(), {}, {}, {}}; }
+
+  // NFA for empty string
+  static NFA epsilon() {
+    auto q0 = genState();
+    return NFA{q0, {q0}, {}, {}};
+  }
+
+  // NFA accepting only given string
+  static NFA acceptOnly(std::string s) {
+    auto q0 = genState();
+    auto current = q0;
+    Transitions transitions;
+
+    // build a chain of states that let only s go through.
+    for (char c : s) {
+      auto next = genState();
+      transitions.emplace(current, std::vector<Transition>{{CharSet{c}, next}});
+      current = next;
+    }
+
+    return NFA{q0, {current}, transitions, {}};
+  }
+
+  static NFA acceptRange(const CharSet &c) {
+    auto q0 = genState();
+    auto q1 = genState();
+
+    return NFA{
+        q0, {q1}, Transitions{{q0, std::vector<Transition>{{c, q1}}}, {}}};
+  }
+
+  // BEGIN NFA operations. All of these operations keep the state labels from
+  // the original NFA.
+
+  // union of two NFAs' languages
+  NFA operator|(const NFA &that) const {
+    NFA result = *this;
+    result |= that;
+    return result;
+  }
+  // concatenate two NFAs' languages
+  NFA operator*(const NFA &that) const {
+    NFA result = *this;
+    result *= that;
+    return result;
+  }
+
+  void operator|=(const NFA &that) {
+    auto oldStart = start;
+    start = genState();
+    // merge transition relations
+    transitions.insert(that.transitions.begin(), that.transitions.end());
+    epsilonTransitions.insert(that.epsilonTransitions.begin(),
+                              that.epsilonTransitions.end());
+    // merge start states
+    epsilonTransitions.emplace(start, std::set<State>{oldStart, that.start});
+    // merge accept states
+    accept.insert(that.accept.begin(), that.accept.end());
+  }
+
+  void operator*=(const NFA &that) {
+    // merge transition relations
+    transitions.insert(that.transitions.begin(), that.transitions.end());
+    epsilonTransitions.insert(that.epsilonTransitions.begin(),
+                              that.epsilonTransitions.end());
+    // add epsilon edges from old accept states to that.start
+    for (auto q : accept) {
+      if (epsilonTransitions.count(q) != 0) {
+        epsilonTransitions.emplace(q, std::set<State>{});
+      }
+      epsilonTransitions[q].insert(that.start);
+    }
+    // set the new accept states
+    accept = that.accept;
+  }
+
+  // Kleene star
+  NFA operator*() const {
+    auto newStart = genState();
+    auto newEpsilonTransitions = epsilonTransitions;
+    auto newTransitions = transitions;
+
+    // create epsilon-edges from old accept states to new start state
+    for (auto q : accept) {
+      if (newEpsilonTransitions.count(q) == 0) {
+        newEpsilonTransitions.emplace(q, std::set<State>{});
+      }
+
+      newEpsilonTransitions[q].insert(newStart);
+    }
+
+    newEpsilonTransitions.emplace(newStart, std::set<State>{start});
+
+    return NFA{newStart,
+               {newStart},
+               std::move(newTransitions),
+               std::move(newEpsilonTransitions)};
+  }
+
+  // Repeat 1 or more times.
+  NFA operator+() const { return (*this) * (**this); }
+
+  // Repeat 0 or 1 times. Corresponds to ? operation in extended regular
+  // expressions
+  NFA optional() const {
+    auto newStart = genState();
+    auto newEpsilonTransitions = epsilonTransitions;
+    auto newTransitions = transitions;
+    auto newAccept = accept;
+    newAccept.emplace(newStart);
+
+    newEpsilonTransitions.emplace(newStart, std::set<State>{start});
+
+    return NFA{newStart, newAccept, std::move(newTransitions),
+               std::move(newEpsilonTransitions)};
+  }
+
+  // END NFA operations.
+
+  State start;
+  std::set<State> accept;
+  // non-epsilon transitions
+  Transitions transitions;
+  // epsilon transitions
+  std::map<State, std::set<State>> epsilonTransitions;
+
+  // epsilon closure of a given set of states. all states reachable from qs with
+  // only epsilon edges
+  std::set<State> epsClosure(const std::set<State> &qs) const {
+    std::set<State> result;
+    std::set<State> worklist;
+    for (auto q : qs) {
+      worklist.insert(q);
+    }
+
+    while (!worklist.empty()) {
+      auto q = *worklist.begin();
+      worklist.erase(worklist.begin());
+      if (result.count(q) != 0) {
+        // this node is already processed
+        continue;
+      }
+      result.insert(q);
+      auto it = epsilonTransitions.find(q);
+      if (it != epsilonTransitions.end()) {
+        for (auto q_ : it->second) {
+          worklist.insert(q_);
+        }
+      }
+    }
+
+    return result;
+  }
+
+  // transitions with epsilon closure afterward
+  std::set<State> delta(const std::set<State> &qs, char c) const {
+    std::set<State> result;
+
+    for (auto q : qs) {
+      auto it = transitions.find(q);
+      if (it != transitions.end()) {
+        for (auto &[cs, q_] : it->second) {
+          if (cs[c]) {
+            result.insert(q_);
+          }
+        }
+      }
+    }
+
+    return epsClosure(result);
+  }
+};
+
+// A deterministic automaton with a dense transition table, built from an NFA
+// with subset construction and minimized with Hopcroft's algorithm. Every state
+// carries a label; label 0 means the state is not accepting, and accepting
+// states with different labels are never merged during minimization. State 0 is
+// always the dead state.
+struct DFA {
+  using Label = int;
+  using Row = std::array<State, 256>;
+
+  static constexpr State Dead = 0;
+  static constexpr Label NoLabel = 0;
+
+  State start;
+  std::vector<Row> delta;
+  std::vector<Label> labels;
+
+  // Determinize given NFA. `labelOf` computes the label of a DFA state from
+  // the set of NFA states it stands for.
+  template <typename LabelFn>
+  static DFA fromNFA(const NFA &nfa, LabelFn labelOf) {
+    DFA dfa;
+    std::map<std::set<State>, State> ids;
+    std::vector<std::set<State>> worklist;
+
+    auto idOf = [&](std::set<State> qs) -> State {
+      auto it = ids.find(qs);
+      if (it != ids.end()) {
+        return it->second;
+      }
+      State id = dfa.delta.size();
+      dfa.delta.emplace_back();
+      dfa.labels.push_back(qs.empty() ? NoLabel : labelOf(qs));
+      ids.emplace(qs, id);
+      worklist.push_back(std::move(qs));
+      return id;
+    };
+
+    // the empty set becomes the dead state
+    idOf({});
+    dfa.start = idOf(nfa.epsClosure({nfa.start}));
+
+    while (!worklist.empty()) {
+      auto qs = std::move(worklist.back());
+      worklist.pop_back();
+      auto q = ids.at(qs);
+      for (size_t c = 0; c < 256; ++c) {
+        auto next = qs.empty() ? Dead : idOf(nfa.delta(qs, (char)c));
+        dfa.delta[q][c] = next;
+      }
+    }
+
+    return dfa;
+  }
+
+  // Merge equivalent states using Hopcroft's partition refinement algorithm.
+  DFA minimize() const {
+    auto n = delta.size();
+
+    // inverse transitions: for each character c and state q, the states that
+    // move to q on c
+    std::vector<std::vector<std::vector<State>>> inverse(
+        256, std::vector<std::vector<State>>(n));
+    for (State q = 0; q < (State)n; ++q) {
+      for (size_t c = 0; c < 256; ++c) {
+        inverse[c][delta[q][c]].push_back(q);
+      }
+    }
+
+    // initial partition groups the states by their labels
+    std::vector<std::vector<State>> blocks;
+    std::vector<size_t> blockOf(n);
+    std::map<Label, size_t> labelBlocks;
+    for (State q = 0; q < (State)n; ++q) {
+      auto [it, inserted] = labelBlocks.emplace(labels[q], blocks.size());
+      if (inserted) {
+        blocks.emplace_back();
+      }
+      blockOf[q] = it->second;
+      blocks[it->second].push_back(q);
+    }
+
+    std::vector<size_t> splitters;
+    std::vector<bool> isSplitter(blocks.size(), true);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+      splitters.push_back(b);
+    }
+
+    while (!splitters.empty()) {
+      auto a = splitters.back();
+      splitters.pop_back();
+      isSplitter[a] = false;
+      // copy the splitter because it may get split below
+      auto splitter = blocks[a];
+
+      for (size_t c = 0; c < 256; ++c) {
+        // states that move into the splitter on c, grouped by their blocks
+        std::map<size_t, std::vector<State>> touched;
+        for (auto q : splitter) {
+          for (auto p : inverse[c][q]) {
+            touched[blockOf[p]].push_back(p);
+          }
+        }
+
+        for (auto &[y, inY] : touched) {
+          if (inY.size() == blocks[y].size()) {
+            // all of the block moves into the splitter, nothing to split
+            continue;
+          }
+
+          // move the states in Y ∩ X to a new block, Y \ X keeps the old id
+          auto newBlock = blocks.size();
+          blocks.emplace_back(inY);
+          isSplitter.push_back(false);
+          for (auto p : inY) {
+            blockOf[p] = newBlock;
+          }
+          auto &rest = blocks[y];
+          rest.erase(std::remove_if(rest.begin(), rest.end(),
+                                    [&](State p) {
+                                      return blockOf[p] == newBlock;
+                                    }),
+                     rest.end());
+
+          if (isSplitter[y] || blocks[newBlock].size() <= rest.size()) {
+            splitters.push_back(newBlock);
+            isSplitter[newBlock] = true;
+          } else {
+            splitters.push_back(y);
+            isSplitter[y] = true;
+          }
+        }
+      }
+    }
+
+    // renumber the blocks so that the dead state's block comes first
+    std::vector<State> renumber(blocks.size(), -1);
+    State next = 0;
+    renumber[blockOf[Dead]] = next++;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+      if (renumber[b] == -1) {
+        renumber[b] = next++;
+      }
+    }
+
+    DFA result;
+    result.start = renumber[blockOf[start]];
+    result.delta.resize(blocks.size());
+    result.labels.resize(blocks.size());
+    for (size_t b = 0; b < blocks.size(); ++b) {
+      auto representative = blocks[b].front();
+      auto q = renumber[b];
+      result.labels[q] = labels[representative];
+      for (size_t c = 0; c < 256; ++c) {
+        result.delta[q][c] = renumber[blockOf[delta[representative][c]]];
+      }
+    }
+
+    return result;
+  }
+
+  // Print the DFA as constexpr arrays whose names start with given prefix
+  void emit(std::ostream &out, const std::string &prefix) const {
+    out << "constexpr State " << prefix << "Start = " << start << ";\n\n";
+
+    out << "constexpr Label " << prefix << "Labels[] = {";
+    for (size_t q = 0; q < labels.size(); ++q) {
+      out << (q % 16 == 0 ? "\n    " : " ") << labels[q] << ",";
+    }
+    out << "\n};\n\n";
+
+    out << "constexpr State " << prefix << "Delta[][256] = {\n";
+    for (auto &row : delta) {
+      out << "    {";
+      for (size_t c = 0; c < row.size(); ++c) {
+        out << (c % 16 == 0 ? "\n        " : " ") << std::setw(3) << row[c]
+            << ",";
+      }
+      out << "\n    },\n";
+    }
+    out << "};\n\n";
+  }
+};
+
+// An additional struct to contain the NFA for recognizing lexemes and token
+// types
+struct NFAInfo {
+  std::map<State, TokenType> q2tokType;
+  std::optional<NFA> lexemeNFA;
+  std::optional<NFA> whitespaceNFA;
+
+  NFAInfo() {
+    // create the NFA for identifiers
+    NFA id =
+        NFA::acceptRange(CharSet::alpha) * (*NFA::acceptRange(CharSet::alnum));
+
+    // start by adding ID NFA to our lexeme NFA
+    lexemeNFA.emplace(id);
+
+    for (auto q : id.accept) {
+      q2tokType.emplace(q, TokenType::Id);
+    }
+
+    // create the NFA for numbers
+    NFA num =
+        NFA::acceptOnly("-").optional() * (+NFA::acceptRange(CharSet::digits));
+
+    *lexemeNFA |= num;
+
+    for (auto q : num.accept) {
+      q2tokType.emplace(q, TokenType::Num);
+    }
+
+    // A mapping from keywords, type int, and punctuation to their respective
+    // token types
+    std::vector<std::pair<std::string, TokenType>> keywordAndPunct{
+        {"int", TokenType::Type},      {"while", TokenType::While},
+        {"if", TokenType::If},         {"else", TokenType::Else},
+        {"def", TokenType::Def},       {"return", TokenType::Return},
+        {"output", TokenType::Output}, {"+", TokenType::ArithOp},
+        {"-", TokenType::ArithOp},     {"*", TokenType::ArithOp},
+        {"&&", TokenType::LBinOp},     {"||", TokenType::LBinOp},
+        {"!", TokenType::LNeg},        {"<=", TokenType::RelOp},
+        {"<", TokenType::RelOp},       {"=", TokenType::RelOp},
+        {"(", TokenType::LParen},      {")", TokenType::RParen},
+        {"{", TokenType::LBrace},      {"}", TokenType::RBrace},
+        {"[", TokenType::LBracket},    {"]", TokenType::RBracket},
+        {";", TokenType::Semicolon},   {":=", TokenType::Assign},
+        {".", TokenType::Dot},         {"new", TokenType::New},
+        {"nil", TokenType::Nil},       {"struct", TokenType::Struct},
+        {":", TokenType::HasType},     {",", TokenType::Comma}};
+
+    for (auto &[s, tokType] : keywordAndPunct) {
+      // create the NFA
+      auto nfa = NFA::acceptOnly(s);
+      // add the NFA to our lexeme NFA
+      *lexemeNFA |= nfa;
+      // map the accepting state to corresponding token type
+      q2tokType.emplace(*nfa.accept.begin(), tokType);
+    }
+
+    // Add the NFA for non-built-in types
+    auto typeNFA = NFA::acceptOnly("%") * (+ NFA::acceptRange(CharSet::alnum));
+    *lexemeNFA |= typeNFA;
+
+    // Mark the accept states coming from typeNFA as Token::Type
+    for (auto qAccept : typeNFA.accept) {
+      q2tokType.emplace(qAccept, TokenType::Type);
+    }
+
+    // Build the whitespace NFA
+    CharSet whitespace(' ');
+    whitespace.add('\t');
+    whitespace.add('\n');
+    whitespace.add('\r');
+    whitespaceNFA = NFA::acceptRange(whitespace);
+
+    // a set containing all characters but null or newline
+    CharSet nonLine{' ', std::numeric_limits<char>::max()};
+    whitespace.add('\t');
+
+    // make whitespace NFA skip comments as well
+    *whitespaceNFA |= NFA::acceptOnly("//") * (*NFA::acceptRange(nonLine)) *
+                      NFA::acceptRange(CharSet{'\n'});
+    *whitespaceNFA = **whitespaceNFA;
+  }
+
+  // Get the most prioritized token accepted by any of the given states, or
+  // nullopt if none of them is an accept state. The behavior is undefined if
+  // the token types have no comparable priority.
+  std::optional<TokenType> getMostPrioritizedTokenType(
+      const std::set<State> &states) const {
+    std::optional<TokenType> tokType;
+
+    for (auto q : states) {
+      auto it = q2tokType.find(q);
+      // everything else is prioritized over identifiers
+      if (it != q2tokType.end() && (!tokType || *tokType == TokenType::Id)) {
+        tokType = it->second;
+      }
+    }
+
+    return tokType;
+  }
+};
+
+// The DFA recognizing lexemes, labeled with their token types
+inline DFA buildLexemeDFA() {
+  NFAInfo nfaInfo;
+  return DFA::fromNFA(*nfaInfo.lexemeNFA, [&](const std::set<State> &qs) {
+           auto tokType = nfaInfo.getMostPrioritizedTokenType(qs);
+           return tokType ? static_cast<DFA::Label>(*tokType) : DFA::NoLabel;
+         }).minimize();
+}
+
+// The DFA recognizing whitespace and comments, it only needs to tell accepting
+// states apart
+inline DFA buildWhitespaceDFA() {
+  NFAInfo nfaInfo;
+  return DFA::fromNFA(*nfaInfo.whitespaceNFA, [&](const std::set<State> &qs) {
+           auto &accept = nfaInfo.whitespaceNFA->accept;
+           return std::any_of(qs.begin(), qs.end(),
+                              [&](State q) { return accept.count(q) != 0; })
+                      ? 1
+                      : DFA::NoLabel;
+         }).minimize();
+}
+
+}  // namespace cs160::frontend::lexer_automata
@@ -0,0 +1,38 @@
+// Generator for the lexer automata. It prints the minimized DFAs of
+// frontend/lexer_automata.h as constexpr tables to standard output. The
+// Makefile runs it to produce build/lexer_tables.h, which frontend/lexer.cpp
+// includes, so the lexer does no construction work at startup.
+#include "frontend/lexer_automata.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+using namespace cs160::frontend::lexer_automata;
+
+int main() {
+  auto lexemeDFA = buildLexemeDFA();
+  auto whitespaceDFA = buildWhitespaceDFA();
+
+  auto numStates = std::max(lexemeDFA.delta.size(), whitespaceDFA.delta.size());
+  auto stateType = numStates <= std::numeric_limits<uint8_t>::max() + 1
+                       ? "std::uint8_t"
+                       : "std::uint16_t";
+
+  auto &out = std::cout;
+  out << "// Generated by build/lexer_gen from frontend/lexer_gen.cpp, do not "
+         "edit.\n"
+      << "#pragma once\n\n"
+      << "#include <cstdint>\n\n"
+      << "namespace cs160::frontend::lexer_tables {\n\n"
+      << "using State = " << stateType << ";\n"
+      << "using Label = int;\n\n"
+      << "constexpr State Dead = " << DFA::Dead << ";\n"
+      << "constexpr Label NoLabel = " << DFA::NoLabel << ";\n\n"
+      << "// Labels of the lexeme DFA are TokenType values\n";
+  lexemeDFA.emit(out, "lexeme");
+  out << "// The whitespace DFA accepts whitespace and comments\n";
+  whitespaceDFA.emit(out, "whitespace");
+  out << "}  // namespace cs160::frontend::lexer_tables\n";
+
+  return 0;
+}
@@ -0,0 +1,47 @@
+#define CATCH_CONFIG_MAIN
+
+#include "frontend/lexer_automata.h"
+#include "build/lexer_tables.h"
+#include "catch2/catch.hpp"
+
+using namespace cs160::frontend;
+
+namespace {
+
+// Compare a DFA built at runtime with the generated tables of the same DFA
+template <size_t NumStates>
+void requireSameDFA(const lexer_automata::DFA &dfa, lexer_tables::State start,
+                    const lexer_tables::Label (&labels)[NumStates],
+                    const lexer_tables::State (&delta)[NumStates][256]) {
+  REQUIRE(dfa.start == start);
+  REQUIRE(dfa.labels.size() == NumStates);
+  REQUIRE(dfa.delta.size() == NumStates);
+  for (size_t q = 0; q < NumStates; ++q) {
+    INFO("state " << q);
+    REQUIRE(dfa.labels[q] == labels[q]);
+    for (size_t c = 0; c < 256; ++c) {
+      INFO("character " << c);
+      REQUIRE(dfa.delta[q][c] == delta[q][c]);
+    }
+  }
+}
+
+}  // namespace
+
+TEST_CASE("Generated tables match the automata built at runtime",
+          "[lexer_gen]") {
+  REQUIRE(lexer_automata::DFA::Dead == lexer_tables::Dead);
+  REQUIRE(lexer_automata::DFA::NoLabel == lexer_tables::NoLabel);
+
+  SECTION("lexemes") {
+    requireSameDFA(lexer_automata::buildLexemeDFA(), lexer_tables::lexemeStart,
+                   lexer_tables::lexemeLabels, lexer_tables::lexemeDelta);
+  }
+
+  SECTION("whitespace") {
+    requireSameDFA(lexer_automata::buildWhitespaceDFA(),
+                   lexer_tables::whitespaceStart,
+                   lexer_tables::whitespaceLabels,
+                   lexer_tables::whitespaceDelta);
+  }
+}
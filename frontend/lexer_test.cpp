@@ -1,6 +1,7 @@
 #define CATCH_CONFIG_MAIN
 
 #include "frontend/lexer.h"
+#include <sstream>
 #include "catch2/catch.hpp"
 
 using namespace cs160::frontend;
@@ -83,3 +84,61 @@ TEST_CASE("Simple whitespace and comment tests", "[Lexer{}]") {
   CHECK_THAT(Lexer{}.tokenize("  def\n\nif"),
              Equals(std::vector{Token::makeDef(), Token::makeIf()}));
 }
+
+TEST_CASE("Longest munch and keyword priority tests", "[lexer]") {
+  CHECK_THAT(Lexer{}.tokenize("whilex if2 intx"),
+             Equals(std::vector{Token::makeId("whilex"), Token::makeId("if2"),
+                                Token::makeId("intx")}));
+  CHECK_THAT(Lexer{}.tokenize("x<=-3:=y"),
+             Equals(std::vector{Token::makeId("x"),
+                                Token::makeRelOp(RelOp::LessEq),
+                                Token::makeNum(-3), Token::makeAssign(),
+                                Token::makeId("y")}));
+  CHECK_THAT(Lexer{}.tokenize("a.b// comment\n%t"),
+             Equals(std::vector{Token::makeId("a"), Token::makeDot(),
+                                Token::makeId("b"), Token::makeType("%t")}));
+}
+
+TEST_CASE("Lexemes refer to the program text", "[lexer]") {
+  std::string program = "foo := %bar;";
+  auto tokens = Lexer{}.tokenize(program);
+  REQUIRE(tokens.size() == 4);
+  CHECK(tokens[0].stringValue().data() == program.data());
+  CHECK(tokens[2].stringValue().data() == program.data() + 7);
+  CHECK(tokens[2].stringValue() == "%bar");
+}
+
+TEST_CASE("Token stream tests", "[lexer]") {
+  std::string program = "def f(int x) : int { return x <= -42; } // done\n"
+                        "%list l; output l.next;";
+  auto expected = Lexer{}.tokenize(program);
+
+  SECTION("lexing a buffer lazily") {
+    LexingTokenStream stream{program};
+    CHECK(stream.peek(2) == Token::makeId("f"));
+    for (auto &token : expected) {
+      REQUIRE(stream.peek() == token);
+      stream.advance();
+    }
+    CHECK(stream.peek() == std::nullopt);
+  }
+
+  SECTION("lexing an input stream in small chunks") {
+    std::istringstream input{program};
+    LexingTokenStream stream{input, 3};
+    for (auto &token : expected) {
+      REQUIRE(stream.peek() == token);
+      stream.advance();
+    }
+    CHECK(stream.peek() == std::nullopt);
+  }
+
+  SECTION("invalid lexemes are reported when they are reached") {
+    std::istringstream input{"x := y > 3;"};
+    LexingTokenStream stream{input, 4};
+    CHECK(stream.peek(3) == Token::makeId("y"));
+    REQUIRE_THROWS_MATCHES(
+        stream.peek(4), InvalidLexemeError,
+        Message("Invalid lexeme in input program: > at position 7"));
+  }
+}
@@ -1,18 +1,16 @@
-
 #include "frontend/parser.h"
 #include <iostream>
 
 namespace cs160::frontend {
 
 Token Parser::matchToken(const TokenType& tok) {
-  // we're duplicating some work here but I don't understand quite what
   if (auto token = nextToken(); token && token->type() == tok) {
-    head++;
+    tokens.advance();
     return *token;
   } else {
     std::string message = "Expected a " + std::string(tokenTypeToString(tok));
-    if (nextToken()) {
-      message += " but found " + nextToken()->toString();
+    if (token) {
+      message += " but found " + token->toString();
     } else {
       message += " but reached the end of program";
     }
@@ -20,503 +18,752 @@ Token Parser::matchToken(const TokenType& tok) {
   }
 }
 
-// peek one token ahead but don't advance; should move from head as int to head
-// as iterator with std::next
+// peek ahead but don't advance
 std::optional<cs160::frontend::Token> Parser::nextToken(int peek) {
-  if (head == static_cast<int>(tokens.size()) - 1) {
-    return std::nullopt;
-  } else {
-    return tokens[head + peek];
-  }
+  return tokens.peek(peek);
 }
 
-// arithmetic expressions
+namespace {
+
+// Builds the nodes of a tree in an arena. Missing subexpressions are null.
+class TreeNodes final {
+ public:
+  using Arith = ArithmeticExprP;
+  using Path = AccessPathP;
+  using Rhs = const RhsExpr*;
+  using Rel = RelationalExprP;
+  using Stmt = StatementP;
+  using Block = BlockStmtP;
+  using Decl = Declaration;
+  using Type = const TypeExpr*;
+  using Param = std::pair<const TypeExpr*, Variable>;
+  using Call = FunctionCallP;
+  using FunDef = FunctionDefP;
+  using TypeDefinition = TypeDef;
+  using Result = const Program*;
+
+  explicit TreeNodes(AstArena& arena) : arena(arena) {}
+
+  Arith integer(int value) { return arena.make<IntegerExpr>(value); }
+  Arith nil() { return arena.make<NilExpr>(); }
+  Arith newExpr(Symbol type) { return arena.make<NewExpr>(type); }
+  Path accessPath(Symbol root, std::vector<Symbol> fields) {
+    return arena.make<AccessPath>(Variable(root),
+                                  arena.makeList(std::move(fields)));
+  }
+  Arith add(Arith lhs, Arith rhs) { return arena.make<AddExpr>(lhs, rhs); }
+  Arith subtract(Arith lhs, Arith rhs) {
+    return arena.make<SubtractExpr>(lhs, rhs);
+  }
+  Arith multiply(Arith lhs, Arith rhs) {
+    return arena.make<MultiplyExpr>(lhs, rhs);
+  }
 
-IntegerExprP Parser::parseIntegerExpr() {
-  // std::cout << "Parser::parseIntegerExpr" << std::endl;
-  matchToken(TokenType::Num);
-  return std::make_unique<const IntegerExpr>(tokens[head].intValue());
-}
+  Rel lessThan(Arith lhs, Arith rhs) {
+    return arena.make<LessThanExpr>(lhs, rhs);
+  }
+  Rel lessThanEqualTo(Arith lhs, Arith rhs) {
+    return arena.make<LessThanEqualToExpr>(lhs, rhs);
+  }
+  Rel equalTo(Arith lhs, Arith rhs) {
+    return arena.make<EqualToExpr>(lhs, rhs);
+  }
+  Rel logicalAnd(Rel lhs, Rel rhs) {
+    return arena.make<LogicalAndExpr>(lhs, rhs);
+  }
+  Rel logicalOr(Rel lhs, Rel rhs) {
+    return arena.make<LogicalOrExpr>(lhs, rhs);
+  }
+  Rel logicalNot(Rel operand) { return arena.make<LogicalNotExpr>(operand); }
 
-Variable Parser::parseVariable() {
-  return Variable(matchToken(TokenType::Id).stringValue());
-}
+  Decl declaration(Symbol type, Symbol variable) {
+    return Declaration(TypeExpr{type}, Variable(variable));
+  }
+  Block block(std::vector<Decl> decls, std::vector<Stmt> stmts) {
+    return arena.make<BlockStmt>(arena.makeList(std::move(decls)),
+                                 arena.makeList(std::move(stmts)));
+  }
+  Stmt assignment(Path lhs, Rhs rhs) {
+    return arena.make<Assignment>(lhs, rhs);
+  }
+  Stmt conditional(Rel guard, Block trueBranch, Block falseBranch) {
+    return arena.make<Conditional>(guard, trueBranch, falseBranch);
+  }
+  Stmt loop(Rel guard, Block body) { return arena.make<Loop>(guard, body); }
 
-std::unique_ptr<const AccessPath> Parser::parseAccessPath() {
-  // std::cout << "Parser::parseVariable" << std::endl;
-  auto root = parseVariable();
-  std::vector<std::string> fields;
-  // Convert recursive descent to a while loop
-  while (nextToken() && nextToken()->type() == TokenType::Dot) {
-    matchToken(TokenType::Dot);
-    fields.push_back(matchToken(TokenType::Id).stringValue());
+  Call call(Symbol callee, std::vector<Arith> args) {
+    return arena.make<FunctionCall>(callee, arena.makeList(std::move(args)));
+  }
+  Type type(Symbol name) { return arena.make<TypeExpr>(name); }
+  Param parameter(Symbol type, Symbol variable) {
+    return std::make_pair(this->type(type), Variable(variable));
+  }
+  FunDef functionDef(Symbol name, std::vector<Param> params, Type retType,
+                     Block body, Arith retval) {
+    return arena.make<FunctionDef>(name, retType,
+                                   arena.makeList(std::move(params)), body,
+                                   retval);
+  }
+  TypeDefinition typeDef(Symbol name, std::vector<Decl> fields) {
+    return {name, arena.makeList(std::move(fields))};
+  }
+  Result program(std::vector<TypeDefinition> typeDefs,
+                 std::vector<FunDef> funDefs, Block block, Arith output) {
+    return arena.make<Program>(arena.makeList(std::move(typeDefs)),
+                               arena.makeList(std::move(funDefs)), block,
+                               output);
   }
-  return std::make_unique<const AccessPath>(root, fields);
-}
 
-ArithmeticExprP Parser::parseAFactor() {
-  // std::cout << "Parser::parseAFactor " << nextToken().value() << std::endl;
-  if (nextToken() && nextToken().value().type() == TokenType::LParen) {
-    matchToken(TokenType::LParen);
-    auto ae = parseArithmeticExpr();
-    matchToken(TokenType::RParen);
-    return ae;
-  } else if (nextToken() && nextToken().value().type() == TokenType::Num) {
-    return parseIntegerExpr();
-  } else if (nextToken() && nextToken().value().type() == TokenType::Id) {
-    return parseAccessPath();
-  } else if (nextToken() && nextToken().value().type() == TokenType::Nil) {
-    matchToken(TokenType::Nil);
-    return std::make_unique<NilExpr>();
-  } else if (nextToken() && nextToken().value().type() == TokenType::New) {
-    matchToken(TokenType::New);
-    auto type = matchToken(TokenType::Type);
-    if (type.stringValue() == "int") {
-      throw InvalidASTError(); // cannot create ints with new
+ private:
+  AstArena& arena;
+};
+
+// A node appended to a flat AST, false for a missing subexpression
+struct FlatNode {
+  FlatAst::NodeId id = FlatAst::NoNode;
+
+  explicit operator bool() const { return id != FlatAst::NoNode; }
+};
+
+// Appends the nodes to a flat AST in the order they are recognized. Children
+// are recognized before their parents and in source order, which is the
+// order FlatAst::fromTree visits a tree in, so both give the same encoding.
+class FlatNodes final {
+ public:
+  using Arith = FlatNode;
+  using Path = FlatNode;
+  using Rhs = FlatNode;
+  using Rel = FlatNode;
+  using Stmt = FlatNode;
+  using Block = FlatNode;
+  using Decl = FlatNode;
+  using Type = FlatNode;
+  using Param = std::pair<FlatNode, FlatNode>;
+  using Call = FlatNode;
+  using FunDef = FlatNode;
+  using TypeDefinition = FlatNode;
+  using Result = FlatNode;
+
+  explicit FlatNodes(FlatAst& ast) : ast(ast) {}
+
+  Arith integer(int value) { return append(NodeKind::Integer, value); }
+  Arith nil() { return append(NodeKind::Nil, 0); }
+  Arith newExpr(Symbol type) { return append(NodeKind::New, symbol(type)); }
+  Path accessPath(Symbol root, const std::vector<Symbol>& fields) {
+    std::vector<uint32_t> operands;
+    for (auto field : fields) {
+      operands.push_back(field.id());
     }
-    return std::make_unique<NewExpr>(type.stringValue());
+    return append(NodeKind::AccessPath, symbol(root), operands);
+  }
+  Arith add(Arith lhs, Arith rhs) { return binary(NodeKind::Add, lhs, rhs); }
+  Arith subtract(Arith lhs, Arith rhs) {
+    return binary(NodeKind::Subtract, lhs, rhs);
+  }
+  Arith multiply(Arith lhs, Arith rhs) {
+    return binary(NodeKind::Multiply, lhs, rhs);
   }
-  throw InvalidASTError();  // if we get here it should be a parse error
-}
 
-ArithmeticExprP Parser::parseATermPrime() {
-  // std::cout << "Parser::parseATermPrime" << std::endl;
+  Rel lessThan(Arith lhs, Arith rhs) {
+    return binary(NodeKind::LessThan, lhs, rhs);
+  }
+  Rel lessThanEqualTo(Arith lhs, Arith rhs) {
+    return binary(NodeKind::LessThanEqualTo, lhs, rhs);
+  }
+  Rel equalTo(Arith lhs, Arith rhs) {
+    return binary(NodeKind::EqualTo, lhs, rhs);
+  }
+  Rel logicalAnd(Rel lhs, Rel rhs) {
+    return binary(NodeKind::LogicalAnd, lhs, rhs);
+  }
+  Rel logicalOr(Rel lhs, Rel rhs) {
+    return binary(NodeKind::LogicalOr, lhs, rhs);
+  }
+  Rel logicalNot(Rel operand) {
+    return append(NodeKind::LogicalNot, 0, {operand.id});
+  }
 
-  if (nextToken() &&
-      nextToken().value() == Token::makeArithOp(ArithOp::Times)) {
-    matchToken(Token::makeArithOp(ArithOp::Times).type());
-    auto l = parseAFactor();
-    auto p = parseATermPrime();
-    if (p) {
-      return std::make_unique<const MultiplyExpr>(std::move(l), std::move(p));
-    } else {
-      return l;
+  Decl declaration(Symbol type, Symbol variable) {
+    auto t = this->type(type);
+    auto v = append(NodeKind::Variable, symbol(variable));
+    return append(NodeKind::Declaration, 0, {t.id, v.id});
+  }
+  Block block(const std::vector<Decl>& decls, const std::vector<Stmt>& stmts) {
+    auto operands = ids(decls);
+    for (auto stmt : stmts) {
+      operands.push_back(stmt.id);
     }
-  } else {
-    // empty unique_ptr
-    return {};
+    return append(NodeKind::Block, static_cast<int32_t>(decls.size()),
+                  operands);
   }
-}
-
-ArithmeticExprP Parser::parseATerm() {
-  // std::cout << "Parser::parseATerm" << std::endl;
-  auto l = parseAFactor();
-  auto p = parseATermPrime();
-  if (p) {
-    return std::make_unique<const MultiplyExpr>(std::move(l), std::move(p));
-  } else {
-    return l;
+  Stmt assignment(Path lhs, Rhs rhs) {
+    return append(NodeKind::Assignment, 0, {lhs.id, rhs.id});
+  }
+  Stmt conditional(Rel guard, Block trueBranch, Block falseBranch) {
+    return append(NodeKind::Conditional, 0,
+                  {guard.id, trueBranch.id, falseBranch.id});
+  }
+  Stmt loop(Rel guard, Block body) {
+    return append(NodeKind::Loop, 0, {guard.id, body.id});
   }
-}
-
-std::pair<ArithmeticExprP, std::optional<Token>> Parser::parseAExpPrime() {
-  // std::cout << "Parser::parseAExpPrime " << nextToken().value() << std::endl;
-  if (nextToken() && nextToken().value() == Token::makeArithOp(ArithOp::Plus)) {
-    matchToken(Token::makeArithOp(ArithOp::Plus).type());
-    auto l = parseATerm();
-    auto p = parseAExpPrime();
-    if (p.first && p.second.value() == Token::makeArithOp(ArithOp::Plus)) {
-      return std::make_pair(
-          std::make_unique<const AddExpr>(std::move(l), std::move(p.first)),
-          Token::makeArithOp(ArithOp::Plus));
-    } else if (p.first &&
-               p.second.value() == Token::makeArithOp(ArithOp::Minus)) {
-      return std::make_pair(std::make_unique<const SubtractExpr>(
-                                std::move(l), std::move(p.first)),
-                            Token::makeArithOp(ArithOp::Plus));
 
-    } else {
-      return std::make_pair(std::move(l), Token::makeArithOp(ArithOp::Plus));
+  Call call(Symbol callee, const std::vector<Arith>& args) {
+    return append(NodeKind::FunctionCall, symbol(callee), ids(args));
+  }
+  Type type(Symbol name) { return append(NodeKind::Type, symbol(name)); }
+  Param parameter(Symbol type, Symbol variable) {
+    auto t = this->type(type);
+    return {t, append(NodeKind::Variable, symbol(variable))};
+  }
+  FunDef functionDef(Symbol name, const std::vector<Param>& params,
+                     Type retType, Block body, Arith retval) {
+    std::vector<uint32_t> operands{retType.id, body.id, retval.id};
+    for (auto [type, variable] : params) {
+      operands.push_back(type.id);
+      operands.push_back(variable.id);
     }
+    return append(NodeKind::FunctionDef, symbol(name), operands);
+  }
+  TypeDefinition typeDef(Symbol name, const std::vector<Decl>& fields) {
+    return append(NodeKind::TypeDef, symbol(name), ids(fields));
+  }
+  Result program(const std::vector<TypeDefinition>& typeDefs,
+                 const std::vector<FunDef>& funDefs, Block block,
+                 Arith output) {
+    auto operands = ids(typeDefs);
+    for (auto funDef : funDefs) {
+      operands.push_back(funDef.id);
+    }
+    operands.push_back(block.id);
+    operands.push_back(output.id);
+    return append(NodeKind::Program, static_cast<int32_t>(typeDefs.size()),
+                  operands);
   }
 
-  else if (nextToken() &&
-           nextToken().value() == Token::makeArithOp(ArithOp::Minus)) {
-    matchToken(Token::makeArithOp(ArithOp::Minus).type());
-    auto l = parseATerm();
-    auto p = parseAExpPrime();
-    if (p.first && p.second.value() == Token::makeArithOp(ArithOp::Plus)) {
-      return std::make_pair(
-          std::make_unique<const AddExpr>(std::move(l), std::move(p.first)),
-          Token::makeArithOp(ArithOp::Minus));
-    } else if (p.first &&
-               p.second.value() == Token::makeArithOp(ArithOp::Minus)) {
-      return std::make_pair(std::make_unique<const SubtractExpr>(
-                                std::move(l), std::move(p.first)),
-                            Token::makeArithOp(ArithOp::Minus));
-    } else {
-      return std::make_pair(std::move(l), Token::makeArithOp(ArithOp::Minus));
+ private:
+  // Symbols are stored in flat nodes by their id
+  static int32_t symbol(Symbol s) { return static_cast<int32_t>(s.id()); }
+
+  static std::vector<uint32_t> ids(const std::vector<FlatNode>& nodes) {
+    std::vector<uint32_t> result;
+    for (auto node : nodes) {
+      result.push_back(node.id);
     }
+    return result;
+  }
 
-  } else {
-    return std::make_pair(nullptr, std::nullopt);  // epsilon case
+  FlatNode append(NodeKind kind, int32_t value,
+                  std::initializer_list<uint32_t> operands = {}) {
+    return {ast.add(kind, value, operands)};
+  }
+  FlatNode append(NodeKind kind, int32_t value,
+                  const std::vector<uint32_t>& operands) {
+    return {ast.add(kind, value, operands)};
+  }
+  FlatNode binary(NodeKind kind, FlatNode lhs, FlatNode rhs) {
+    return append(kind, 0, {lhs.id, rhs.id});
   }
-}
 
-ArithmeticExprP Parser::parseArithmeticExpr() {
-  // std::cout << "Parser::parseArithmeticExpr" << std::endl;
-  auto at = parseATerm();
-  auto p = parseAExpPrime();
-  if (p.second && p.second.value() == Token::makeArithOp(ArithOp::Plus)) {
-    return std::make_unique<const AddExpr>(std::move(at), std::move(p.first));
+  FlatAst& ast;
+};
+
+}  // namespace
+
+template <class Nodes>
+class Parser::Grammar final {
+ public:
+  using Arith = typename Nodes::Arith;
+  using Path = typename Nodes::Path;
+  using Rel = typename Nodes::Rel;
+  using Stmt = typename Nodes::Stmt;
+  using Block = typename Nodes::Block;
+  using Decl = typename Nodes::Decl;
+  using Param = typename Nodes::Param;
+  using Call = typename Nodes::Call;
+  using FunDef = typename Nodes::FunDef;
+  using TypeDefinition = typename Nodes::TypeDefinition;
+
+  Grammar(Parser& parser, Nodes& nodes) : parser(parser), nodes(nodes) {}
+
+  // arithmetic expressions
+
+  Arith parseIntegerExpr() {
+    // std::cout << "Parser::parseIntegerExpr" << std::endl;
+    auto num = matchToken(TokenType::Num);
+    return nodes.integer(num.intValue());
   }
 
-  else if (p.second && p.second.value() == Token::makeArithOp(ArithOp::Minus)) {
-    return std::make_unique<const SubtractExpr>(std::move(at),
-                                                std::move(p.first));
+  Symbol parseVariable() { return matchToken(TokenType::Id).symbolValue(); }
+
+  Path parseAccessPath() {
+    // std::cout << "Parser::parseVariable" << std::endl;
+    auto root = parseVariable();
+    std::vector<Symbol> fields;
+    // Convert recursive descent to a while loop
+    while (nextToken() && nextToken()->type() == TokenType::Dot) {
+      matchToken(TokenType::Dot);
+      fields.push_back(matchToken(TokenType::Id).symbolValue());
+    }
+    return nodes.accessPath(root, std::move(fields));
   }
 
-  else {
-    return at;
+  Arith parseAFactor() {
+    // std::cout << "Parser::parseAFactor " << nextToken().value() << std::endl;
+    if (nextToken() && nextToken().value().type() == TokenType::LParen) {
+      matchToken(TokenType::LParen);
+      auto ae = parseArithmeticExpr();
+      matchToken(TokenType::RParen);
+      return ae;
+    } else if (nextToken() && nextToken().value().type() == TokenType::Num) {
+      return parseIntegerExpr();
+    } else if (nextToken() && nextToken().value().type() == TokenType::Id) {
+      return parseAccessPath();
+    } else if (nextToken() && nextToken().value().type() == TokenType::Nil) {
+      matchToken(TokenType::Nil);
+      return nodes.nil();
+    } else if (nextToken() && nextToken().value().type() == TokenType::New) {
+      matchToken(TokenType::New);
+      auto type = matchToken(TokenType::Type);
+      if (type.symbolValue() == TypeExpr::IntName) {
+        throw InvalidASTError(); // cannot create ints with new
+      }
+      return nodes.newExpr(type.symbolValue());
+    }
+    throw InvalidASTError();  // if we get here it should be a parse error
   }
-}
 
-// relational expressions
+  Arith parseATermPrime() {
+    // std::cout << "Parser::parseATermPrime" << std::endl;
 
-RelationalExprP Parser::parseRexpPrime1() {
-  // std::cout << "Parser::parseRexpPrime1" << std::endl;
-  if (nextToken() && nextToken().value().type() == TokenType::LNeg) {
-    matchToken(TokenType::LNeg);
-    auto re = parseRexp();
-    return std::make_unique<const LogicalNotExpr>(std::move(re));
+    if (nextToken() &&
+        nextToken().value() == Token::makeArithOp(ArithOp::Times)) {
+      matchToken(Token::makeArithOp(ArithOp::Times).type());
+      auto l = parseAFactor();
+      auto p = parseATermPrime();
+      if (p) {
+        return nodes.multiply(l, p);
+      } else {
+        return l;
+      }
+    } else {
+      // no more factors
+      return {};
+    }
+  }
 
-  } else if (nextToken() && nextToken().value().type() == TokenType::LBracket) {
-    matchToken(TokenType::LBracket);
-    auto re = parseRexp();
-    matchToken(TokenType::RBracket);
-    return re;
+  Arith parseATerm() {
+    // std::cout << "Parser::parseATerm" << std::endl;
+    auto l = parseAFactor();
+    auto p = parseATermPrime();
+    if (p) {
+      return nodes.multiply(l, p);
+    } else {
+      return l;
+    }
+  }
 
-  } else {
-    auto ae1 = parseArithmeticExpr();
+  std::pair<Arith, std::optional<Token>> parseAExpPrime() {
+    // std::cout << "Parser::parseAExpPrime " << nextToken().value() <<
+    // std::endl;
     if (nextToken() &&
-        nextToken().value() == Token::makeRelOp(RelOp::LessThan)) {
-      matchToken(Token::makeRelOp(RelOp::LessThan).type());
-      auto ae2 = parseArithmeticExpr();
-      return std::make_unique<const LessThanExpr>(std::move(ae1),
-                                                  std::move(ae2));
+        nextToken().value() == Token::makeArithOp(ArithOp::Plus)) {
+      matchToken(Token::makeArithOp(ArithOp::Plus).type());
+      auto l = parseATerm();
+      auto p = parseAExpPrime();
+      if (p.first && p.second.value() == Token::makeArithOp(ArithOp::Plus)) {
+        return std::make_pair(nodes.add(l, p.first),
+                              Token::makeArithOp(ArithOp::Plus));
+      } else if (p.first &&
+                 p.second.value() == Token::makeArithOp(ArithOp::Minus)) {
+        return std::make_pair(nodes.subtract(l, p.first),
+                              Token::makeArithOp(ArithOp::Plus));
+
+      } else {
+        return std::make_pair(l, Token::makeArithOp(ArithOp::Plus));
+      }
+    }
 
-    } else if (nextToken() &&
-               nextToken().value() == Token::makeRelOp(RelOp::LessEq)) {
-      matchToken(Token::makeRelOp(RelOp::LessEq).type());
-      auto ae2 = parseArithmeticExpr();
-      return std::make_unique<const LessThanEqualToExpr>(std::move(ae1),
-                                                         std::move(ae2));
+    else if (nextToken() &&
+             nextToken().value() == Token::makeArithOp(ArithOp::Minus)) {
+      matchToken(Token::makeArithOp(ArithOp::Minus).type());
+      auto l = parseATerm();
+      auto p = parseAExpPrime();
+      if (p.first && p.second.value() == Token::makeArithOp(ArithOp::Plus)) {
+        return std::make_pair(nodes.add(l, p.first),
+                              Token::makeArithOp(ArithOp::Minus));
+      } else if (p.first &&
+                 p.second.value() == Token::makeArithOp(ArithOp::Minus)) {
+        return std::make_pair(nodes.subtract(l, p.first),
+                              Token::makeArithOp(ArithOp::Minus));
+      } else {
+        return std::make_pair(l, Token::makeArithOp(ArithOp::Minus));
+      }
 
-    } else if (nextToken() &&
-               nextToken().value() == Token::makeRelOp(RelOp::Equal)) {
-      matchToken(Token::makeRelOp(RelOp::Equal).type());
-      auto ae2 = parseArithmeticExpr();
-      return std::make_unique<const EqualToExpr>(std::move(ae1),
-                                                 std::move(ae2));
+    } else {
+      return std::make_pair(Arith{}, std::nullopt);  // epsilon case
     }
   }
-  throw InvalidASTError();
-}
 
-std::pair<RelationalExprP, std::optional<Token>> Parser::parseRexpPrime2() {
-  // std::cout << "Parser::parseRexpPrime2" << std::endl;
-  if (nextToken() && nextToken().value() == Token::makeLBinOp(LBinOp::And)) {
-    matchToken(Token::makeLBinOp(LBinOp::And).type());
+  Arith parseArithmeticExpr() {
+    // std::cout << "Parser::parseArithmeticExpr" << std::endl;
+    auto at = parseATerm();
+    auto p = parseAExpPrime();
+    if (p.second && p.second.value() == Token::makeArithOp(ArithOp::Plus)) {
+      return nodes.add(at, p.first);
+    }
 
-    auto l = parseRexpPrime1();
-    auto r = parseRexpPrime2();
+    else if (p.second &&
+             p.second.value() == Token::makeArithOp(ArithOp::Minus)) {
+      return nodes.subtract(at, p.first);
+    }
 
-    if (r.first) {
-      return std::make_pair(std::make_unique<const LogicalAndExpr>(
-                                std::move(l), std::move(r.first)),
-                            Token::makeLBinOp(LBinOp::And));
-    } else {
-      return std::make_pair(std::move(l), Token::makeLBinOp(LBinOp::And));
+    else {
+      return at;
     }
   }
 
-  else if (nextToken() &&
-           nextToken().value() == Token::makeLBinOp(LBinOp::Or)) {
-    matchToken(Token::makeLBinOp(LBinOp::Or).type());
+  // relational expressions
 
-    auto l = parseRexpPrime1();
-    auto r = parseRexpPrime2();
+  Rel parseRexpPrime1() {
+    // std::cout << "Parser::parseRexpPrime1" << std::endl;
+    if (nextToken() && nextToken().value().type() == TokenType::LNeg) {
+      matchToken(TokenType::LNeg);
+      auto re = parseRexp();
+      return nodes.logicalNot(re);
+
+    } else if (nextToken() &&
+               nextToken().value().type() == TokenType::LBracket) {
+      matchToken(TokenType::LBracket);
+      auto re = parseRexp();
+      matchToken(TokenType::RBracket);
+      return re;
 
-    if (r.first) {
-      return std::make_pair(std::make_unique<const LogicalOrExpr>(
-                                std::move(l), std::move(r.first)),
-                            Token::makeLBinOp(LBinOp::Or));
     } else {
-      return std::make_pair(std::move(l), Token::makeLBinOp(LBinOp::Or));
+      auto ae1 = parseArithmeticExpr();
+      if (nextToken() &&
+          nextToken().value() == Token::makeRelOp(RelOp::LessThan)) {
+        matchToken(Token::makeRelOp(RelOp::LessThan).type());
+        auto ae2 = parseArithmeticExpr();
+        return nodes.lessThan(ae1, ae2);
+
+      } else if (nextToken() &&
+                 nextToken().value() == Token::makeRelOp(RelOp::LessEq)) {
+        matchToken(Token::makeRelOp(RelOp::LessEq).type());
+        auto ae2 = parseArithmeticExpr();
+        return nodes.lessThanEqualTo(ae1, ae2);
+
+      } else if (nextToken() &&
+                 nextToken().value() == Token::makeRelOp(RelOp::Equal)) {
+        matchToken(Token::makeRelOp(RelOp::Equal).type());
+        auto ae2 = parseArithmeticExpr();
+        return nodes.equalTo(ae1, ae2);
+      }
     }
-  } else {
-    return std::make_pair(nullptr, std::nullopt);
+    throw InvalidASTError();
   }
-}
 
-RelationalExprP Parser::parseRexp() {
-  // std::cout << "Parser::parseRexp" << std::endl;
-  auto l = parseRexpPrime1();
-  auto r = parseRexpPrime2();
-  if (r.second && r.second.value() == Token::makeLBinOp(LBinOp::And)) {
-    return std::make_unique<const LogicalAndExpr>(std::move(l),
-                                                  std::move(r.first));
-  } else if (r.second && r.second.value() == Token::makeLBinOp(LBinOp::Or)) {
-    return std::make_unique<const LogicalOrExpr>(std::move(l),
-                                                 std::move(r.first));
-  } else {
-    return l;
-  }
-}
+  std::pair<Rel, std::optional<Token>> parseRexpPrime2() {
+    // std::cout << "Parser::parseRexpPrime2" << std::endl;
+    if (nextToken() && nextToken().value() == Token::makeLBinOp(LBinOp::And)) {
+      matchToken(Token::makeLBinOp(LBinOp::And).type());
 
-// statements and declarations
-
-LoopExprP Parser::parseLoopExprP() {
-  // std::cout << "Parser::parseLoopExprP" << std::endl;
-  matchToken(TokenType::While);
-  matchToken(TokenType::LParen);
-  auto re = parseRexp();
-  matchToken(TokenType::RParen);
-  matchToken(TokenType::LBrace);
-  auto blk = parseBlockStmt();
-  matchToken(TokenType::RBrace);
-  return std::make_unique<const Loop>(std::move(re), std::move(blk));
-}
+      auto l = parseRexpPrime1();
+      auto r = parseRexpPrime2();
 
-ConditionalExprP Parser::parseCondExprP() {
-  // std::cout << "Parser::parseCondExprP" << std::endl;
-  matchToken(TokenType::If);
-  matchToken(TokenType::LParen);
+      if (r.first) {
+        return std::make_pair(nodes.logicalAnd(l, r.first),
+                              Token::makeLBinOp(LBinOp::And));
+      } else {
+        return std::make_pair(l, Token::makeLBinOp(LBinOp::And));
+      }
+    }
 
-  auto re = parseRexp();
+    else if (nextToken() &&
+             nextToken().value() == Token::makeLBinOp(LBinOp::Or)) {
+      matchToken(Token::makeLBinOp(LBinOp::Or).type());
 
-  matchToken(TokenType::RParen);
-  matchToken(TokenType::LBrace);
+      auto l = parseRexpPrime1();
+      auto r = parseRexpPrime2();
 
-  auto blk = parseBlockStmt();
+      if (r.first) {
+        return std::make_pair(nodes.logicalOr(l, r.first),
+                              Token::makeLBinOp(LBinOp::Or));
+      } else {
+        return std::make_pair(l, Token::makeLBinOp(LBinOp::Or));
+      }
+    } else {
+      return std::make_pair(Rel{}, std::nullopt);
+    }
+  }
+
+  Rel parseRexp() {
+    // std::cout << "Parser::parseRexp" << std::endl;
+    auto l = parseRexpPrime1();
+    auto r = parseRexpPrime2();
+    if (r.second && r.second.value() == Token::makeLBinOp(LBinOp::And)) {
+      return nodes.logicalAnd(l, r.first);
+    } else if (r.second && r.second.value() == Token::makeLBinOp(LBinOp::Or)) {
+      return nodes.logicalOr(l, r.first);
+    } else {
+      return l;
+    }
+  }
+
+  // statements and declarations
+
+  Stmt parseLoopExprP() {
+    // std::cout << "Parser::parseLoopExprP" << std::endl;
+    matchToken(TokenType::While);
+    matchToken(TokenType::LParen);
+    auto re = parseRexp();
+    matchToken(TokenType::RParen);
+    matchToken(TokenType::LBrace);
+    auto blk = parseBlockStmt();
+    matchToken(TokenType::RBrace);
+    return nodes.loop(re, blk);
+  }
+
+  Stmt parseCondExprP() {
+    // std::cout << "Parser::parseCondExprP" << std::endl;
+    matchToken(TokenType::If);
+    matchToken(TokenType::LParen);
 
-  matchToken(TokenType::RBrace);
+    auto re = parseRexp();
 
-  if (nextToken() && nextToken().value().type() == TokenType::Else) {
-    matchToken(TokenType::Else);
+    matchToken(TokenType::RParen);
     matchToken(TokenType::LBrace);
 
-    auto blk2 = parseBlockStmt();
+    auto blk = parseBlockStmt();
+
     matchToken(TokenType::RBrace);
 
-    return std::make_unique<const Conditional>(std::move(re), std::move(blk),
-                                               std::move(blk2));
+    if (nextToken() && nextToken().value().type() == TokenType::Else) {
+      matchToken(TokenType::Else);
+      matchToken(TokenType::LBrace);
 
-  } else {
-    std::vector<DeclarationExprP> d;
-    std::vector<StatementP> s;
-    return std::make_unique<const Conditional>(
-        std::move(re), std::move(blk),
-        std::make_unique<const BlockStmt>(Declaration::Block{}, std::move(s)));
-  }
-}
+      auto blk2 = parseBlockStmt();
+      matchToken(TokenType::RBrace);
 
-// break up into second call, e.g. parseRHS?
-AssignmentExprP Parser::parseAssignmentExprP() {
-  // std::cout << "Parser::parseAssignmentExprP" << std::endl;
-  auto lhs = parseAccessPath();
-  matchToken(TokenType::Assign);
-
-  // the one place we do LL(2)
-  if (nextToken(1) && nextToken(2) &&
-      nextToken(1).value().type() == TokenType::Id &&
-      nextToken(2).value().type() == TokenType::LParen) {
-    auto c = parseFunCall();
-    matchToken(TokenType::Semicolon);
-    return std::make_unique<const Assignment>(std::move(lhs), std::move(c));
+      return nodes.conditional(re, blk, blk2);
 
-  } else {
-    auto ae = parseArithmeticExpr();
-    matchToken(TokenType::Semicolon);
-    return std::make_unique<const Assignment>(std::move(lhs), std::move(ae));
+    } else {
+      return nodes.conditional(re, blk, nodes.block({}, {}));
+    }
   }
-}
 
-Declaration Parser::parseDeclaration() {
-  auto t = TypeExpr{matchToken(TokenType::Type).stringValue()};
-  auto id = parseVariable();
-  matchToken(TokenType::Semicolon);
-  return Declaration(std::move(t), std::move(id));
-}
+  // break up into second call, e.g. parseRHS?
+  Stmt parseAssignmentExprP() {
+    // std::cout << "Parser::parseAssignmentExprP" << std::endl;
+    auto lhs = parseAccessPath();
+    matchToken(TokenType::Assign);
+
+    // the one place we do LL(2)
+    if (nextToken(1) && nextToken(2) &&
+        nextToken(1).value().type() == TokenType::Id &&
+        nextToken(2).value().type() == TokenType::LParen) {
+      auto c = parseFunCall();
+      matchToken(TokenType::Semicolon);
+      return nodes.assignment(lhs, c);
 
-Declaration::Block Parser::parseDecls() {
-  Declaration::Block ret;
-  while (nextToken() && (nextToken().value().type() == TokenType::Type)) {
-    ret.push_back(parseDeclaration());
+    } else {
+      auto ae = parseArithmeticExpr();
+      matchToken(TokenType::Semicolon);
+      return nodes.assignment(lhs, ae);
+    }
   }
-  return ret;
-}
 
-StatementP Parser::parseStatementP() {
-  // std::cout << "Parser::parseStatementP" << std::endl;
-  if (nextToken() && nextToken().value().type() == TokenType::While) {
-    return parseLoopExprP();
-  } else if (nextToken() && nextToken().value().type() == TokenType::If) {
-    return parseCondExprP();
-    // playing a little fast/loose maybe todo
-  } else if (nextToken() && nextToken().value().type() == TokenType::Id) {
-    return parseAssignmentExprP();
-  }
-  throw InvalidASTError();
-}
+  Decl parseDeclaration() {
+    auto t = matchToken(TokenType::Type).symbolValue();
+    auto id = parseVariable();
+    matchToken(TokenType::Semicolon);
+    return nodes.declaration(t, id);
+  }
 
-// not sure I"m doing the assign case correctly here
-Statement::Block Parser::parseStmts() {
-  // std::cout << "Parser::parseStmts" << std::endl;
-  Statement::Block ret;
-  while (nextToken() && (nextToken().value().type() == TokenType::Id ||
-                         nextToken().value().type() == TokenType::While ||
-                         nextToken().value().type() == TokenType::If)) {
-    auto s = parseStatementP();
-    ret.push_back(std::move(s));
-  }
-  return ret;
-}
+  std::vector<Decl> parseDecls() {
+    std::vector<Decl> ret;
+    while (nextToken() && (nextToken().value().type() == TokenType::Type)) {
+      ret.push_back(parseDeclaration());
+    }
+    return ret;
+  }
 
-BlockStmtP Parser::parseBlockStmt() {
-  // std::cout << "Parser::parseBlockStmt" << std::endl;
-  Declaration::Block d = parseDecls();
-  Statement::Block s = parseStmts();
-  return std::make_unique<const BlockStmt>(std::move(d), std::move(s));
-}
+  Stmt parseStatementP() {
+    // std::cout << "Parser::parseStatementP" << std::endl;
+    if (nextToken() && nextToken().value().type() == TokenType::While) {
+      return parseLoopExprP();
+    } else if (nextToken() && nextToken().value().type() == TokenType::If) {
+      return parseCondExprP();
+      // playing a little fast/loose maybe todo
+    } else if (nextToken() && nextToken().value().type() == TokenType::Id) {
+      return parseAssignmentExprP();
+    }
+    throw InvalidASTError();
+  }
 
-// function defs, calls, args, and params
-std::vector<ArithmeticExprP> Parser::parseFunArgs() {
-  // std::cout << "Parser::parseFunArgs" << std::endl;
-  std::vector<ArithmeticExprP> ret;
+  // not sure I"m doing the assign case correctly here
+  std::vector<Stmt> parseStmts() {
+    // std::cout << "Parser::parseStmts" << std::endl;
+    std::vector<Stmt> ret;
+    while (nextToken() && (nextToken().value().type() == TokenType::Id ||
+                           nextToken().value().type() == TokenType::While ||
+                           nextToken().value().type() == TokenType::If)) {
+      auto s = parseStatementP();
+      ret.push_back(s);
+    }
+    return ret;
+  }
 
-  while (nextToken() && (nextToken().value().type() == TokenType::Num ||
-                         nextToken().value().type() == TokenType::Id ||
-                         nextToken().value().type() == TokenType::ArithOp)) {
-    auto ae = parseArithmeticExpr();
-    ret.push_back(std::move(ae));
+  Block parseBlockStmt() {
+    // std::cout << "Parser::parseBlockStmt" << std::endl;
+    auto d = parseDecls();
+    auto s = parseStmts();
+    return nodes.block(std::move(d), std::move(s));
+  }
 
-    // todo, another fast/loose possible break of LL(1)
-    if (nextToken() && nextToken().value().type() == TokenType::Comma) {
-      matchToken(TokenType::Comma);
+  // function defs, calls, args, and params
+  std::vector<Arith> parseFunArgs() {
+    // std::cout << "Parser::parseFunArgs" << std::endl;
+    std::vector<Arith> ret;
+
+    while (nextToken() && (nextToken().value().type() == TokenType::Num ||
+                           nextToken().value().type() == TokenType::Id ||
+                           nextToken().value().type() == TokenType::ArithOp)) {
+      auto ae = parseArithmeticExpr();
+      ret.push_back(ae);
+
+      // todo, another fast/loose possible break of LL(1)
+      if (nextToken() && nextToken().value().type() == TokenType::Comma) {
+        matchToken(TokenType::Comma);
+      }
     }
+    return ret;
   }
-  return ret;
-}
-
-FunctionCallP Parser::parseFunCall() {
-  // std::cout << "Parser::parseFunCall" << std::endl;
-  auto id = matchToken(TokenType::Id).stringValue();
-  matchToken(TokenType::LParen);
-  auto args = parseFunArgs();
-  matchToken(TokenType::RParen);
-  return std::make_unique<const FunctionCall>(id, std::move(args));
-}
 
-std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                      Variable>>
-Parser::parseParams() {
-  // std::cout << "Parser::parseParams" << std::endl;
-  std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                        Variable>>
-      ret;
-  while (nextToken() && nextToken().value().type() == TokenType::Type) {
-    auto t = std::make_unique<TypeExpr>(matchToken(TokenType::Type).stringValue());
-    auto id = parseVariable();
-    auto pair =
-        std::make_pair(std::move(t), std::move(id));
-    ret.push_back(std::move(pair));
+  Call parseFunCall() {
+    // std::cout << "Parser::parseFunCall" << std::endl;
+    auto id = matchToken(TokenType::Id).symbolValue();
+    matchToken(TokenType::LParen);
+    auto args = parseFunArgs();
+    matchToken(TokenType::RParen);
+    return nodes.call(id, std::move(args));
+  }
 
-    // todo, another fast/loose possible break of LL(1)
-    if (nextToken() && nextToken().value().type() == TokenType::Comma) {
-      matchToken(TokenType::Comma);
+  std::vector<Param> parseParams() {
+    // std::cout << "Parser::parseParams" << std::endl;
+    std::vector<Param> ret;
+    while (nextToken() && nextToken().value().type() == TokenType::Type) {
+      auto t = matchToken(TokenType::Type).symbolValue();
+      auto id = parseVariable();
+      ret.push_back(nodes.parameter(t, id));
+
+      // todo, another fast/loose possible break of LL(1)
+      if (nextToken() && nextToken().value().type() == TokenType::Comma) {
+        matchToken(TokenType::Comma);
+      }
     }
+    return ret;
   }
-  return ret;
-}
 
-std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                      Variable>>
-Parser::parseOptParams() {
-  // std::cout << "Parser::parseOptParams" << std::endl;
-  if (nextToken() && nextToken().value().type() == TokenType::Type) {
-    return parseParams();
-  } else {
-    std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                          std::unique_ptr<const Variable>>>
-        ret;
-    // return empty vector
-    return {};
+  std::vector<Param> parseOptParams() {
+    // std::cout << "Parser::parseOptParams" << std::endl;
+    if (nextToken() && nextToken().value().type() == TokenType::Type) {
+      return parseParams();
+    } else {
+      // return empty list
+      return {};
+    }
   }
-}
 
-FunctionDefP Parser::parseFunDef() {
-  // std::cout << "Parser::parseFunDef" << std::endl;
-  matchToken(TokenType::Def);
-  auto id = matchToken(TokenType::Id).stringValue();
+  FunDef parseFunDef() {
+    // std::cout << "Parser::parseFunDef" << std::endl;
+    matchToken(TokenType::Def);
+    auto id = matchToken(TokenType::Id).symbolValue();
 
-  matchToken(TokenType::LParen);
-  auto optparams = parseOptParams();
-  matchToken(TokenType::RParen);
-  matchToken(TokenType::HasType);
+    matchToken(TokenType::LParen);
+    auto optparams = parseOptParams();
+    matchToken(TokenType::RParen);
+    matchToken(TokenType::HasType);
 
-  auto retType = std::make_unique<const TypeExpr>(matchToken(TokenType::Type).stringValue());
-  matchToken(TokenType::LBrace);
+    auto retType = nodes.type(matchToken(TokenType::Type).symbolValue());
+    matchToken(TokenType::LBrace);
 
-  auto b = parseBlockStmt();
-  matchToken(TokenType::Return);
+    auto b = parseBlockStmt();
+    matchToken(TokenType::Return);
 
-  auto ae = parseArithmeticExpr();
-  matchToken(TokenType::Semicolon);
-  matchToken(TokenType::RBrace);
-  return std::make_unique<const FunctionDef>(
-      id, std::move(retType), std::move(optparams),
-      std::move(b), std::move(ae));
-}
+    auto ae = parseArithmeticExpr();
+    matchToken(TokenType::Semicolon);
+    matchToken(TokenType::RBrace);
+    return nodes.functionDef(id, std::move(optparams), retType, b, ae);
+  }
 
-FunctionDef::Block Parser::parseFunDefs() {
-  // std::cout << "Parser::parseFunDefs" << std::endl;
-  FunctionDef::Block ret;
-  while (nextToken() && (nextToken().value().type() == TokenType::Def)) {
-    auto f = parseFunDef();
-    ret.push_back(std::move(f));
+  std::vector<FunDef> parseFunDefs() {
+    // std::cout << "Parser::parseFunDefs" << std::endl;
+    std::vector<FunDef> ret;
+    while (nextToken() && (nextToken().value().type() == TokenType::Def)) {
+      auto f = parseFunDef();
+      ret.push_back(f);
+    }
+    return ret;
   }
-  return ret;
-}
 
-TypeDef Parser::parseTypeDef() {
-  matchToken(TokenType::Struct);
-  auto type = matchToken(TokenType::Type);
-  if (type.stringValue() == "int") {
-    // can't define int as a struct
-    throw InvalidASTError();
+  TypeDefinition parseTypeDef() {
+    matchToken(TokenType::Struct);
+    auto type = matchToken(TokenType::Type);
+    if (type.symbolValue() == TypeExpr::IntName) {
+      // can't define int as a struct
+      throw InvalidASTError();
+    }
+    matchToken(TokenType::LBrace);
+    auto decls = parseDecls();
+    matchToken(TokenType::RBrace);
+    matchToken(TokenType::Semicolon);
+
+    return nodes.typeDef(type.symbolValue(), std::move(decls));
   }
-  matchToken(TokenType::LBrace);
-  auto decls = parseDecls();
-  matchToken(TokenType::RBrace);
-  matchToken(TokenType::Semicolon);
 
-  return {type.stringValue(), std::move(decls)};
-}
+  std::vector<TypeDefinition> parseTypeDefs() {
+    std::vector<TypeDefinition> ret;
+    while (nextToken() && (nextToken().value().type() == TokenType::Struct)) {
+      ret.push_back(parseTypeDef());
+    }
+    return ret;
+  }
+
+  // toplevel
+  typename Nodes::Result parseProgram() {
+    // std::cout << "Parser::parseProgram" << std::endl;
+
+    auto typeDefs = parseTypeDefs();
+    auto f = parseFunDefs();
+    auto s = parseBlockStmt();
+
+    matchToken(TokenType::Output);
+    auto ae = parseArithmeticExpr();
+    matchToken(TokenType::Semicolon);
 
-TypeDef::Block Parser::parseTypeDefs() {
-  TypeDef::Block ret;
-  while (nextToken() && (nextToken().value().type() == TokenType::Struct)) {
-    ret.push_back(parseTypeDef());
+    return nodes.program(std::move(typeDefs), std::move(f), s, ae);
   }
-  return ret;
-}
 
-// toplevel
-ProgramExprP Parser::parse() {
-  // std::cout << "Parser::parseProgram" << std::endl;
+ private:
+  std::optional<Token> nextToken(int peek = 1) {
+    return parser.nextToken(peek);
+  }
+  Token matchToken(const TokenType& tok) { return parser.matchToken(tok); }
 
-  TypeDef::Block typeDefs = parseTypeDefs();
-  FunctionDef::Block f = parseFunDefs();
-  BlockStmtP s = parseBlockStmt();
+  Parser& parser;
+  Nodes& nodes;
+};
 
-  matchToken(TokenType::Output);
-  auto ae = parseArithmeticExpr();
-  matchToken(TokenType::Semicolon);
+ProgramExprP Parser::parse() {
+  TreeNodes nodes{*arena};
+  auto program = Grammar<TreeNodes>{*this, nodes}.parseProgram();
+  return ProgramExprP(std::move(arena), program);
+}
 
-  return std::make_unique<const Program>(std::move(typeDefs),
-                                         std::move(f),
-                                         std::move(s),
-                                         std::move(ae));
+FlatAst Parser::parseFlat() {
+  FlatAst ast;
+  FlatNodes nodes{ast};
+  Grammar<FlatNodes>{*this, nodes}.parseProgram();
+  return ast;
 }
 }  // namespace cs160::frontend
@@ -1,9 +1,12 @@
 #pragma once
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <vector>
 #include "frontend/ast.h"
+#include "frontend/flat_ast.h"
 #include "frontend/token.h"
+#include "frontend/token_stream.h"
 
 namespace cs160::frontend {
 
@@ -21,58 +24,35 @@ class Parser final {
   // The entry point of the parser you need to implement. It takes the output of
   // the lexer as the argument and produces an abstract syntax tree as the
   // result of parsing the tokens.
-  Parser(const std::vector<Token> &lexer_tokens) : tokens(lexer_tokens) {}
+  Parser(const std::vector<Token> &lexer_tokens)
+      : ownedTokens(std::make_unique<VectorTokenStream>(lexer_tokens)),
+        tokens(*ownedTokens) {}
+
+  // Parse tokens pulled from given stream. The parser looks at most two tokens
+  // ahead, so the stream may produce tokens on demand.
+  explicit Parser(TokenStream &tokenStream) : tokens(tokenStream) {}
 
   std::optional<Token> nextToken(int peek = 1);
   Token matchToken(const TokenType &);
 
-  std::unique_ptr<const AccessPath> parseAccessPath();
-  Variable parseVariable();
-  IntegerExprP parseIntegerExpr();
-
-  ArithmeticExprP parseArithmeticExpr();
-  std::pair<ArithmeticExprP, std::optional<Token>> parseAExpPrime();
-  ArithmeticExprP parseATerm();
-  ArithmeticExprP parseATermPrime();
-  ArithmeticExprP parseAFactor();
-
-  RelationalExprP parseRexp();
-  RelationalExprP parseRexpPrime1();
-  std::pair<RelationalExprP, std::optional<Token>> parseRexpPrime2();
-
-  Declaration parseDeclaration();
-  Declaration::Block parseDecls();
-
-  // TypeExprP parseTypeExpe();
-
-  StatementP parseStatementP();
-  LoopExprP parseLoopExprP();
-  ConditionalExprP parseCondExprP();
-  AssignmentExprP parseAssignmentExprP();
-  Statement::Block parseStmts();
-  BlockStmtP parseBlockStmt();
-
-  std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                        Variable>>
-  parseParams();
-  std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                        Variable>>
-  parseOptParams();
-  // std::vector<DeclarationExprP> parseOptParams();
-
-  std::vector<ArithmeticExprP> parseFunArgs();
-  FunctionDefP parseFunDef();
-  FunctionDef::Block parseFunDefs();
-
-  TypeDef parseTypeDef();
-  TypeDef::Block parseTypeDefs();
-
-  FunctionCallP parseFunCall();
-
+  // Parse a whole program. The returned tree owns the arena holding all of its
+  // nodes, so a parser produces at most one program.
   ProgramExprP parse();
 
+  // Parse a whole program into the flat encoding (see frontend/flat_ast.h).
+  // The nodes are appended as they are recognized, no tree is built.
+  FlatAst parseFlat();
+
  private:
-  const std::vector<Token> tokens;
-  int head = -1;  // we start at one before the token list
+  // Token stream created by the parser when it is given a vector of tokens
+  std::unique_ptr<TokenStream> ownedTokens;
+  TokenStream &tokens;
+  // Storage for the nodes of the tree being built
+  std::unique_ptr<AstArena> arena = std::make_unique<AstArena>();
+
+  // The recursive descent over the tokens. It hands what it recognizes to
+  // `Nodes`, which builds either tree nodes or flat nodes, see parser.cpp.
+  template <class Nodes>
+  class Grammar;
 };
 };  // namespace cs160::frontend
@@ -2,6 +2,7 @@
 
 #include "frontend/parser.h"
 #include "catch2/catch.hpp"
+#include "frontend/ast_walker.h"
 #include "frontend/lexer.h"
 #include "frontend/token.h"
 
@@ -10,19 +11,19 @@ using Catch::Matchers::Equals;
 using Catch::Matchers::Message;
 
 TEST_CASE("Basic coverage tests", "[parser]") {
+  AstArena arena;
+
   // integer expression: 4
   auto parsed =
       Parser{std::vector<Token>{Token::makeOutput(), Token::makeNum(4),
                                 Token::makeSemicolon()}}
   .parse();
 
-  Declaration::Block di;
-  std::vector<std::unique_ptr<const Statement>> si;
   auto expected =
       Program(TypeDef::Block(),
               FunctionDef::Block(),
-              std::make_unique<const BlockStmt>(std::move(di), std::move(si)),
-              std::make_unique<const IntegerExpr>(4));
+              arena.make<BlockStmt>(Declaration::Block{}, Statement::Block{}),
+              arena.make<IntegerExpr>(4));
   REQUIRE(parsed->toString() == expected.toString());
 
   //  addition expression: 1+2
@@ -32,13 +33,12 @@ TEST_CASE("Basic coverage tests", "[parser]") {
                                 Token::makeNum(2), Token::makeSemicolon()}}
           .parse();
 
-  std::vector<std::unique_ptr<const Statement>> sp;
   auto expected_plus = Program(
       TypeDef::Block(),
       FunctionDef::Block(),
-      std::make_unique<const BlockStmt>(Declaration::Block{}, std::move(sp)),
-      std::make_unique<const AddExpr>(std::make_unique<const IntegerExpr>(1),
-                                      std::make_unique<const IntegerExpr>(2)));
+      arena.make<BlockStmt>(Declaration::Block{}, Statement::Block{}),
+      arena.make<AddExpr>(arena.make<IntegerExpr>(1),
+                          arena.make<IntegerExpr>(2)));
   REQUIRE(parsed_plus->toString() == expected_plus.toString());
 
   //
@@ -50,15 +50,13 @@ TEST_CASE("Basic coverage tests", "[parser]") {
                                 Token::makeSemicolon()}}
           .parse();
 
-  Declaration::Block da;
-  std::vector<std::unique_ptr<const Statement>> sa;
-  sa.push_back(std::make_unique<const Assignment>(
-      std::make_unique<const AccessPath>(Variable{"x"}),
-      std::make_unique<const IntegerExpr>(4)));
+  auto sa = arena.makeList<StatementP>({arena.make<Assignment>(
+      arena.make<AccessPath>(Variable{"x"}),
+      arena.make<IntegerExpr>(4))});
   auto expected_assign =
       Program(TypeDef::Block(), FunctionDef::Block(),
-              std::make_unique<const BlockStmt>(Declaration::Block{}, std::move(sa)),
-              std::make_unique<const AccessPath>(Variable{"x"}));
+              arena.make<BlockStmt>(Declaration::Block{}, sa),
+              arena.make<AccessPath>(Variable{"x"}));
   REQUIRE(parsed_assign->toString() == expected_assign.toString());
 
   //
@@ -73,24 +71,16 @@ TEST_CASE("Basic coverage tests", "[parser]") {
                  Token::makeSemicolon()}}
           .parse();
 
-  Declaration::Block dc;
-  std::vector<std::unique_ptr<const Statement>> sc;
-  Declaration::Block true_branch_decls;
-  std::vector<std::unique_ptr<const Statement>> true_branch_stmts;
-  Declaration::Block false_branch_decls;
-  std::vector<std::unique_ptr<const Statement>> false_branch_stmts;
-  sc.push_back(std::make_unique<const Conditional>(
-      std::make_unique<const LessThanExpr>(
-          std::make_unique<const IntegerExpr>(1),
-          std::make_unique<const IntegerExpr>(2)),
-      std::make_unique<const BlockStmt>(std::move(true_branch_decls),
-                                        std::move(true_branch_stmts)),
-      std::make_unique<const BlockStmt>(std::move(false_branch_decls),
-                                        std::move(false_branch_stmts))));
+  auto sc = arena.makeList<StatementP>({arena.make<Conditional>(
+      arena.make<LessThanExpr>(
+          arena.make<IntegerExpr>(1),
+          arena.make<IntegerExpr>(2)),
+      arena.make<BlockStmt>(Declaration::Block{}, Statement::Block{}),
+      arena.make<BlockStmt>(Declaration::Block{}, Statement::Block{}))});
   auto expected_cond =
       Program(TypeDef::Block(), FunctionDef::Block(),
-              std::make_unique<const BlockStmt>(std::move(dc), std::move(sc)),
-              std::make_unique<const IntegerExpr>(4));
+              arena.make<BlockStmt>(Declaration::Block{}, sc),
+              arena.make<IntegerExpr>(4));
   REQUIRE(parsed_cond->toString() == expected_cond.toString());
 
   //
@@ -105,20 +95,15 @@ TEST_CASE("Basic coverage tests", "[parser]") {
                  Token::makeSemicolon()}}
           .parse();
 
-  Declaration::Block dl;
-  std::vector<std::unique_ptr<const Statement>> sl;
-  Declaration::Block loop_body_decls;
-  std::vector<std::unique_ptr<const Statement>> loop_body_stmts;
-  sl.push_back(std::make_unique<const Loop>(
-      std::make_unique<const LessThanExpr>(
-          std::make_unique<const IntegerExpr>(1),
-          std::make_unique<const IntegerExpr>(2)),
-      std::make_unique<const BlockStmt>(std::move(loop_body_decls),
-                                        std::move(loop_body_stmts))));
+  auto sl = arena.makeList<StatementP>({arena.make<Loop>(
+      arena.make<LessThanExpr>(
+          arena.make<IntegerExpr>(1),
+          arena.make<IntegerExpr>(2)),
+      arena.make<BlockStmt>(Declaration::Block{}, Statement::Block{}))});
   auto expected_loop =
       Program(TypeDef::Block(), FunctionDef::Block(),
-              std::make_unique<const BlockStmt>(std::move(dl), std::move(sl)),
-              std::make_unique<const IntegerExpr>(4));
+              arena.make<BlockStmt>(Declaration::Block{}, sl),
+              arena.make<IntegerExpr>(4));
   REQUIRE(parsed_loop->toString() == expected_loop.toString());
 
   //
@@ -129,13 +114,11 @@ TEST_CASE("Basic coverage tests", "[parser]") {
                                 Token::makeNum(4), Token::makeSemicolon()}}
           .parse();
 
-  Declaration::Block dd;
-  std::vector<std::unique_ptr<const Statement>> sd;
-  dd.push_back(Declaration{TypeExpr{"int"}, Variable{"x"}});
+  auto dd = arena.makeList({Declaration{TypeExpr{"int"}, Variable{"x"}}});
   auto expected_declaration =
       Program(TypeDef::Block(), FunctionDef::Block(),
-              std::make_unique<const BlockStmt>(std::move(dd), std::move(sd)),
-              std::make_unique<const IntegerExpr>(4));
+              arena.make<BlockStmt>(dd, Statement::Block{}),
+              arena.make<IntegerExpr>(4));
   REQUIRE(parsed_declaration->toString() == expected_declaration.toString());
 
   //
@@ -150,29 +133,24 @@ TEST_CASE("Basic coverage tests", "[parser]") {
                                 Token::makeNum(4), Token::makeSemicolon()}}
           .parse();
 
-  Declaration::Block empty_defs;
-  std::vector<std::unique_ptr<const Statement>> empty_stmts;
-  FunctionDef::Block fdef_body;
-  std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                        Variable>>
-      parameters;
-  fdef_body.push_back(std::make_unique<const FunctionDef>(
+  auto fdef_body = arena.makeList<FunctionDefP>({arena.make<FunctionDef>(
       "f",                                // function name
-      std::make_unique<const TypeExpr>("int"),  // return type
-      std::move(parameters),              // no parameters
-      std::make_unique<const BlockStmt>(
-          std::move(empty_defs), std::move(empty_stmts)),  // no function body
-      std::make_unique<const IntegerExpr>(4)));            // return value
+      arena.make<TypeExpr>("int"),        // return type
+      FunctionDef::Parameters{},          // no parameters
+      arena.make<BlockStmt>(
+          Declaration::Block{}, Statement::Block{}),  // no function body
+      arena.make<IntegerExpr>(4))});                  // return value
 
   auto expected_fdef =
-      Program(TypeDef::Block(), std::move(fdef_body),
-              std::make_unique<const BlockStmt>(std::move(empty_defs),
-                                                std::move(empty_stmts)),
-              std::make_unique<const IntegerExpr>(4));
+      Program(TypeDef::Block(), fdef_body,
+              arena.make<BlockStmt>(Declaration::Block{}, Statement::Block{}),
+              arena.make<IntegerExpr>(4));
   REQUIRE(parsed_fdef->toString() == expected_fdef.toString());
 }
 
 TEST_CASE("Type definition test", "[parser]") {
+  AstArena arena;
+
   //
   // type and function def: struct %list { int value; %list next; } def f() :int { return 4; } output 4;
   auto parsed_fdef =
@@ -192,36 +170,230 @@ TEST_CASE("Type definition test", "[parser]") {
       Token::makeNum(4), Token::makeSemicolon()}}
   .parse();
 
-  Declaration::Block empty_defs;
-  std::vector<std::unique_ptr<const Statement>> empty_stmts;
-  FunctionDef::Block fdef_body;
-  std::vector<std::pair<std::unique_ptr<const TypeExpr>,
-                        Variable>>
-      parameters;
-  fdef_body.push_back(std::make_unique<const FunctionDef>(
+  auto fdef_body = arena.makeList<FunctionDefP>({arena.make<FunctionDef>(
       "f",                                // function name
-      std::make_unique<const TypeExpr>("int"),  // return type
-      std::move(parameters),              // no parameters
-      std::make_unique<const BlockStmt>(
-          std::move(empty_defs), std::move(empty_stmts)),  // no function body
-      std::make_unique<const IntegerExpr>(4)));            // return value
+      arena.make<TypeExpr>("int"),        // return type
+      FunctionDef::Parameters{},          // no parameters
+      arena.make<BlockStmt>(
+          Declaration::Block{}, Statement::Block{}),  // no function body
+      arena.make<IntegerExpr>(4))});                  // return value
 
-  auto typeDef = TypeDef{"%list", {
+  auto typeDef = TypeDef{"%list", arena.makeList({
       Declaration{TypeExpr{"int"}, Variable{"value"}},
       Declaration{TypeExpr{"%list"}, Variable{"next"}},
-    }};
+    })};
 
   auto expected_fdef =
-      Program(TypeDef::Block{std::move(typeDef)}, std::move(fdef_body),
-              std::make_unique<const BlockStmt>(std::move(empty_defs),
-                                                std::move(empty_stmts)),
-              std::make_unique<const IntegerExpr>(4));
+      Program(arena.makeList({typeDef}), fdef_body,
+              arena.make<BlockStmt>(Declaration::Block{}, Statement::Block{}),
+              arena.make<IntegerExpr>(4));
   REQUIRE(parsed_fdef->toString() == expected_fdef.toString());
 }
 
+TEST_CASE("Parsed trees live in an arena", "[parser]") {
+  // x := 1 + 2 * 3; output x;
+  auto parsed =
+      Parser{std::vector<Token>{Token::makeId("x"), Token::makeAssign(),
+                                Token::makeNum(1),
+                                Token::makeArithOp(ArithOp::Plus),
+                                Token::makeNum(2),
+                                Token::makeArithOp(ArithOp::Times),
+                                Token::makeNum(3), Token::makeSemicolon(),
+                                Token::makeOutput(), Token::makeId("x"),
+                                Token::makeSemicolon()}}
+          .parse();
+
+  REQUIRE(parsed);
+  REQUIRE(parsed->statements().stmts().size() == 1);
+  REQUIRE(parsed.arena().bytesUsed() > 0);
+
+  // nodes moved out with the tree outlive the parser
+  auto moved = std::move(parsed);
+  REQUIRE(moved->toString() == " x := (+ 1 (* 2 3));  output x;");
+}
+
 TEST_CASE("Simple invalid parser tests", "[Parser{}]") {
   auto tok = std::vector<Token>{
       Token::makeId("x"), Token::makeArithOp(ArithOp::Plus),
       Token::makeArithOp(ArithOp::Times), Token::makeId("y")};
   REQUIRE_THROWS_AS(Parser{tok}.parse(), InvalidASTError);
 }
+
+namespace {
+// Counts the arithmetic operators in a tree using the switch-based walker
+struct OperatorCounter : AstWalker<OperatorCounter> {
+  int count = 0;
+
+  void VisitIntegerExpr(const IntegerExpr&) {}
+  void VisitAccessPath(const AccessPath&) {}
+  void VisitAddExpr(const AddExpr& exp) { binary(exp); }
+  void VisitSubtractExpr(const SubtractExpr& exp) { binary(exp); }
+  void VisitMultiplyExpr(const MultiplyExpr& exp) { binary(exp); }
+  void VisitBlockStmt(const BlockStmt& exp) {
+    for (auto stmt : exp.stmts()) Walk(*stmt);
+  }
+  void VisitAssignmentExpr(const Assignment& exp) { Walk(exp.rhs()); }
+  void VisitProgramExpr(const Program& exp) {
+    Walk(exp.statements());
+    Walk(exp.arithmetic_exp());
+  }
+
+  void binary(const ArithmeticBinaryOperatorExpr& exp) {
+    ++count;
+    Walk(exp.lhs());
+    Walk(exp.rhs());
+  }
+
+  // not reachable from the programs below
+  void VisitNil(const NilExpr&) {}
+  void VisitNewExpr(const NewExpr&) {}
+  void VisitVariable(const Variable&) {}
+  void VisitLessThanExpr(const LessThanExpr&) {}
+  void VisitLessThanEqualToExpr(const LessThanEqualToExpr&) {}
+  void VisitEqualToExpr(const EqualToExpr&) {}
+  void VisitLogicalAndExpr(const LogicalAndExpr&) {}
+  void VisitLogicalOrExpr(const LogicalOrExpr&) {}
+  void VisitLogicalNotExpr(const LogicalNotExpr&) {}
+  void VisitTypeExpr(const TypeExpr&) {}
+  void VisitDeclarationExpr(const Declaration&) {}
+  void VisitConditionalExpr(const Conditional&) {}
+  void VisitLoopExpr(const Loop&) {}
+  void VisitFunctionCallExpr(const FunctionCall&) {}
+  void VisitFunctionDefExpr(const FunctionDef&) {}
+  void VisitTypeDef(const TypeDef&) {}
+};
+}  // namespace
+
+TEST_CASE("Node kinds and the switch-based walker", "[parser]") {
+  // x := 1 + 2 * 3 - 4; output x * x;
+  auto parsed =
+      Parser{std::vector<Token>{Token::makeId("x"), Token::makeAssign(),
+                                Token::makeNum(1),
+                                Token::makeArithOp(ArithOp::Plus),
+                                Token::makeNum(2),
+                                Token::makeArithOp(ArithOp::Times),
+                                Token::makeNum(3),
+                                Token::makeArithOp(ArithOp::Minus),
+                                Token::makeNum(4), Token::makeSemicolon(),
+                                Token::makeOutput(), Token::makeId("x"),
+                                Token::makeArithOp(ArithOp::Times),
+                                Token::makeId("x"), Token::makeSemicolon()}}
+          .parse();
+
+  REQUIRE(parsed->kind() == NodeKind::Program);
+  REQUIRE(parsed->statements().kind() == NodeKind::Block);
+  auto& assign = *parsed->statements().stmts()[0];
+  REQUIRE(assign.kind() == NodeKind::Assignment);
+  REQUIRE(static_cast<const Assignment&>(assign).lhs().kind() ==
+          NodeKind::AccessPath);
+  REQUIRE(parsed->arithmetic_exp().kind() == NodeKind::Multiply);
+
+  OperatorCounter counter;
+  counter.Walk(*parsed);
+  REQUIRE(counter.count == 4);
+}
+
+TEST_CASE("Flat AST encoding", "[parser]") {
+  // struct %pt { int x; %pt next; };
+  // def f(int a, %pt p) : int { int y; y := a * 2; return y + p.x; }
+  // %pt q; q := new %pt; q.x := f(3, q);
+  // if (q.x < 10 && !(q.x = 4)) { q.x := 1; } while (q.x <= 2) { q.next := nil; }
+  // output q.x - 1;
+  auto tokens = std::vector<Token>{
+      Token::makeStruct(), Token::makeType("%pt"), Token::makeLBrace(),
+      Token::makeType("int"), Token::makeId("x"), Token::makeSemicolon(),
+      Token::makeType("%pt"), Token::makeId("next"), Token::makeSemicolon(),
+      Token::makeRBrace(), Token::makeSemicolon(),
+      Token::makeDef(), Token::makeId("f"), Token::makeLParen(),
+      Token::makeType("int"), Token::makeId("a"), Token::makeComma(),
+      Token::makeType("%pt"), Token::makeId("p"), Token::makeRParen(),
+      Token::makeHasType(), Token::makeType("int"), Token::makeLBrace(),
+      Token::makeType("int"), Token::makeId("y"), Token::makeSemicolon(),
+      Token::makeId("y"), Token::makeAssign(), Token::makeId("a"),
+      Token::makeArithOp(ArithOp::Times), Token::makeNum(2),
+      Token::makeSemicolon(), Token::makeReturn(), Token::makeId("y"),
+      Token::makeArithOp(ArithOp::Plus), Token::makeId("p"), Token::makeDot(),
+      Token::makeId("x"), Token::makeSemicolon(), Token::makeRBrace(),
+      Token::makeType("%pt"), Token::makeId("q"), Token::makeSemicolon(),
+      Token::makeId("q"), Token::makeAssign(), Token::makeNew(),
+      Token::makeType("%pt"), Token::makeSemicolon(),
+      Token::makeId("q"), Token::makeDot(), Token::makeId("x"),
+      Token::makeAssign(), Token::makeId("f"), Token::makeLParen(),
+      Token::makeNum(3), Token::makeComma(), Token::makeId("q"),
+      Token::makeRParen(), Token::makeSemicolon(),
+      Token::makeIf(), Token::makeLParen(), Token::makeId("q"),
+      Token::makeDot(), Token::makeId("x"), Token::makeRelOp(RelOp::LessThan),
+      Token::makeNum(10), Token::makeLBinOp(LBinOp::And), Token::makeLNeg(),
+      Token::makeLBracket(), Token::makeId("q"), Token::makeDot(),
+      Token::makeId("x"), Token::makeRelOp(RelOp::Equal), Token::makeNum(4),
+      Token::makeRBracket(), Token::makeRParen(), Token::makeLBrace(),
+      Token::makeId("q"), Token::makeDot(), Token::makeId("x"),
+      Token::makeAssign(), Token::makeNum(1), Token::makeSemicolon(),
+      Token::makeRBrace(),
+      Token::makeWhile(), Token::makeLParen(), Token::makeId("q"),
+      Token::makeDot(), Token::makeId("x"), Token::makeRelOp(RelOp::LessEq),
+      Token::makeNum(2), Token::makeRParen(), Token::makeLBrace(),
+      Token::makeId("q"), Token::makeDot(), Token::makeId("next"),
+      Token::makeAssign(), Token::makeNil(), Token::makeSemicolon(),
+      Token::makeRBrace(),
+      Token::makeOutput(), Token::makeId("q"), Token::makeDot(),
+      Token::makeId("x"), Token::makeArithOp(ArithOp::Minus),
+      Token::makeNum(1), Token::makeSemicolon()};
+
+  auto flat = Parser{tokens}.parseFlat();
+  auto tree = Parser{tokens}.parse();
+
+  REQUIRE(flat.kind(flat.root()) == NodeKind::Program);
+  // children come before their parents
+  for (FlatAst::NodeId id = 0; id < flat.size(); ++id) {
+    if (flat.kind(id) != NodeKind::AccessPath) {
+      for (auto operand : flat.operands(id)) {
+        REQUIRE(operand < id);
+      }
+    }
+  }
+
+  // the parser builds the same encoding as the converter, without a tree
+  REQUIRE(FlatAst::fromTree(*tree) == flat);
+  // and the encoding converts back to the tree the parser builds
+  REQUIRE(flat.toTree()->toString() == tree->toString());
+
+  auto bytes = flat.serialize();
+  auto copy = FlatAst::deserialize(bytes.data(), bytes.size());
+  REQUIRE(copy == flat);
+  REQUIRE(copy.toTree()->toString() == tree->toString());
+
+  REQUIRE_THROWS_AS(FlatAst::deserialize(bytes.data(), bytes.size() - 1),
+                    InvalidFlatAstError);
+
+  FlatAst notAProgram;
+  notAProgram.add(NodeKind::Integer, 4);
+  REQUIRE_THROWS_AS(notAProgram.toTree(), InvalidFlatAstError);
+
+  // operands must refer to earlier nodes
+  FlatAst forward;
+  forward.add(NodeKind::Add, 0, {1, 2});
+  forward.add(NodeKind::Integer, 1);
+  forward.add(NodeKind::Integer, 2);
+  forward.add(NodeKind::Block, 0);
+  forward.add(NodeKind::Program, 0, {3, 0});
+  REQUIRE_THROWS_AS(forward.toTree(), InvalidFlatAstError);
+
+  // a buffer whose nodes have more operands than their kind takes
+  for (auto kind : {NodeKind::Add, NodeKind::LessThan, NodeKind::LogicalNot}) {
+    FlatAst extra;
+    auto one = extra.add(NodeKind::Integer, 1);
+    auto two = extra.add(NodeKind::Integer, 2);
+    auto less = extra.add(NodeKind::LessThan, 0, {one, two});
+    if (kind == NodeKind::LogicalNot) {
+      extra.add(kind, 0, {less, less});
+    } else {
+      extra.add(kind, 0, {one, two, one});
+    }
+    auto block = extra.add(NodeKind::Block, 0);
+    extra.add(NodeKind::Program, 0, {block, one});
+    auto bytes = extra.serialize();
+    auto malformed = FlatAst::deserialize(bytes.data(), bytes.size());
+    REQUIRE_THROWS_AS(malformed.toTree(), InvalidFlatAstError);
+  }
+}
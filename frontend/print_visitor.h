@@ -4,10 +4,11 @@
 #include <string>
 
 #include "frontend/ast_visitor.h"
+#include "frontend/ast_walker.h"
 
 namespace cs160::frontend {
 
-class PrintVisitor : public AstVisitor {
+class PrintVisitor final : public AstVisitor, public AstWalker<PrintVisitor> {
  public:
   PrintVisitor() {}
   ~PrintVisitor() {}
@@ -28,25 +29,25 @@ class PrintVisitor : public AstVisitor {
 
   void VisitAddExpr(const AddExpr& exp) override {
     output_ << "(+ ";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << ")";
   }
 
   void VisitSubtractExpr(const SubtractExpr& exp) override {
     output_ << "(- ";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << ")";
   }
 
   void VisitMultiplyExpr(const MultiplyExpr& exp) override {
     output_ << "(* ";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << ")";
   }
 
@@ -55,7 +56,7 @@ class PrintVisitor : public AstVisitor {
   }
 
   void VisitAccessPath(const AccessPath& path) override {
-    path.root().Visit(this);
+    Walk(path.root());
     for (auto const & f : path.fieldAccesses()) {
       output_ << "." << f;
     }
@@ -63,47 +64,47 @@ class PrintVisitor : public AstVisitor {
 
   void VisitLessThanExpr(const LessThanExpr& exp) override {
     output_ << "[< ";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << "]";
   }
 
   void VisitLessThanEqualToExpr(const LessThanEqualToExpr& exp) override {
     output_ << "[<= ";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << "]";
   }
 
   void VisitEqualToExpr(const EqualToExpr& exp) override {
     output_ << "[= ";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << "]";
   }
 
   void VisitLogicalAndExpr(const LogicalAndExpr& exp) override {
     output_ << "[&& ";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << "]";
   }
 
   void VisitLogicalOrExpr(const LogicalOrExpr& exp) override {
     output_ << "[|| ";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << "]";
   }
 
   void VisitLogicalNotExpr(const LogicalNotExpr& exp) override {
     output_ << "[!";
-    exp.operand().Visit(this);
+    Walk(exp.operand());
     output_ << "]";
   }
 
@@ -111,52 +112,52 @@ class PrintVisitor : public AstVisitor {
 
   void VisitBlockStmt(const BlockStmt& exp) override {
     for (auto it = exp.decls().begin(); it != exp.decls().end(); ++it) {
-      it->Visit(this);
+      Walk(*it);
     }
     output_ << " ";
     for (auto it = exp.stmts().begin(); it != exp.stmts().end(); ++it) {
-      (*it)->Visit(this);
+      Walk(**it);
     }
   }
 
   void VisitDeclarationExpr(const Declaration& exp) override {
     output_ << "";
-    exp.type().Visit(this);
+    Walk(exp.type());
     output_ << " ";
-    exp.id().Visit(this);
+    Walk(exp.id());
     output_ << "; ";
   }
 
   void VisitAssignmentExpr(const Assignment& exp) override {
     output_ << "";
-    exp.lhs().Visit(this);
+    Walk(exp.lhs());
     output_ << " := ";
-    exp.rhs().Visit(this);
+    Walk(exp.rhs());
     output_ << "; ";
   }
 
   void VisitConditionalExpr(const Conditional& exp) override {
     output_ << "if ";
-    exp.guard().Visit(this);
+    Walk(exp.guard());
     output_ << " {";
-    exp.true_branch().Visit(this);
+    Walk(exp.true_branch());
     output_ << "} else {";
-    exp.false_branch().Visit(this);
+    Walk(exp.false_branch());
     output_ << "}";
   }
 
   void VisitLoopExpr(const Loop& exp) override {
     output_ << "while (";
-    exp.guard().Visit(this);
+    Walk(exp.guard());
     output_ << ") {";
-    exp.body().Visit(this);
+    Walk(exp.body());
     output_ << "}";
   }
 
   void VisitFunctionCallExpr(const FunctionCall& exp) override {
     output_ << exp.callee_name() << "(";
     for (auto it = exp.arguments().begin(); it != exp.arguments().end(); ++it) {
-      (*it)->Visit(this);
+      Walk(**it);
     }
     output_ << ")";
   }
@@ -166,26 +167,26 @@ class PrintVisitor : public AstVisitor {
     output_ << "(";
     for (auto it = exp.parameters().begin(); it != exp.parameters().end();
          ++it) {
-      (*it).first->Visit(this);
+      Walk(*(*it).first);
       output_ << " ";
-      (*it).second.Visit(this);
+      Walk((*it).second);
       if (std::next(it) != exp.parameters().end()) {
         output_ << ", ";
       }
     }
     output_ << ") : ";
-    exp.type().Visit(this);
+    Walk(exp.type());
     output_ << " {";
-    exp.function_body().Visit(this);
+    Walk(exp.function_body());
     output_ << "return ";
-    exp.retval().Visit(this);
+    Walk(exp.retval());
     output_ << "; }";
   }
 
   void VisitTypeDef(const TypeDef & typeDef) override {
     output_ << "struct " << typeDef.type_name() << " {\n";
     for (auto & decl : typeDef.fields()) {
-      decl.Visit(this);
+      Walk(decl);
     }
     output_ << "\n};";
   }
@@ -194,11 +195,11 @@ class PrintVisitor : public AstVisitor {
     // output_ << "Program(";
     for (auto it = exp.function_defs().begin(); it != exp.function_defs().end();
          ++it) {
-      (*it)->Visit(this);
+      Walk(**it);
     }
-    exp.statements().Visit(this);
+    Walk(exp.statements());
     output_ << " output ";
-    exp.arithmetic_exp().Visit(this);
+    Walk(exp.arithmetic_exp());
     output_ << ";";
   }
 
@@ -0,0 +1,90 @@
+#include "frontend/source_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace cs160::frontend {
+
+namespace {
+
+std::system_error lastError(const std::string &what) {
+  return std::system_error{errno, std::generic_category(), what};
+}
+
+}  // anonymous namespace
+
+SourceFile::SourceFile(const std::string &path) {
+  int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw lastError("cannot open " + path);
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    auto error = lastError("cannot stat " + path);
+    if (fd != STDIN_FILENO) {
+      close(fd);
+    }
+    throw error;
+  }
+
+  if (S_ISREG(info.st_mode) && info.st_size > 0) {
+    auto size = static_cast<size_t>(info.st_size);
+    auto addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      mapping = addr;
+      mappingSize = size;
+      // the lexer reads the text front to back
+      madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+      text_ = std::string_view(static_cast<const char *>(mapping), size);
+    }
+  }
+
+  if (!mapping) {
+    // pipes, terminals and the like cannot be mapped, read them instead
+    try {
+      readAll(fd);
+    } catch (...) {
+      if (fd != STDIN_FILENO) {
+        close(fd);
+      }
+      throw;
+    }
+    text_ = buffer;
+  }
+
+  // the mapping stays valid after closing the file
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+}
+
+SourceFile::~SourceFile() {
+  if (mapping) {
+    munmap(mapping, mappingSize);
+  }
+}
+
+void SourceFile::readAll(int fd) {
+  const size_t chunkSize = 1 << 16;
+  while (true) {
+    auto oldSize = buffer.size();
+    buffer.resize(oldSize + chunkSize);
+    auto n = read(fd, &buffer[oldSize], chunkSize);
+    if (n < 0 && errno == EINTR) {
+      buffer.resize(oldSize);
+      continue;
+    }
+    if (n < 0) {
+      throw lastError("cannot read the input");
+    }
+    buffer.resize(oldSize + n);
+    if (n == 0) {
+      return;
+    }
+  }
+}
+
+}  // namespace cs160::frontend
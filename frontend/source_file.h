@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace cs160::frontend {
+
+// The text of an L2 source file. Regular files are mapped into memory
+// read-only, so the lexer runs over the mapping without copying the file.
+// Inputs that cannot be mapped, such as pipes or the standard input (given as
+// "-"), are read into a buffer instead.
+class SourceFile final {
+ public:
+  // Throws std::system_error if the file cannot be opened or read.
+  explicit SourceFile(const std::string &path);
+  ~SourceFile();
+
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+
+  // The program text, valid as long as this object is alive
+  std::string_view text() const { return text_; }
+
+  // Whether the text is a memory mapping of the file
+  bool isMapped() const { return mapping != nullptr; }
+
+ private:
+  // Read the rest of given file descriptor into the buffer
+  void readAll(int fd);
+
+  void *mapping = nullptr;
+  size_t mappingSize = 0;
+  std::string buffer;
+  std::string_view text_;
+};
+
+}  // namespace cs160::frontend
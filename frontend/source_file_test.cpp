@@ -0,0 +1,75 @@
+#define CATCH_CONFIG_MAIN
+
+#include "frontend/source_file.h"
+#include "catch2/catch.hpp"
+
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+using namespace cs160::frontend;
+
+namespace {
+
+// A file with given contents that is removed at the end of the test
+struct TemporaryFile {
+  std::string path;
+
+  explicit TemporaryFile(const std::string &contents) {
+    char name[] = "/tmp/source_file_test_XXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    close(fd);
+    path = name;
+    std::ofstream(path) << contents;
+  }
+  ~TemporaryFile() { unlink(path.c_str()); }
+};
+
+}  // namespace
+
+TEST_CASE("Regular files are mapped", "[source_file]") {
+  TemporaryFile file{"int x;\nx := 1;\noutput x;\n"};
+  SourceFile source{file.path};
+  REQUIRE(source.isMapped());
+  REQUIRE(source.text() == "int x;\nx := 1;\noutput x;\n");
+}
+
+TEST_CASE("Empty files are read", "[source_file]") {
+  // there is nothing to map
+  TemporaryFile file{""};
+  SourceFile source{file.path};
+  REQUIRE(!source.isMapped());
+  REQUIRE(source.text().empty());
+}
+
+TEST_CASE("Pipes are read", "[source_file]") {
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  // more than one read and more than the pipe holds at once
+  std::string contents;
+  for (int i = 0; contents.size() < 300000; ++i) {
+    contents += "x := x + " + std::to_string(i) + ";\n";
+  }
+  std::thread writer([&] {
+    for (size_t done = 0; done < contents.size();) {
+      auto n = write(fds[1], contents.data() + done, contents.size() - done);
+      if (n <= 0) {
+        break;
+      }
+      done += n;
+    }
+    close(fds[1]);
+  });
+
+  SourceFile source{"/dev/fd/" + std::to_string(fds[0])};
+  writer.join();
+  close(fds[0]);
+  REQUIRE(!source.isMapped());
+  REQUIRE(source.text() == contents);
+}
+
+TEST_CASE("Missing files throw", "[source_file]") {
+  REQUIRE_THROWS_AS(SourceFile{"/nonexistent/program.l2"}, std::system_error);
+}
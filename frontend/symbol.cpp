@@ -0,0 +1,48 @@
+#include "frontend/symbol.h"
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace cs160::frontend {
+
+namespace {
+
+// The global string interner. Strings live in a deque so the views used as
+// keys stay valid as the interner grows.
+struct Interner {
+  std::deque<std::string> strings;
+  std::unordered_map<std::string_view, uint32_t> ids;
+
+  Interner() {
+    // id 0 is reserved for the empty string, the default symbol
+    add("");
+  }
+
+  uint32_t add(std::string_view s) {
+    auto it = ids.find(s);
+    if (it != ids.end()) {
+      return it->second;
+    }
+    auto id = static_cast<uint32_t>(strings.size());
+    strings.emplace_back(s);
+    ids.emplace(strings.back(), id);
+    return id;
+  }
+};
+
+// Constructed on first use so that symbols can be created during static
+// initialization
+Interner& interner() {
+  static Interner instance;
+  return instance;
+}
+
+}  // anonymous namespace
+
+uint32_t Symbol::intern(std::string_view s) { return interner().add(s); }
+
+const std::string& Symbol::str() const { return interner().strings[id_]; }
+
+uint32_t Symbol::count() { return interner().strings.size(); }
+
+}  // namespace cs160::frontend
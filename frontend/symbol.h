@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace cs160::frontend {
+
+// An interned identifier or type name. All symbols are handed out by a global
+// interner that maps each distinct string to a dense integer id, so comparing
+// and hashing symbols is integer work. The default symbol is the empty string.
+//
+// Symbols convert implicitly from strings, which interns the string.
+class Symbol final {
+ public:
+  Symbol() = default;
+  Symbol(std::string_view s) : id_(intern(s)) {}
+  Symbol(const std::string& s) : Symbol(std::string_view{s}) {}
+  Symbol(const char* s) : Symbol(std::string_view{s}) {}
+
+  // Get the symbol with given id. The id should come from id() of an
+  // existing symbol.
+  static Symbol fromId(uint32_t id) {
+    Symbol result;
+    result.id_ = id;
+    return result;
+  }
+
+  // The dense integer id of this symbol
+  uint32_t id() const { return id_; }
+
+  // The interned string. The reference is valid until the program exits.
+  const std::string& str() const;
+
+  bool operator==(Symbol that) const { return id_ == that.id_; }
+  bool operator!=(Symbol that) const { return id_ != that.id_; }
+  bool operator<(Symbol that) const { return id_ < that.id_; }
+
+  // Number of distinct symbols interned so far
+  static uint32_t count();
+
+ private:
+  // Look up or add given string in the global interner
+  static uint32_t intern(std::string_view s);
+
+  uint32_t id_ = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& out, Symbol symbol) {
+  return out << symbol.str();
+}
+
+inline std::string operator+(const std::string& lhs, Symbol rhs) {
+  return lhs + rhs.str();
+}
+
+inline std::string operator+(Symbol lhs, const std::string& rhs) {
+  return lhs.str() + rhs;
+}
+
+}  // namespace cs160::frontend
+
+namespace std {
+
+template <>
+struct hash<cs160::frontend::Symbol> {
+  size_t operator()(cs160::frontend::Symbol symbol) const {
+    return symbol.id();
+  }
+};
+
+}  // namespace std
@@ -73,30 +73,37 @@ void expectTokenType(TokenType expected, TokenType actual) {
   }
 }
 
-const std::string& Token::stringValue() const {
-  if (type_ != TokenType::Id && type_ != TokenType::Type) {
+void expectStringTokenType(TokenType actual) {
+  if (actual != TokenType::Id && actual != TokenType::Type) {
     throw TokenMismatchError{
         std::string{"expected a string-holding token type, found "} +
-        tokenTypeToString(type_)};
+        tokenTypeToString(actual)};
   }
+}
 
-  return std::get<std::string>(*value_);
+std::string_view Token::stringValue() const {
+  expectStringTokenType(type_);
+  return text_;
+}
+Symbol Token::symbolValue() const {
+  expectStringTokenType(type_);
+  return Symbol::fromId(value_);
 }
 int Token::intValue() const {
   expectTokenType(TokenType::Num, type_);
-  return std::get<int>(*value_);
+  return value_;
 }
 RelOp Token::relOpValue() const {
   expectTokenType(TokenType::RelOp, type_);
-  return std::get<RelOp>(*value_);
+  return static_cast<RelOp>(value_);
 }
 ArithOp Token::arithOpValue() const {
   expectTokenType(TokenType::ArithOp, type_);
-  return std::get<ArithOp>(*value_);
+  return static_cast<ArithOp>(value_);
 }
 LBinOp Token::logicBinOpValue() const {
   expectTokenType(TokenType::LBinOp, type_);
-  return std::get<LBinOp>(*value_);
+  return static_cast<LBinOp>(value_);
 }
 
 // Helper functions for converting operators to string
@@ -143,32 +150,39 @@ const char* opToString(LBinOp op) {
 std::string Token::toString() const {
   std::ostringstream s;
   s << '<' << tokenTypeToString(type_);
-  if (value_) {
-    s << ',';
-    if (auto str = std::get_if<std::string>(&*value_)) {
-      s << *str;
-    } else if (auto n = std::get_if<int>(&*value_)) {
-      s << *n;
-    } else if (auto op = std::get_if<RelOp>(&*value_)) {
-      s << opToString(*op);
-    } else if (auto op = std::get_if<ArithOp>(&*value_)) {
-      s << opToString(*op);
-    } else if (auto op = std::get_if<LBinOp>(&*value_)) {
-      s << opToString(*op);
-    } else {
-      throw std::logic_error{
-          "Exhausted all values a token may hold. This case should be "
-          "unreachable."};
-    }
+  switch (type_) {
+    case TokenType::Id:
+    case TokenType::Type:
+      s << ',' << text_;
+      break;
+    case TokenType::Num:
+      s << ',' << value_;
+      break;
+    case TokenType::RelOp:
+      s << ',' << opToString(relOpValue());
+      break;
+    case TokenType::ArithOp:
+      s << ',' << opToString(arithOpValue());
+      break;
+    case TokenType::LBinOp:
+      s << ',' << opToString(logicBinOpValue());
+      break;
+    default:
+      // other tokens do not hold a value
+      break;
   }
   s << '>';
 
   return s.str();
 }
 
-Token Token::makeId(std::string name) { return Token(TokenType::Id, name); }
+Token Token::makeId(std::string_view name) {
+  return Token(TokenType::Id, name, Symbol{name});
+}
 Token Token::makeNum(int value) { return Token(TokenType::Num, value); }
-Token Token::makeType(std::string name) { return Token(TokenType::Type, name); }
+Token Token::makeType(std::string_view name) {
+  return Token(TokenType::Type, name, Symbol{name});
+}
 Token Token::makeIf() { return Token(TokenType::If); }
 Token Token::makeElse() { return Token(TokenType::Else); }
 Token Token::makeWhile() { return Token(TokenType::While); }
@@ -196,15 +210,19 @@ Token Token::makeNew() { return Token(TokenType::New); }
 
 Token::Token(TokenType type) : type_(type) {}
 
-Token::Token(TokenType type, std::string value) : type_(type), value_(value) {}
+Token::Token(TokenType type, std::string_view text, Symbol symbol)
+    : type_(type), text_(text), value_(static_cast<int>(symbol.id())) {}
 
 Token::Token(TokenType type, int value) : type_(type), value_(value) {}
 
-Token::Token(TokenType type, RelOp value) : type_(type), value_(value) {}
+Token::Token(TokenType type, RelOp value)
+    : type_(type), value_(static_cast<int>(value)) {}
 
-Token::Token(TokenType type, ArithOp value) : type_(type), value_(value) {}
+Token::Token(TokenType type, ArithOp value)
+    : type_(type), value_(static_cast<int>(value)) {}
 
-Token::Token(TokenType type, LBinOp value) : type_(type), value_(value) {}
+Token::Token(TokenType type, LBinOp value)
+    : type_(type), value_(static_cast<int>(value)) {}
 
 std::ostream& operator<<(std::ostream& out, const Token& tok) {
   return out << tok.toString();
@@ -1,11 +1,12 @@
 #pragma once
 
 #include <iostream>
-#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
-#include <variant>
+#include "frontend/symbol.h"
 
 namespace cs160::frontend {
 
@@ -69,6 +70,11 @@ struct TokenMismatchError : public std::logic_error {
 };
 
 // Tokens in our language L1. The lexer will output a sequence of Token objects.
+//
+// Tokens are small trivially copyable records. Id and Type tokens do not own
+// their lexemes, they refer to the program text given to the lexer (or to the
+// string literal given to makeId/makeType), so that text must outlive them.
+// Their names are also interned when the token is made, see symbolValue().
 class Token final {
  public:
   // BEGIN getters
@@ -77,8 +83,11 @@ class Token final {
   TokenType type() const { return type_; }
 
   // Get string value inside the token. Throws TokenMismatchError if token type
-  // is not an Id or Type
-  const std::string& stringValue() const;
+  // is not an Id or Type. The result is a view into the token's source text.
+  std::string_view stringValue() const;
+  // Get the interned name inside the token. Throws TokenMismatchError if token
+  // type is not an Id or Type.
+  Symbol symbolValue() const;
   // Get integer value inside the token. Throws TokenMismatchError if token type
   // is not Num.
   int intValue() const;
@@ -97,9 +106,9 @@ class Token final {
   std::string toString() const;
 
   // BEGIN static methods to build tokens in a type-safe manner
-  static Token makeId(std::string name);
+  static Token makeId(std::string_view name);
   static Token makeNum(int value);
-  static Token makeType(std::string name);
+  static Token makeType(std::string_view name);
   static Token makeIf();
   static Token makeElse();
   static Token makeWhile();
@@ -128,9 +137,7 @@ class Token final {
 
   // Equality operators
   bool operator==(const Token& that) const {
-    // std::cout << tokenTypeToString(this->type_) << ' ' <<
-    // tokenTypeToString(that.type_) << ' ' << this->value_ << ' ' << that.value_
-    // << std::endl;
+    // names are interned so equal names have equal values
     return this->type_ == that.type_ && this->value_ == that.value_;
   }
 
@@ -139,7 +146,7 @@ class Token final {
  private:
   // BEGIN private constructors for different kinds of values a token may carry
   explicit Token(TokenType type);
-  Token(TokenType type, std::string value);
+  Token(TokenType type, std::string_view text, Symbol symbol);
   Token(TokenType type, int value);
   Token(TokenType type, RelOp value);
   Token(TokenType type, ArithOp value);
@@ -149,12 +156,18 @@ class Token final {
   // This is the type of the token.
   TokenType type_;
 
-  // This is the value held inside the token, it depends on the token type.
-  std::optional<std::variant<std::string, int, RelOp, ArithOp, LBinOp>> value_;
+  // The lexeme of Id and Type tokens, empty for other token types.
+  std::string_view text_;
 
-  friend class std::hash<Token>;
+  // The value of Num tokens, the symbol id of Id and Type tokens, or the
+  // operator held inside ArithOp, RelOp and LBinOp tokens. It is 0 for other
+  // token types.
+  int value_ = 0;
 };
 
+static_assert(std::is_trivially_copyable_v<Token>,
+              "tokens should be cheap to copy");
+
 // Stream operator for printing
 std::ostream& operator<<(std::ostream& out, const Token& tok);
 
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+#include "frontend/token.h"
+
+namespace cs160::frontend {
+
+// A pull-based source of tokens. Consumers look ahead with peek() and consume
+// tokens one by one with advance(), so a source may produce tokens on demand.
+class TokenStream {
+ public:
+  virtual ~TokenStream() {}
+
+  // Get the k-th token ahead without consuming it, k starts from 1. Returns
+  // nullopt if the stream ends before that token.
+  virtual std::optional<Token> peek(size_t k = 1) = 0;
+
+  // Consume the next token
+  virtual void advance() = 0;
+};
+
+// A token stream over an already lexed sequence of tokens
+class VectorTokenStream final : public TokenStream {
+ public:
+  explicit VectorTokenStream(std::vector<Token> tokens)
+      : tokens(std::move(tokens)) {}
+
+  std::optional<Token> peek(size_t k = 1) override {
+    if (head + k - 1 >= tokens.size()) {
+      return std::nullopt;
+    }
+    return tokens[head + k - 1];
+  }
+
+  void advance() override {
+    if (head == tokens.size()) {
+      throw std::logic_error{"Advancing past the end of the token stream"};
+    }
+    ++head;
+  }
+
+ private:
+  const std::vector<Token> tokens;
+  // index of the next token
+  size_t head = 0;
+};
+
+}  // namespace cs160::frontend
@@ -223,3 +223,18 @@ TEST_CASE("toString", "[token]") {
   CHECK(Token::makeNil().toString() == "<Nil>");
   CHECK(Token::makeStruct().toString() == "<Struct>");
 }
+
+TEST_CASE("interned names", "[token]") {
+  std::string programText = "x y x";
+  auto x1 = Token::makeId(std::string_view(programText).substr(0, 1));
+  auto y = Token::makeId(std::string_view(programText).substr(2, 1));
+  auto x2 = Token::makeId(std::string_view(programText).substr(4, 1));
+
+  CHECK(x1.symbolValue() == x2.symbolValue());
+  CHECK(x1.symbolValue() != y.symbolValue());
+  CHECK(x1.symbolValue() == Symbol{"x"});
+  CHECK(x1.symbolValue().str() == "x");
+  CHECK(Token::makeType("int").symbolValue() == Symbol{"int"});
+  CHECK(Symbol{}.str() == "");
+  REQUIRE_THROWS_AS(Token::makeNum(3).symbolValue(), TokenMismatchError);
+}
@@ -1,91 +1,1075 @@
 //https://en.wikipedia.org/wiki/Cheney%27s_algorithm
 #include "gc.h"
 
-#include <cassert>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+// The header word of an object: bit 0 is set while the object has not been
+// forwarded, bit i + 1 is set if field i is a pointer and the number of fields
+// is in the top 8 bits. Only fields 0 to 21 have a bit, objects with a pointer
+// in a later field are wide instead: bit 23 is set, bits 1 to 22 hold a number
+// of bitmap words that start the object and bit j of bitmap word w is set if
+// field 32 * w + j is a pointer. Once an object is copied its header word
+// holds the address of the copy instead, which always has bit 0 clear.
+namespace {
+
+bool isForwarded(intptr_t header) {
+  return (header & 1) == 0;
+}
+
+int32_t fieldCount(intptr_t header) {
+  return static_cast<uint32_t>(header) >> 24;
+}
+
+bool isWide(intptr_t header) {
+  return (header >> 23) & 1;
+}
+
+int32_t bitmapWords(intptr_t header) {
+  return (header >> 1) & ((1 << 22) - 1);
+}
+
+bool isPointerField(const intptr_t* object, intptr_t header, int32_t i) {
+  if (!isWide(header)) {
+    return i < 22 && ((header >> (i + 1)) & 1);
+  }
+  return i / 32 < bitmapWords(header) &&
+         ((static_cast<uint32_t>(object[i / 32]) >> (i % 32)) & 1);
+}
 
-#include <iomanip>
-#include <sstream>
+intptr_t* asObject(intptr_t word) {
+  return reinterpret_cast<intptr_t*>(word);
+}
+
+// Copy an object and its header word to `to`, and leave a forwarding pointer
+// to the copy in the old header word
+intptr_t* copyTo(intptr_t* object, intptr_t* to) {
+  int32_t size = fieldCount(object[-1]) + 1;
+  for (int32_t i = 0; i < size; ++i) {
+    to[i] = object[i - 1];
+  }
+  object[-1] = reinterpret_cast<intptr_t>(to + 1);
+  return to + 1;
+}
+
+// Call `visit` with each pointer field of the object whose header word is at
+// `scan`, returns the address right after the object
+template <class Visit>
+intptr_t* scanObject(intptr_t* scan, Visit visit) {
+  intptr_t header = *scan;
+  int32_t fields = fieldCount(header);
+  intptr_t* object = scan + 1;
+  for (int32_t i = 0; i < fields; ++i) {
+    if (isPointerField(object, header, i)) {
+      visit(object[i]);
+    }
+  }
+  return object + fields;
+}
 
-using std::unordered_set;
+}  // namespace
 
-GcSemiSpace::GcSemiSpace(intptr_t* frame_ptr, int heap_size_in_words) {
+intptr_t* L2AllocPtr;
+intptr_t* L2AllocLimit;
+uint8_t* L2CardTable;
+
+GarbageCollector::GarbageCollector(intptr_t* frame_ptr,
+                                   const intptr_t* stack_maps_table) {
   base = frame_ptr;
-  heapbase = (intptr_t*) malloc(heap_size_in_words*4);
-  heapcur = heapbase;
-  from = 0;
-  totalheapwords = heap_size_in_words;
+
+  intptr_t count = *stack_maps_table++;
+  for (intptr_t i = 0; i < count; ++i) {
+    intptr_t return_addr = *stack_maps_table++;
+    intptr_t num_slots = *stack_maps_table++;
+    std::vector<int32_t> slots(stack_maps_table, stack_maps_table + num_slots);
+    stack_maps_table += num_slots;
+    stack_maps.emplace(return_addr, std::move(slots));
+  }
+}
+
+void GarbageCollector::setTelemetry(GcTelemetry* telemetry) {
+  this->telemetry = telemetry;
+  alloc_start = L2AllocPtr;
+  words_allocated_elsewhere = 0;
+}
+
+void GarbageCollector::collectionStarted() {
+  if (telemetry == nullptr) {
+    return;
+  }
+  collection_start_ns = GcTelemetry::now();
+  words_allocated = (L2AllocPtr - alloc_start) + words_allocated_elsewhere;
+}
+
+void GarbageCollector::collectionFinished(size_t words_copied, size_t live_words) {
+  if (telemetry == nullptr) {
+    return;
+  }
+  size_t words_in_use = last_live_words + words_allocated;
+  telemetry->record({GcTelemetry::now() - collection_start_ns, words_copied,
+                     words_allocated,
+                     words_in_use ? std::min(1.0, double(live_words) / words_in_use) : 1.0});
+  alloc_start = L2AllocPtr;
+  words_allocated_elsewhere = 0;
+  last_live_words = live_words;
+}
+
+void GarbageCollector::initCardTable(intptr_t* start, size_t words) {
+  card_bias = reinterpret_cast<uintptr_t>(start) >> CardShift;
+  uintptr_t last = reinterpret_cast<uintptr_t>(start + words) >> CardShift;
+  cards.assign(last - card_bias + 1, 0);
+  L2CardTable = cards.data() - card_bias;
+}
+
+const std::vector<int32_t>& GarbageCollector::slotsOf(intptr_t return_addr) const {
+  auto slots = stack_maps.find(return_addr);
+  if (slots == stack_maps.end()) {
+    // Every call the L2 program makes has a stack map, so this is a frame we
+    // don't know how to scan and any pointer we miss would be left dangling.
+    fprintf(stderr, "No stack map for return address %p\n", (void*)return_addr);
+    abort();
+  }
+  return slots->second;
+}
+
+// Large object space
+
+LargeObjectSpace::LargeObjectSpace(intptr_t* start, size_t bytes)
+    : start(start), end(start + bytes / sizeof(intptr_t)), page(sysconf(_SC_PAGESIZE)) {
+  if (bytes > 0) {
+    free_ranges.emplace(reinterpret_cast<uintptr_t>(start), bytes);
+  }
+}
+
+intptr_t* LargeObjectSpace::allocate(int32_t num_words) {
+  size_t bytes = (sizeof(intptr_t) * (num_words + 1) + page - 1) / page * page;
+  // First fit
+  auto range = std::find_if(free_ranges.begin(), free_ranges.end(),
+                            [&](auto& free) { return free.second >= bytes; });
+  if (range == free_ranges.end()) {
+    return nullptr;
+  }
+  uintptr_t address = range->first;
+  size_t rest = range->second - bytes;
+  free_ranges.erase(range);
+  if (rest > 0) {
+    free_ranges.emplace(address + bytes, rest);
+  }
+
+  void* memory = reinterpret_cast<void*>(address);
+  if (mprotect(memory, bytes, PROT_READ | PROT_WRITE) != 0) {
+    throw std::bad_alloc();
+  }
+  intptr_t* object = static_cast<intptr_t*>(memory) + 1;
+  objects[object].bytes = bytes;
+  return object;
+}
+
+bool LargeObjectSpace::mark(intptr_t* object) {
+  return !objects.at(object).marked.exchange(true);
+}
+
+void LargeObjectSpace::sweep(size_t& live_objects, size_t& live_words) {
+  for (auto object = objects.begin(); object != objects.end();) {
+    if (object->second.marked) {
+      object->second.marked = false;
+      ++live_objects;
+      live_words += fieldCount(object->first[-1]) + 1;
+      ++object;
+      continue;
+    }
+    // Drop the pages and make the range inaccessible again. Unlike munmap
+    // this keeps the addresses reserved, so the card table stays valid for
+    // them and nothing else can be mapped there.
+    uintptr_t address = reinterpret_cast<uintptr_t>(object->first - 1);
+    size_t bytes = object->second.bytes;
+    madvise(object->first - 1, bytes, MADV_DONTNEED);
+    mprotect(object->first - 1, bytes, PROT_NONE);
+    object = objects.erase(object);
+
+    auto next = free_ranges.emplace(address, bytes).first;
+    auto after = std::next(next);
+    if (after != free_ranges.end() && next->first + next->second == after->first) {
+      next->second += after->second;
+      free_ranges.erase(after);
+    }
+    if (next != free_ranges.begin()) {
+      auto before = std::prev(next);
+      if (before->first + before->second == next->first) {
+        before->second += next->second;
+        free_ranges.erase(next);
+      }
+    }
+  }
+}
+
+// Allocation profile
+
+AllocationProfile::AllocationProfile(const intptr_t* table, const uint64_t* allocations)
+    : allocations(allocations) {
+  intptr_t count = *table++;
+  for (intptr_t i = 0; i < count; ++i, table += 2) {
+    sites.push_back({reinterpret_cast<const char*>(table[1]), static_cast<int32_t>(table[0])});
+  }
+}
+
+void AllocationProfile::countSurvivors(const intptr_t* start, const intptr_t* end) {
+  for (const intptr_t* scan = start; scan < end; scan += fieldCount(*scan) + 1) {
+    countSurvivor(scan + 1);
+  }
+}
+
+void AllocationProfile::countSurvivor(const intptr_t* object) {
+  // The site is in the last field, which only a tagged object of the site's
+  // size has. That rules out the dummy objects of the parallel collector.
+  int32_t fields = fieldCount(object[-1]);
+  if (fields == 0) {
+    return;
+  }
+  uintptr_t site = object[fields - 1];
+  if (site < sites.size() && sites[site].words == fields) {
+    ++sites[site].survivors;
+  }
+}
+
+void AllocationProfile::writeReport(std::ostream& out) const {
+  std::vector<size_t> order(sites.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  auto bytes = [&](size_t i) { return allocations[i] * sites[i].words * sizeof(intptr_t); };
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return bytes(a) > bytes(b); });
+
+  out << "allocations\tbytes\tsurvivors\tsite\n";
+  for (size_t i : order) {
+    out << allocations[i] << "\t" << bytes(i) << "\t" << sites[i].survivors << "\t"
+        << sites[i].name << "\n";
+  }
+}
+
+// Telemetry
+
+GcTelemetry::GcTelemetry() : start_ns(now()) {}
+
+uint64_t GcTelemetry::now() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return uint64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+void GcTelemetry::record(const Collection& collection) {
+  // Claim the oldest slot, older records are overwritten
+  ring[collections.fetch_add(1, std::memory_order_relaxed) % Capacity] = collection;
+  total_pause_ns.fetch_add(collection.pause_ns, std::memory_order_relaxed);
+  total_words_copied.fetch_add(collection.words_copied, std::memory_order_relaxed);
+  total_words_allocated.fetch_add(collection.words_allocated, std::memory_order_relaxed);
+  uint64_t max = max_pause_ns.load(std::memory_order_relaxed);
+  while (collection.pause_ns > max &&
+         !max_pause_ns.compare_exchange_weak(max, collection.pause_ns,
+                                             std::memory_order_relaxed)) {
+  }
+}
+
+void GcTelemetry::writeJson(std::ostream& out) const {
+  uint64_t count = collections.load();
+  size_t recorded = std::min<uint64_t>(count, Capacity);
+  std::vector<uint64_t> pauses;
+  double survival = 0;
+  for (size_t i = 0; i < recorded; ++i) {
+    pauses.push_back(ring[i].pause_ns);
+    survival += ring[i].survival_rate;
+  }
+  std::sort(pauses.begin(), pauses.end());
+  auto percentile = [&](double p) -> uint64_t {
+    return pauses.empty() ? 0 : pauses[size_t(p * (pauses.size() - 1) + 0.5)];
+  };
+
+  double elapsed_s = (now() - start_ns) / 1e9;
+  double pause_s = total_pause_ns.load() / 1e9;
+  uint64_t bytes_allocated = total_words_allocated.load() * sizeof(intptr_t);
+  out << "{\"collections\": " << count
+      << ", \"pause_ns\": {\"p50\": " << percentile(0.5)
+      << ", \"p99\": " << percentile(0.99) << ", \"max\": " << max_pause_ns.load()
+      << ", \"total\": " << total_pause_ns.load() << "}"
+      << ", \"elapsed_ns\": " << uint64_t(elapsed_s * 1e9)
+      << ", \"gc_overhead\": " << (elapsed_s > 0 ? pause_s / elapsed_s : 0)
+      << ", \"bytes_copied\": " << total_words_copied.load() * sizeof(intptr_t)
+      << ", \"bytes_allocated\": " << bytes_allocated
+      << ", \"allocation_rate_bytes_per_s\": "
+      << (elapsed_s > pause_s ? bytes_allocated / (elapsed_s - pause_s) : 0)
+      << ", \"mean_survival_rate\": " << (recorded ? survival / recorded : 0) << "}\n";
+}
+
+// Heap sizing
+
+HeapSizingPolicy::HeapSizingPolicy(int32_t min_heap_words, int32_t max_heap_words,
+                                   double target_gc_overhead)
+    : min_heap_words(min_heap_words),
+      max_heap_words(std::max(min_heap_words, max_heap_words)),
+      target_gc_overhead(target_gc_overhead) {}
+
+void HeapSizingPolicy::collectionStarted() {
+  collection_start = Clock::now();
 }
 
+int32_t HeapSizingPolicy::collectionFinished(size_t live_words, int32_t heap_words) {
+  auto now = Clock::now();
+  double gc_time = std::chrono::duration<double>(now - collection_start).count();
+  double mutator_time =
+      std::chrono::duration<double>(collection_start - last_collection_end).count();
+  last_collection_end = now;
 
+  double sample = gc_time / std::max(gc_time + mutator_time, 1e-9);
+  gc_overhead = gc_overhead < 0 ? sample : (gc_overhead + sample) / 2;
 
-void GcSemiSpace::collect(intptr_t* frame) {
-  intptr_t* newheap = (intptr_t*) malloc(totalheapwords*4);
-  heapcur = newheap;
-  scan = newheap;
-  from = 0;
-  if (rootset.size() > 0) {
-    rootset.clear();
+  double size = heap_words;
+  if (gc_overhead > target_gc_overhead) {
+    size *= 2;
+  } else if (gc_overhead < target_gc_overhead / 2) {
+    size *= 0.75;
   }
-  from = 0;
-  while (frame != base) {
-    frame = frame - 12;
-    copy(frame);
+  // Copying more than a third of the heap each time is a sign it's too small
+  size = std::max(size, 3.0 * live_words);
+  size = std::clamp(size, double(min_heap_words), double(max_heap_words));
+  return static_cast<int32_t>(size) & ~1;
+}
+
+// Semispace collector
+
+GcSemiSpace::GcSemiSpace(intptr_t* frame_ptr, int heap_size_in_words,
+                         int gc_threads, int max_heap_size_in_words,
+                         const intptr_t* stack_maps_table)
+    : GarbageCollector(frame_ptr, stack_maps_table),
+      gc_threads(std::max(gc_threads, 1)) {
+  semispace_words = heap_size_in_words / 2;
+  max_semispace_words = std::max(max_heap_size_in_words / 2, semispace_words);
+
+  // Reserve room for both semispaces at their largest, each starting on a
+  // page so it can be released on its own, followed by the large objects
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t semispace_bytes = sizeof(intptr_t) * max_semispace_words;
+  semispace_stride = (semispace_bytes + page - 1) / page * page / sizeof(intptr_t);
+  size_t large_object_bytes = 2 * semispace_stride * sizeof(intptr_t);
+  reservation_bytes = std::max<size_t>(4 * semispace_stride * sizeof(intptr_t), page);
+  void* memory = mmap(nullptr, reservation_bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  heap = static_cast<intptr_t*>(memory);
+  from_space = heap;
+  to_space = heap + semispace_stride;
+  L2AllocPtr = from_space;
+  L2AllocLimit = from_space + semispace_words;
+
+  intptr_t* large_object_start = heap + 2 * semispace_stride;
+  mprotect(large_object_start, large_object_bytes, PROT_NONE);
+  large_objects.emplace(large_object_start, large_object_bytes);
+  // Nothing reads the cards, but the barrier of the L2 program still marks them
+  initCardTable(heap, 4 * semispace_stride);
+}
+
+GcSemiSpace::~GcSemiSpace() {
+  munmap(heap, reservation_bytes);
+}
+
+void GcSemiSpace::profileLive() {
+  profileSurvivors(from_space, L2AllocPtr);
+  large_objects->forEachObject([this](intptr_t* object) { profileSurvivor(object); });
+}
+
+void GcSemiSpace::flip() {
+  std::swap(from_space, to_space);
+  L2AllocLimit = from_space + semispace_words;
+  // The next collection writes the to-space from the start, so its old
+  // contents can go. The pages read back as zeros if they are touched again.
+  madvise(to_space, semispace_stride * sizeof(intptr_t), MADV_DONTNEED);
+}
+
+void GcSemiSpace::grow(int32_t size) {
+  int32_t used = L2AllocPtr - from_space;
+  while (used + size > semispace_words && semispace_words < max_semispace_words) {
+    semispace_words = std::min(2 * semispace_words, max_semispace_words);
   }
-  while (scan < heapcur) {
-    intptr_t item = *(scan + 4);
-    copy(item);
-    scan = scan + 4;
+  L2AllocLimit = from_space + semispace_words;
+}
+
+void GcSemiSpace::resize(int32_t words) {
+  int32_t used = L2AllocPtr - from_space;
+  semispace_words = std::clamp(words, used, max_semispace_words);
+  L2AllocLimit = from_space + semispace_words;
+  // Give back the pages past the end of a smaller semispace
+  size_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t end = reinterpret_cast<uintptr_t>(from_space + semispace_words);
+  uintptr_t first_page = (end + page - 1) / page * page;
+  uintptr_t stride_end = reinterpret_cast<uintptr_t>(from_space + semispace_stride);
+  if (first_page < stride_end) {
+    madvise(reinterpret_cast<void*>(first_page), stride_end - first_page, MADV_DONTNEED);
+  }
+}
+
+intptr_t* GcSemiSpace::forward(intptr_t* object) {
+  if (object == nullptr) {
+    return nullptr;
+  }
+  if (large_objects->contains(object)) {
+    if (large_objects->mark(object)) {
+      large_gray.push_back(object);
+    }
+    return object;
+  }
+  if (isForwarded(object[-1])) {
+    return asObject(object[-1]);
+  }
+  intptr_t* copy = copyTo(object, L2AllocPtr);
+  L2AllocPtr += fieldCount(copy[-1]) + 1;
+  return copy;
+}
+
+void GcSemiSpace::collect(intptr_t* frame, intptr_t return_addr) {
+  collectionStarted();
+  if (gc_threads > 1) {
+    collectParallel(frame, return_addr);
+    return;
+  }
+
+  L2AllocPtr = to_space;
+  L2AllocLimit = to_space + semispace_words;
+
+  auto forwardSlot = [this](intptr_t& slot) {
+    slot = reinterpret_cast<intptr_t>(forward(asObject(slot)));
+  };
+  // The roots are the pointer slots of each L2 frame
+  forEachRoot(frame, return_addr, forwardSlot);
+
+  // Large objects are scanned in place
+  size_t live_objects = 0;
+  intptr_t* scan = to_space;
+  while (scan < L2AllocPtr || !large_gray.empty()) {
+    if (scan < L2AllocPtr) {
+      scan = scanObject(scan, forwardSlot);
+      ++live_objects;
+    } else {
+      intptr_t* object = large_gray.back();
+      large_gray.pop_back();
+      scanObject(object - 1, forwardSlot);
+    }
   }
-  heapbase = newheap;
+
+  size_t live_words = L2AllocPtr - to_space;
+  size_t words_copied = live_words;
+  large_objects->sweep(live_objects, live_words);
+  flip();
+  profileLive();
+  collectionFinished(words_copied, live_words);
+  ReportGCStats(live_objects, live_words);
 }
 
+// Parallel copying
+
+namespace {
 
-intptr_t* GcSemiSpace::copy(intptr_t* object) {
-  if (*(object-4) & 0x1 == 1) { //not a valid forwarding pointer, copy me!
-    intptr_t* temp = heapcur;
-    heapcur = heapcur + sizeof(object);
-    *temp = *object;
-    *(object-4) = *temp;
-    return (object-4);
+// Turn [from, to) into dead objects without pointers so the space stays
+// walkable
+void fillGap(intptr_t* from, intptr_t* to) {
+  while (from < to) {
+    intptr_t words = std::min<intptr_t>(to - from, 256);
+    *from = ((words - 1) << 24) | 1;
+    if (words > 1) {
+      // Not an allocation site, see AllocationProfile
+      from[words - 1] = -1;
+    }
+    from += words;
   }
-  return NULL;
 }
 
+}  // namespace
+
+struct GcSemiSpace::Worker {
+  intptr_t* tlab = nullptr;
+  intptr_t* tlab_end = nullptr;
+  // Copies whose fields still point to the from-space. The owner pushes and
+  // pops at the back, other workers steal from the front.
+  std::mutex lock;
+  std::deque<intptr_t*> gray;
+  std::atomic<size_t> gray_size{0};
+  std::vector<intptr_t*> roots;
+  size_t live_objects = 0;
+  size_t live_words = 0;
+
+  void push(intptr_t* object) {
+    std::lock_guard<std::mutex> guard(lock);
+    gray.push_back(object);
+    gray_size.store(gray.size(), std::memory_order_release);
+  }
+
+  bool pop(intptr_t*& object) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (gray.empty()) {
+      return false;
+    }
+    object = gray.back();
+    gray.pop_back();
+    gray_size.store(gray.size(), std::memory_order_release);
+    return true;
+  }
+
+  bool steal(intptr_t*& object) {
+    if (gray_size.load(std::memory_order_acquire) == 0) {
+      return false;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    if (gray.empty()) {
+      return false;
+    }
+    object = gray.front();
+    gray.pop_front();
+    gray_size.store(gray.size(), std::memory_order_release);
+    return true;
+  }
+};
 
+intptr_t* GcSemiSpace::allocateInTlab(Worker& worker, int32_t size) {
+  if (worker.tlab + size > worker.tlab_end) {
+    fillGap(worker.tlab, worker.tlab_end);
+    // If the heap may grow, the chunks can spill over the end of the
+    // to-space, Alloc grows the heap to match after the collection
+    intptr_t* end = to_space + semispace_words;
+    intptr_t* hard_end = to_space + max_semispace_words;
+    intptr_t* top = tlab_top.load();
+    intptr_t* new_top;
+    do {
+      if (top + size > hard_end) {
+        throw OutOfMemoryError();
+      }
+      // Hand out smaller chunks as the space runs out so the unused ends of
+      // the other workers' chunks don't waste much
+      int32_t chunk = std::min<int32_t>(TlabWords, (end - top) / (2 * gc_threads));
+      new_top = std::min(top + std::max(chunk, size), hard_end);
+    } while (!tlab_top.compare_exchange_weak(top, new_top));
+    worker.tlab = top;
+    worker.tlab_end = new_top;
+  }
+  intptr_t* result = worker.tlab;
+  worker.tlab += size;
+  return result;
+}
 
-void GcSemiSpace::reset() {
-  from = 0;
-  base = NULL;
-  scan = NULL;
-  if (rootset.size() > 0) {
-    rootset.clear();
+intptr_t* GcSemiSpace::forward(intptr_t* object, Worker& worker) {
+  if (object == nullptr) {
+    return nullptr;
+  }
+  if (large_objects->contains(object)) {
+    if (large_objects->mark(object)) {
+      worker.push(object);
+    }
+    return object;
+  }
+  intptr_t header = __atomic_load_n(&object[-1], __ATOMIC_ACQUIRE);
+  if (isForwarded(header)) {
+    return asObject(header);
+  }
+  // Copy first, then try to claim the object. The fields can't change while
+  // the program is stopped, so a losing copy is just thrown away.
+  int32_t size = fieldCount(header) + 1;
+  intptr_t* to = allocateInTlab(worker, size);
+  to[0] = header;
+  std::copy(object, object + size - 1, to + 1);
+  if (__atomic_compare_exchange_n(&object[-1], &header, reinterpret_cast<intptr_t>(to + 1),
+                                  false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    ++worker.live_objects;
+    worker.live_words += size;
+    worker.push(to + 1);
+    return to + 1;
   }
-  stacksize = 0;
-  heapbase = NULL;
-  heapcur = NULL;
-  stacksize = 0;
+  // Another worker won, `header` is its forwarding pointer now
+  worker.tlab -= size;
+  return asObject(header);
 }
 
-bool GcSemiSpace::checkspace(int numwords) {
-  if (from + numwords + 1 >= totalheapwords) {
+void GcSemiSpace::work(Worker& worker, std::vector<Worker>& workers) {
+  auto forwardSlot = [&](intptr_t& slot) {
+    slot = reinterpret_cast<intptr_t>(forward(asObject(slot), worker));
+  };
+  auto next = [&](intptr_t*& object) {
+    if (worker.pop(object)) {
+      return true;
+    }
+    for (auto& victim : workers) {
+      if (&victim != &worker && victim.steal(object)) {
+        return true;
+      }
+    }
     return false;
+  };
+
+  try {
+    for (intptr_t* root : worker.roots) {
+      forwardSlot(*root);
+    }
+    while (true) {
+      intptr_t* object;
+      if (next(object)) {
+        scanObject(object - 1, forwardSlot);
+        continue;
+      }
+      // Only a worker that isn't idle can make more work, so once all of
+      // them are idle the collection is done
+      ++idle_workers;
+      while (true) {
+        if (idle_workers.load() == gc_threads || overflowed.load()) {
+          return;
+        }
+        bool work_left = std::any_of(workers.begin(), workers.end(), [](Worker& w) {
+          return w.gray_size.load(std::memory_order_acquire) != 0;
+        });
+        if (work_left) {
+          --idle_workers;
+          break;
+        }
+        std::this_thread::yield();
+      }
+    }
+  } catch (const OutOfMemoryError&) {
+    overflowed = true;
+  }
+}
+
+void GcSemiSpace::collectParallel(intptr_t* frame, intptr_t return_addr) {
+  std::vector<Worker> workers(gc_threads);
+  size_t next_worker = 0;
+  forEachRoot(frame, return_addr, [&](intptr_t& slot) {
+    workers[next_worker++ % workers.size()].roots.push_back(&slot);
+  });
+
+  tlab_top = to_space;
+  idle_workers = 0;
+  overflowed = false;
+  std::vector<std::thread> threads;
+  for (int i = 1; i < gc_threads; ++i) {
+    threads.emplace_back([&, i] { work(workers[i], workers); });
+  }
+  work(workers[0], workers);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (overflowed) {
+    throw OutOfMemoryError();
+  }
+
+  size_t live_objects = 0;
+  size_t live_words = 0;
+  for (auto& worker : workers) {
+    fillGap(worker.tlab, worker.tlab_end);
+    live_objects += worker.live_objects;
+    live_words += worker.live_words;
+  }
+
+  size_t words_copied = live_words;
+  large_objects->sweep(live_objects, live_words);
+  L2AllocPtr = tlab_top;
+  flip();
+  profileLive();
+  collectionFinished(words_copied, live_words);
+  ReportGCStats(live_objects, live_words);
+}
+
+void GcSemiSpace::collectAndResize(intptr_t* frame, intptr_t return_addr) {
+  if (sizing) {
+    sizing->collectionStarted();
+  }
+  collect(frame, return_addr);
+  if (sizing) {
+    resize(sizing->collectionFinished(L2AllocPtr - from_space, 2 * semispace_words) / 2);
+  }
+}
+
+intptr_t* GcSemiSpace::allocateLarge(int32_t num_words, intptr_t* frame,
+                                     intptr_t return_addr) {
+  if (collect_every_allocation) {
+    collectAndResize(frame, return_addr);
+  }
+  intptr_t* object = large_objects->allocate(num_words);
+  if (object == nullptr) {
+    collectAndResize(frame, return_addr);
+    object = large_objects->allocate(num_words);
+  }
+  if (object == nullptr) {
+    throw OutOfMemoryError();
+  }
+  words_allocated_elsewhere += num_words + 1;
+  return allocated(object);
+}
+
+intptr_t* GcSemiSpace::Alloc(int32_t num_words, intptr_t* curr_frame_ptr,
+                             intptr_t return_addr) {
+  if (num_words + 1 >= LargeObjectWords) {
+    return allocateLarge(num_words, curr_frame_ptr, return_addr);
+  }
+  // The L2 program only calls in here once the object doesn't fit, but
+  // check again anyway so that Alloc is still usable on its own.
+  if (mustCollect(num_words + 1)) {
+    collectAndResize(curr_frame_ptr, return_addr);
+    grow(num_words + 1);
+  }
+  if (L2AllocPtr + num_words + 1 > L2AllocLimit) {
+    throw OutOfMemoryError();
+  }
+  intptr_t* object = L2AllocPtr + 1;
+  L2AllocPtr += num_words + 1;
+  return allocated(object);
+}
+
+// Generational collector
+
+namespace {
+
+// Round a number of words up to whole cards
+int32_t cardAligned(int32_t words) {
+  int32_t card_words = CardBytes / sizeof(intptr_t);
+  return (words + card_words - 1) / card_words * card_words;
+}
+
+}  // namespace
+
+GcGenerational::GcGenerational(intptr_t* frame_ptr, int heap_size_in_words,
+                               int nursery_size, int promotion_age,
+                               const intptr_t* stack_maps_table)
+    : GarbageCollector(frame_ptr, stack_maps_table), promotion_age(promotion_age) {
+  nursery_words = nursery_size < 0 ? heap_size_in_words / 8 : nursery_size;
+  old_words = (heap_size_in_words - 2 * nursery_words) / 2;
+  if (old_words < 0) {
+    throw std::invalid_argument("The nursery does not fit in the heap");
+  }
+  // Each space starts on a card boundary, so a card never mixes objects of
+  // different spaces. The padding is not part of the heap size.
+  int32_t nursery_stride = cardAligned(nursery_words);
+  int32_t old_stride = cardAligned(old_words);
+  size_t heap_words = 2 * (nursery_stride + old_stride);
+  heap = static_cast<intptr_t*>(
+      aligned_alloc(CardBytes, std::max<size_t>(heap_words * sizeof(intptr_t), CardBytes)));
+  nursery_start = nursery_from = heap;
+  nursery_to = heap + nursery_stride;
+  nursery_end = nursery_to + nursery_stride;
+  old_from = nursery_end;
+  old_to = old_from + old_stride;
+  old_alloc = old_from;
+  ages.resize(2 * nursery_stride);
+
+  initCardTable(heap, heap_words);
+  first_object.resize(cards.size());
+  L2AllocPtr = nursery_from;
+  L2AllocLimit = nursery_from + nursery_words;
+}
+
+GcGenerational::~GcGenerational() {
+  free(heap);
+}
+
+intptr_t* GcGenerational::evacuate(intptr_t* object) {
+  // Only objects in the current nursery semispace move, this also skips nil
+  if (object < nursery_from || object >= nursery_from + nursery_words) {
+    return object;
+  }
+  if (isForwarded(object[-1])) {
+    return asObject(object[-1]);
+  }
+  int32_t size = fieldCount(object[-1]) + 1;
+  int32_t age = ages[object - 1 - nursery_start] + 1;
+  if (age >= promotion_age || nursery_alloc + size > nursery_to + nursery_words) {
+    recordOldObject(old_alloc);
+    intptr_t* copy = copyTo(object, old_alloc);
+    old_alloc += size;
+    return copy;
+  }
+  intptr_t* copy = copyTo(object, nursery_alloc);
+  ages[nursery_alloc - nursery_start] = age;
+  nursery_alloc += size;
+  return copy;
+}
+
+void GcGenerational::scanCard(size_t i, intptr_t* end) {
+  intptr_t* low = cardStart(i);
+  intptr_t* high = std::min(cardStart(i + 1), end);
+  // Objects may start on an earlier card and reach into this one
+  size_t k = i;
+  while (first_object[k] == nullptr || first_object[k] > low) {
+    --k;
+  }
+
+  bool young = false;
+  for (intptr_t* object = first_object[k]; object < high;) {
+    object = scanObject(object, [&](intptr_t& slot) {
+      if (&slot >= low && &slot < high) {
+        slot = reinterpret_cast<intptr_t>(evacuate(asObject(slot)));
+        young = young || isYoung(asObject(slot));
+      }
+    });
+  }
+  // The card stays dirty while it refers to survivors in the nursery
+  cards[i] = young;
+}
+
+void GcGenerational::collectMinor(intptr_t* frame, intptr_t return_addr) {
+  // In the worst case every young object is promoted, fall back to a major
+  // collection if the old space can't take them.
+  if (L2AllocPtr - nursery_from > old_from + old_words - old_alloc) {
+    collectMajor(frame, return_addr);
+    return;
+  }
+
+  collectionStarted();
+  nursery_alloc = nursery_to;
+  intptr_t* promoted_start = old_alloc;
+  intptr_t* promoted = old_alloc;
+  auto evacuateSlot = [this](intptr_t& slot) {
+    slot = reinterpret_cast<intptr_t>(evacuate(asObject(slot)));
+  };
+
+  forEachRoot(frame, return_addr, evacuateSlot);
+  // Old objects that had a pointer stored into them since the last collection
+  // are on dirty cards
+  if (promoted > old_from) {
+    for (size_t i = cardIndex(old_from), last = cardIndex(promoted - 1); i <= last; ++i) {
+      if (cards[i]) {
+        scanCard(i, promoted);
+      }
+    }
+  }
+
+  // Scan both the survivors and the promoted objects until neither has
+  // anything left to copy. Promoted objects are old now, so the cards of
+  // their fields that point to survivors are marked.
+  size_t live_objects = 0;
+  intptr_t* scan_young = nursery_to;
+  while (scan_young < nursery_alloc || promoted < old_alloc) {
+    for (; scan_young < nursery_alloc; ++live_objects) {
+      scan_young = scanObject(scan_young, evacuateSlot);
+    }
+    for (; promoted < old_alloc; ++live_objects) {
+      promoted = scanObject(promoted, [&](intptr_t& slot) {
+        evacuateSlot(slot);
+        if (isYoung(asObject(slot))) {
+          cards[cardIndex(&slot)] = 1;
+        }
+      });
+    }
+  }
+
+  size_t words_copied = (nursery_alloc - nursery_to) + (old_alloc - promoted_start);
+  size_t live_words = (nursery_alloc - nursery_to) + (old_alloc - old_from);
+  std::swap(nursery_from, nursery_to);
+  L2AllocPtr = nursery_alloc;
+  L2AllocLimit = nursery_from + nursery_words;
+  // Objects allocated from here on haven't survived anything yet
+  std::fill(ages.begin() + (L2AllocPtr - nursery_start),
+            ages.begin() + (L2AllocLimit - nursery_start), 0);
+  profileSurvivors(nursery_from, nursery_alloc);
+  profileSurvivors(promoted_start, old_alloc);
+  collectionFinished(words_copied, live_words);
+  ReportGCStats(live_objects, live_words);
+}
+
+intptr_t* GcGenerational::promote(intptr_t* object) {
+  if (object == nullptr) {
+    return nullptr;
+  }
+  if (isForwarded(object[-1])) {
+    return asObject(object[-1]);
+  }
+  int32_t size = fieldCount(object[-1]) + 1;
+  if (old_alloc + size > old_to + old_words) {
+    // The live objects of both generations don't fit in the old space
+    throw OutOfMemoryError();
+  }
+  recordOldObject(old_alloc);
+  intptr_t* copy = copyTo(object, old_alloc);
+  old_alloc += size;
+  return copy;
+}
+
+void GcGenerational::collectMajor(intptr_t* frame, intptr_t return_addr) {
+  collectionStarted();
+  old_alloc = old_to;
+  std::fill(first_object.begin() + cardIndex(old_to),
+            first_object.begin() + cardIndex(old_to + cardAligned(old_words)), nullptr);
+  auto promoteSlot = [this](intptr_t& slot) {
+    slot = reinterpret_cast<intptr_t>(promote(asObject(slot)));
+  };
+
+  forEachRoot(frame, return_addr, promoteSlot);
+  size_t live_objects = 0;
+  for (intptr_t* scan = old_to; scan < old_alloc; ++live_objects) {
+    scan = scanObject(scan, promoteSlot);
+  }
+
+  // Everything is old now, so no card refers to the nursery
+  std::swap(old_from, old_to);
+  std::fill(cards.begin(), cards.end(), 0);
+  std::fill(ages.begin(), ages.end(), 0);
+  L2AllocPtr = nursery_from;
+  L2AllocLimit = nursery_from + nursery_words;
+  profileSurvivors(old_from, old_alloc);
+  collectionFinished(old_alloc - old_from, old_alloc - old_from);
+  ReportGCStats(live_objects, old_alloc - old_from);
+}
+
+intptr_t* GcGenerational::allocateOld(int32_t size, intptr_t* frame,
+                                      intptr_t return_addr) {
+  if (collect_every_allocation || old_alloc + size > old_from + old_words) {
+    collectMajor(frame, return_addr);
+  }
+  if (old_alloc + size > old_from + old_words) {
+    throw OutOfMemoryError();
+  }
+  recordOldObject(old_alloc);
+  intptr_t* object = old_alloc + 1;
+  old_alloc += size;
+  words_allocated_elsewhere += size;
+  return allocated(object);
+}
+
+intptr_t* GcGenerational::Alloc(int32_t num_words, intptr_t* curr_frame_ptr,
+                                intptr_t return_addr) {
+  int32_t size = num_words + 1;
+  // Objects that can never fit in the nursery go straight to the old space
+  if (size > nursery_words) {
+    return allocateOld(size, curr_frame_ptr, return_addr);
+  }
+  if (mustCollect(size)) {
+    collectMinor(curr_frame_ptr, return_addr);
+  }
+  // The survivors may have left too little room, a major collection empties
+  // the nursery
+  if (L2AllocPtr + size > L2AllocLimit) {
+    collectMajor(curr_frame_ptr, return_addr);
+  }
+  intptr_t* object = L2AllocPtr + 1;
+  L2AllocPtr += size;
+  return allocated(object);
+}
+
+// Mark-compact collector
+
+GcMarkCompact::GcMarkCompact(intptr_t* frame_ptr, int heap_size_in_words,
+                             const intptr_t* stack_maps_table)
+    : GarbageCollector(frame_ptr, stack_maps_table) {
+  heap_words = heap_size_in_words;
+  heap = static_cast<intptr_t*>(malloc(sizeof(intptr_t) * heap_words));
+  size_t blocks = (heap_words + BlockWords - 1) / BlockWords;
+  live_words.resize(blocks);
+  block_destination.resize(blocks);
+  L2AllocPtr = heap;
+  L2AllocLimit = heap + heap_words;
+  // Nothing reads the cards, but the barrier of the L2 program still marks them
+  initCardTable(heap, heap_words);
+}
+
+GcMarkCompact::~GcMarkCompact() {
+  free(heap);
+}
+
+void GcMarkCompact::mark(intptr_t* object) {
+  mark_stack.push_back(object);
+  while (!mark_stack.empty()) {
+    intptr_t* next = mark_stack.back();
+    mark_stack.pop_back();
+    if (next == nullptr || isMarked(next - 1)) {
+      continue;
+    }
+    // The tag is left alone, the bitmap records that the object is live
+    size_t first = next - 1 - heap;
+    size_t size = fieldCount(next[-1]) + 1;
+    for (size_t i = first; i < first + size; ++i) {
+      live_words[i / BlockWords] |= uint32_t(1) << (i % BlockWords);
+    }
+    scanObject(next - 1, [this](intptr_t& slot) {
+      mark_stack.push_back(asObject(slot));
+    });
   }
-  return true;
 }
 
+intptr_t* GcMarkCompact::forwardingAddress(intptr_t* object) const {
+  if (object == nullptr) {
+    return nullptr;
+  }
+  // Live words before the header in the same block go to the same place
+  size_t i = object - 1 - heap;
+  uint32_t before = live_words[i / BlockWords] & ((uint32_t(1) << (i % BlockWords)) - 1);
+  return block_destination[i / BlockWords] + __builtin_popcount(before) + 1;
+}
+
+void GcMarkCompact::collect(intptr_t* frame, intptr_t return_addr) {
+  collectionStarted();
+  std::fill(live_words.begin(), live_words.end(), 0);
+  forEachRoot(frame, return_addr, [this](intptr_t& slot) { mark(asObject(slot)); });
+
+  intptr_t* destination = heap;
+  for (size_t block = 0; block < live_words.size(); ++block) {
+    block_destination[block] = destination;
+    destination += __builtin_popcount(live_words[block]);
+  }
+
+  auto forwardSlot = [this](intptr_t& slot) {
+    slot = reinterpret_cast<intptr_t>(forwardingAddress(asObject(slot)));
+  };
+  forEachRoot(frame, return_addr, forwardSlot);
+
+  // Every object up to the allocation pointer has a valid header, dead ones
+  // included, so the heap can be walked in address order. Fix the pointers
+  // first because sliding overwrites the headers of dead objects.
+  intptr_t* end = L2AllocPtr;
+  for (intptr_t* scan = heap; scan < end;) {
+    intptr_t* next = scan + fieldCount(*scan) + 1;
+    if (isMarked(scan)) {
+      scanObject(scan, forwardSlot);
+    }
+    scan = next;
+  }
+
+  size_t live_objects = 0;
+  size_t words_copied = 0;
+  for (intptr_t* scan = heap; scan < end;) {
+    int32_t size = fieldCount(*scan) + 1;
+    if (isMarked(scan)) {
+      intptr_t* target = forwardingAddress(scan + 1) - 1;
+      if (target != scan) {
+        std::copy(scan, scan + size, target);
+        words_copied += size;
+      }
+      ++live_objects;
+    }
+    scan += size;
+  }
+
+  L2AllocPtr = destination;
+  L2AllocLimit = heap + heap_words;
+  profileSurvivors(heap, destination);
+  collectionFinished(words_copied, destination - heap);
+  ReportGCStats(live_objects, destination - heap);
+}
 
-intptr_t* GcSemiSpace::Alloc(int32_t num_words, intptr_t * curr_frame_ptr) {
-  if (checkspace(num_words) == false) {
-    collect(curr_frame_ptr);
+intptr_t* GcMarkCompact::Alloc(int32_t num_words, intptr_t* curr_frame_ptr,
+                               intptr_t return_addr) {
+  if (mustCollect(num_words + 1)) {
+    collect(curr_frame_ptr, return_addr);
   }
-  if (checkspace(num_words) == false) {
+  if (L2AllocPtr + num_words + 1 > L2AllocLimit) {
     throw OutOfMemoryError();
   }
-  intptr_t* object = heapcur;
-  heapcur = heapcur + (num_words+1)*4;
-  from = from + num_words + 1;
-  // This is a dummy return value to make the compiler happy. Return
-  // the allocated address in your implementation.
-  return object + 4;
+  intptr_t* object = L2AllocPtr + 1;
+  L2AllocPtr += num_words + 1;
+  return allocated(object);
 }
@@ -1,7 +1,16 @@
 #include <stdint.h>
 
+#include "gc_abi.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
 #include <string>
-#include <unordered_set>
+#include <unordered_map>
 #include <vector>
 
 // Called by the garbage collector after each collection to report the
@@ -13,39 +22,495 @@ struct OutOfMemoryError : public std::runtime_error {
   OutOfMemoryError() : runtime_error("Out of memory.") {}
 };
 
-// Implements a semispace garbage collector for L2 programs.
-class GcSemiSpace {
+// The stack map table emitted by the compiler in the .l2_stack_maps section.
+// It starts with the number of call sites; each call site is described by its
+// return address, the number of pointer slots in the calling frame and the
+// slots themselves as word offsets from that frame's frame pointer.
+extern "C" const intptr_t L2StackMaps[];
+
+// The free part of the current semispace is [L2AllocPtr, L2AllocLimit). The
+// compiler allocates by bumping L2AllocPtr inline and only calls 'allocate'
+// when the object does not fit, so these are the collector's allocation
+// state rather than copies of it.
+extern "C" intptr_t* L2AllocPtr;
+extern "C" intptr_t* L2AllocLimit;
+
+// The card table. Every store of a pointer into a field marks the card of
+// the field's address dirty by setting L2CardTable[address >> CardShift] to 1,
+// so the table is biased: it is only valid for addresses in the heap. The
+// card size is in gc_abi.h.
+constexpr size_t CardBytes = size_t(1) << CardShift;
+extern "C" uint8_t* L2CardTable;
+
+// Nonzero if the L2 program was compiled with the card marking barrier
+extern "C" const int32_t L2WriteBarriers;
+
+// The allocation site table emitted by the compiler for programs compiled with
+// --alloc-profile. It starts with the number of sites; each site is described
+// by the words of its objects, header included but not counting the site
+// word, and its name. That is also the field count in their headers. The program
+// counts the allocations of site i in L2AllocSiteCounts[i] and stores i in
+// the last field of the object, after the declared fields.
+extern "C" const intptr_t L2AllocSites[];
+extern "C" uint64_t L2AllocSiteCounts[];
+
+// Allocations and survivors per allocation site, for finding the `new`
+// expressions that make the GC work hardest.
+class AllocationProfile {
  public:
-  // The 'frame_ptr' argument should be the frame pointer for the stack frame of
-  // 'main', i.e., the stack frame immediately before the stack frame of 'Entry'
-  // for the L2 program. The 'heap_size' argument is the number of desired words
-  // in the heap; it should be a positive even number.
-  GcSemiSpace(intptr_t* frame_ptr, int heap_size_in_words);
-  void reset();
-  intptr_t* copy(intptr_t* object);
-  void collect(intptr_t* frame);
-  bool checkspace(int numwords);
+  AllocationProfile(const intptr_t* sites = L2AllocSites,
+                    const uint64_t* allocations = L2AllocSiteCounts);
+
+  // Whether the program was compiled with allocation sites
+  bool empty() const { return sites.empty(); }
+
+  // Count the objects laid out in [start, end) as survivors of a collection
+  void countSurvivors(const intptr_t* start, const intptr_t* end);
+  // Same for a single object, given the address of its first field
+  void countSurvivor(const intptr_t* object);
+
+  // Write a line per site, the sites that allocated the most bytes first
+  void writeReport(std::ostream& out) const;
+
+ private:
+  struct Site {
+    const char* name;
+    int32_t words;
+    uint64_t survivors = 0;
+  };
+
+  std::vector<Site> sites;
+  const uint64_t* allocations;
+};
+
+// Records what every collection cost so heap sizes can be tuned. Recording
+// only reads the clock and fills a slot of a fixed size ring buffer, so it can
+// stay on in production; the percentiles cover the last Capacity collections
+// and the totals cover all of them.
+class GcTelemetry {
+ public:
+  struct Collection {
+    uint64_t pause_ns;
+    uint64_t words_copied;
+    uint64_t words_allocated;
+    // Fraction of the words in use when the collection started that survived
+    double survival_rate;
+  };
+
+  static constexpr size_t Capacity = 4096;
+
+  GcTelemetry();
+
+  // Nanoseconds on a monotonic clock
+  static uint64_t now();
+
+  // Never blocks, collections may be recorded from any thread
+  void record(const Collection& collection);
+
+  // Write the pause percentiles, the GC overhead so far and the totals as a
+  // JSON object. Must not run concurrently with record().
+  void writeJson(std::ostream& out) const;
+
+ private:
+  std::array<Collection, Capacity> ring;
+  std::atomic<uint64_t> collections{0};
+  std::atomic<uint64_t> total_pause_ns{0};
+  std::atomic<uint64_t> max_pause_ns{0};
+  std::atomic<uint64_t> total_words_copied{0};
+  std::atomic<uint64_t> total_words_allocated{0};
+  uint64_t start_ns;
+};
+
+// The interface between the runtime and a garbage collector for L2 programs.
+class GarbageCollector {
+ public:
+  virtual ~GarbageCollector() = default;
+  GarbageCollector(const GarbageCollector&) = delete;
+  GarbageCollector& operator=(const GarbageCollector&) = delete;
+
   // Allocates num_words+1 words on the heap and returns the address of the
   // second word. The first word (at a negative offset from the returned
   // address) is intended to be the 'header word', which should be filled in by
   // the L2 program with the correct type information.
   //
   // `curr_frame_ptr` is the frame pointer for the last frame in the
-  // L2 program. It is needed for when the garbage collector is
+  // L2 program and `return_addr` is the address that frame's call to
+  // 'allocate' returns to. They are needed for when the garbage collector is
   // walking the stack.
   //
   // Throws 'OutOfMemoryError' if the heap runs out of memory.
-  intptr_t* Alloc(int32_t num_words, intptr_t * curr_frame_ptr);
+  virtual intptr_t* Alloc(int32_t num_words, intptr_t* curr_frame_ptr,
+                          intptr_t return_addr) = 0;
+
+  // Record every collection from now on in `telemetry`, or stop if it is null
+  void setTelemetry(GcTelemetry* telemetry);
+  // Count the survivors of every collection from now on in `profile`
+  void setAllocationProfile(AllocationProfile* profile) { this->profile = profile; }
+  // Collect before every allocation from now on, so that a missing root or
+  // pointer field breaks the program right away instead of whenever the heap
+  // fills up. The L2 program then calls 'allocate' for every object.
+  void collectEveryAllocation() {
+    collect_every_allocation = true;
+    L2AllocLimit = L2AllocPtr;
+  }
+
+ protected:
+  // The 'frame_ptr' argument should be the frame pointer for the stack frame of
+  // 'main', i.e., the stack frame immediately before the stack frame of 'Entry'
+  // for the L2 program. 'stack_maps' is the table described above.
+  GarbageCollector(intptr_t* frame_ptr, const intptr_t* stack_maps);
+
+  // Calls `visit` with a reference to every stack slot that holds a pointer,
+  // starting from the frame of the last L2 function.
+  template <class Visit>
+  void forEachRoot(intptr_t* frame, intptr_t return_addr, Visit visit) const {
+    // The return address pushed by a call identifies the slots of the frame
+    // that made the call.
+    while (frame != base) {
+      for (int32_t slot : slotsOf(return_addr)) {
+        visit(frame[slot]);
+      }
+      return_addr = frame[1];
+      frame = reinterpret_cast<intptr_t*>(frame[0]);
+    }
+  }
+
+  // Set up clean cards for [start, start + words) and point L2CardTable at them
+  void initCardTable(intptr_t* start, size_t words);
+
+  // Index in `cards` of the card that covers `address`, and the first word
+  // covered by card `i`
+  size_t cardIndex(const void* address) const {
+    return (reinterpret_cast<uintptr_t>(address) >> CardShift) - card_bias;
+  }
+  intptr_t* cardStart(size_t i) const {
+    return reinterpret_cast<intptr_t*>((card_bias + i) << CardShift);
+  }
+
+  // Collectors call these around each collection for the telemetry.
+  // `words_copied` counts the words moved, `live_words` all the words that
+  // survived.
+  void collectionStarted();
+  void collectionFinished(size_t words_copied, size_t live_words);
+  // Collectors call these with the objects that survived a collection
+  void profileSurvivors(const intptr_t* start, const intptr_t* end) {
+    if (profile != nullptr) {
+      profile->countSurvivors(start, end);
+    }
+  }
+  void profileSurvivor(const intptr_t* object) {
+    if (profile != nullptr) {
+      profile->countSurvivor(object);
+    }
+  }
+
+  // Whether Alloc has to collect before making room for `words` words by
+  // bumping L2AllocPtr
+  bool mustCollect(int32_t words) const {
+    return collect_every_allocation || L2AllocPtr + words > L2AllocLimit;
+  }
+  // Collectors return each new object through this, which leaves the L2
+  // program no room to allocate inline when collecting at every allocation
+  intptr_t* allocated(intptr_t* object) {
+    if (collect_every_allocation) {
+      L2AllocLimit = L2AllocPtr;
+    }
+    return object;
+  }
+
+  std::vector<uint8_t> cards;
+  bool collect_every_allocation = false;
+  // Words allocated without bumping L2AllocPtr since the last collection
+  size_t words_allocated_elsewhere = 0;
 
  private:
-  int from;
-  intptr_t* heapbase;
-  intptr_t* heapcur;
-  std::vector<intptr_t*> rootset;
+  // Pointer slots of the frame whose call returns to `return_addr`
+  const std::vector<int32_t>& slotsOf(intptr_t return_addr) const;
+
   intptr_t* base;
-  intptr_t* scan;
-  int stacksize = 0;
-  int totalheapwords;
-  // Your private methods for functionality such as garbage
-  // collection, stack walking, and copying live data should go here
+  GcTelemetry* telemetry = nullptr;
+  AllocationProfile* profile = nullptr;
+  // State of the collection being recorded: when it started, where the
+  // mutator started bumping L2AllocPtr after the previous one and the words
+  // that were in use
+  uint64_t collection_start_ns = 0;
+  intptr_t* alloc_start = nullptr;
+  size_t words_allocated = 0;
+  size_t last_live_words = 0;
+  std::unordered_map<intptr_t, std::vector<int32_t>> stack_maps;
+  uintptr_t card_bias = 0;
+};
+
+// Decides how large the heap should be after each collection. The heap grows
+// while the smoothed share of the run time spent collecting is above the
+// target, shrinks while it is well below it, and always leaves room for three
+// times the words that survived the last collection. Sizes are in words of
+// the whole heap, like the heap size given to the collectors.
+class HeapSizingPolicy {
+ public:
+  // 'target_gc_overhead' is a fraction, 0.05 means 5% of the time in the GC
+  HeapSizingPolicy(int32_t min_heap_words, int32_t max_heap_words,
+                   double target_gc_overhead);
+
+  int32_t minHeapWords() const { return min_heap_words; }
+  int32_t maxHeapWords() const { return max_heap_words; }
+
+  void collectionStarted();
+  // Returns the heap size to use until the next collection
+  int32_t collectionFinished(size_t live_words, int32_t heap_words);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  int32_t min_heap_words;
+  int32_t max_heap_words;
+  double target_gc_overhead;
+  // Exponentially smoothed GC time / total time, negative before the first
+  // collection
+  double gc_overhead = -1;
+  Clock::time_point last_collection_end = Clock::now();
+  Clock::time_point collection_start;
+};
+
+// Objects that are too big to be worth copying. Each one gets its own pages
+// in a reserved address range and never moves; a collection marks the live
+// ones and releases the pages of the rest.
+class LargeObjectSpace {
+ public:
+  // Manage the `bytes` long, page aligned range at `start`, which must be
+  // mapped without access
+  LargeObjectSpace(intptr_t* start, size_t bytes);
+
+  // Make pages for an object with a header word and `num_words` fields and
+  // return the address of its first field, or nullptr if there's no room
+  intptr_t* allocate(int32_t num_words);
+
+  bool contains(const intptr_t* object) const {
+    return object >= start && object < end;
+  }
+  // Mark a live object, returns false if it was marked already. This is safe
+  // to call from several GC threads.
+  bool mark(intptr_t* object);
+  // Release the objects that weren't marked and clear the marks of the rest.
+  // Adds the live ones to the statistics.
+  void sweep(size_t& live_objects, size_t& live_words);
+
+  // Calls `visit` with the address of the first field of every object
+  template <class Visit>
+  void forEachObject(Visit visit) const {
+    for (auto& object : objects) {
+      visit(object.first);
+    }
+  }
+
+ private:
+  struct Object {
+    size_t bytes;
+    std::atomic<bool> marked{false};
+  };
+
+  intptr_t* start;
+  intptr_t* end;
+  size_t page;
+  // Free page ranges by address, adjacent ranges are merged
+  std::map<uintptr_t, size_t> free_ranges;
+  std::unordered_map<intptr_t*, Object> objects;
+};
+
+// Implements a semispace garbage collector for L2 programs.
+//
+// With more than one GC thread the copying is done in parallel. The stack
+// roots are dealt out to the workers, each worker copies into its own chunk
+// of the to-space (its TLAB) and keeps the copies it still has to scan in a
+// deque that idle workers steal from. Whoever installs the forwarding pointer
+// in the header word with a compare-and-swap owns the copy. The unused ends
+// of the chunks are filled with dummy objects, so a parallel collection can
+// leave slightly less free space than a sequential one.
+//
+// Both semispaces live in one mmap'ed reservation that is large enough for
+// the maximum heap size. Pages are only backed by memory once they are used,
+// and the evacuated semispace is returned to the system after each
+// collection, so the resident size follows the live data.
+//
+// Objects of at least LargeObjectWords words are allocated in a large object
+// space in the same reservation instead of being copied around. It can hold as
+// many words as the largest heap.
+class GcSemiSpace : public GarbageCollector {
+ public:
+  // The 'heap_size' argument is the number of desired words in the heap; it
+  // should be a positive even number. 'gc_threads' is the number of threads
+  // that copy objects during a collection. If an object still doesn't fit
+  // after a collection, the heap doubles until it does, up to
+  // 'max_heap_size_in_words'; by default the heap doesn't grow.
+  GcSemiSpace(intptr_t* frame_ptr, int heap_size_in_words, int gc_threads = 1,
+              int max_heap_size_in_words = 0,
+              const intptr_t* stack_maps = L2StackMaps);
+  ~GcSemiSpace() override;
+
+  intptr_t* Alloc(int32_t num_words, intptr_t* curr_frame_ptr,
+                  intptr_t return_addr) override;
+
+  // Resize the heap with `policy` after each collection. The heap never grows
+  // past 'max_heap_size_in_words' whatever the policy says.
+  void setSizingPolicy(const HeapSizingPolicy& policy) { sizing = policy; }
+
+ private:
+  // The state of a GC thread during a parallel collection
+  struct Worker;
+  // Size of the to-space chunks the GC threads copy into
+  static constexpr int32_t TlabWords = 256;
+
+  // Copy the live objects reachable from the stack to the other semispace
+  void collect(intptr_t* frame, intptr_t return_addr);
+  void collectParallel(intptr_t* frame, intptr_t return_addr);
+  // Collect, then let the sizing policy, if any, pick the new heap size
+  void collectAndResize(intptr_t* frame, intptr_t return_addr);
+  // Copy a single object unless it is already copied, returns its new address
+  intptr_t* forward(intptr_t* object);
+  intptr_t* forward(intptr_t* object, Worker& worker);
+  // Run a GC thread until there is nothing left to copy
+  void work(Worker& worker, std::vector<Worker>& workers);
+  // Carve `size` words out of the worker's TLAB, getting a new one if needed
+  intptr_t* allocateInTlab(Worker& worker, int32_t size);
+  // Make the evacuated semispace the to-space and give its pages back
+  void flip();
+  // Count the objects that survived the collection that just finished
+  void profileLive();
+  // Grow the semispaces until `size` words fit after the allocation pointer
+  void grow(int32_t size);
+  // Set the size of the semispaces, keeping the objects in the current one
+  void resize(int32_t words);
+  // Allocate in the large object space, collecting if it is full
+  intptr_t* allocateLarge(int32_t num_words, intptr_t* frame, intptr_t return_addr);
+
+  intptr_t* heap;
+  int32_t semispace_words;
+  int32_t max_semispace_words;
+  // Distance between the starts of the semispaces, a whole number of pages
+  size_t semispace_stride;
+  size_t reservation_bytes;
+  std::optional<LargeObjectSpace> large_objects;
+  // Large objects marked but not scanned yet by a sequential collection
+  std::vector<intptr_t*> large_gray;
+  // The current semispace starts at from_space, see L2AllocPtr for the rest
+  intptr_t* from_space;
+  intptr_t* to_space;
+  int gc_threads;
+  // Shared state of a parallel collection: the end of the TLABs handed out
+  // so far, the number of workers that ran out of work and whether the
+  // to-space overflowed
+  std::atomic<intptr_t*> tlab_top;
+  std::atomic<int> idle_workers;
+  std::atomic<bool> overflowed;
+  std::optional<HeapSizingPolicy> sizing;
+};
+
+// Implements a generational garbage collector for L2 programs. New objects
+// are allocated in a nursery made of two semispaces. A minor collection copies
+// the live young objects to the other nursery semispace, or to the old space
+// once they have survived 'promotion_age' minor collections, so its cost
+// depends on the survivors rather than on the size of the heap. The roots of
+// a minor collection are the stack and the fields on old cards that the write
+// barrier marked dirty. When the old space fills up, a major collection copies
+// everything that is live into the other half of the old space.
+class GcGenerational : public GarbageCollector {
+ public:
+  // The heap of 'heap_size_in_words' words is split into the two nursery
+  // semispaces of 'nursery_words' words each (by default an eighth of the
+  // heap) and the two halves of the old space.
+  GcGenerational(intptr_t* frame_ptr, int heap_size_in_words,
+                 int nursery_words = -1, int promotion_age = 2,
+                 const intptr_t* stack_maps = L2StackMaps);
+  ~GcGenerational() override;
+
+  intptr_t* Alloc(int32_t num_words, intptr_t* curr_frame_ptr,
+                  intptr_t return_addr) override;
+
+ private:
+  // Evacuate the young objects reachable from the stack and dirty cards
+  void collectMinor(intptr_t* frame, intptr_t return_addr);
+  // Copy all live objects to the other half of the old space
+  void collectMajor(intptr_t* frame, intptr_t return_addr);
+  // Copy a young object to the nursery or the old space during a minor
+  // collection, returns the new address of the object
+  intptr_t* evacuate(intptr_t* object);
+  // Copy any object to the old space during a major collection
+  intptr_t* promote(intptr_t* object);
+  // Bump allocate in the old space, collecting if needed
+  intptr_t* allocateOld(int32_t size, intptr_t* frame, intptr_t return_addr);
+  // Evacuate the young objects referenced from the fields on dirty card `i`
+  // of the old objects below `end`
+  void scanCard(size_t i, intptr_t* end);
+  // Note that an object was placed in the old space at `header`
+  void recordOldObject(intptr_t* header) {
+    auto& first = first_object[cardIndex(header)];
+    if (first == nullptr) {
+      first = header;
+    }
+  }
+
+  bool isYoung(intptr_t* object) const {
+    return object >= nursery_start && object < nursery_end;
+  }
+
+  intptr_t* heap;
+  intptr_t* nursery_start;
+  intptr_t* nursery_end;
+  int32_t nursery_words;
+  int32_t old_words;
+  int32_t promotion_age;
+  // The nursery semispaces, see L2AllocPtr for the free part of nursery_from
+  intptr_t* nursery_from;
+  intptr_t* nursery_to;
+  intptr_t* nursery_alloc;
+  // The halves of the old space, old_from is in use up to old_alloc
+  intptr_t* old_from;
+  intptr_t* old_to;
+  intptr_t* old_alloc;
+  // Number of minor collections survived by the young object whose header
+  // word is at nursery_start + i
+  std::vector<uint8_t> ages;
+  // The header word of the first old object that starts on each card, the
+  // halves of the spaces start on card boundaries so this is enough to find
+  // the objects on a dirty card
+  std::vector<intptr_t*> first_object;
+};
+
+// Implements a sliding mark-compact collector for L2 programs. Unlike the
+// copying collectors it allocates from the whole heap. A collection marks the
+// words of the live objects in a bitmap, computes where each object goes from
+// the bitmap, updates the pointers and slides the live objects to the start of
+// the heap in address order. Apart from the heap it needs a bit and 1/32 of a
+// word per heap word.
+class GcMarkCompact : public GarbageCollector {
+ public:
+  GcMarkCompact(intptr_t* frame_ptr, int heap_size_in_words,
+                const intptr_t* stack_maps = L2StackMaps);
+  ~GcMarkCompact() override;
+
+  intptr_t* Alloc(int32_t num_words, intptr_t* curr_frame_ptr,
+                  intptr_t return_addr) override;
+
+ private:
+  // Bits per bitmap block, each block describes that many heap words
+  static constexpr int32_t BlockWords = 32;
+
+  void collect(intptr_t* frame, intptr_t return_addr);
+  // Mark the words of every object reachable from `object`
+  void mark(intptr_t* object);
+  // The address `object` will have after compaction
+  intptr_t* forwardingAddress(intptr_t* object) const;
+
+  bool isMarked(intptr_t* header) const {
+    size_t i = header - heap;
+    return (live_words[i / BlockWords] >> (i % BlockWords)) & 1;
+  }
+
+  intptr_t* heap;
+  int32_t heap_words;
+  // Bit i is set if heap word i belongs to a live object
+  std::vector<uint32_t> live_words;
+  // Where the first live word of each block goes
+  std::vector<intptr_t*> block_destination;
+  std::vector<intptr_t*> mark_stack;
 };
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// Constants of the runtime that the compiler builds into the code it
+// generates. The runtime and the compiler both include this header.
+
+// Log2 of the number of bytes covered by a card of the card table
+constexpr int CardShift = 9;
+
+// Objects with this many words, header included, are never allocated inline:
+// the L2 program always calls 'allocate' for them and the semispace collector
+// puts them in its large object space.
+constexpr int32_t LargeObjectWords = 128;
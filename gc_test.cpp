@@ -0,0 +1,163 @@
+#define CATCH_CONFIG_MAIN
+
+#include "gc.h"
+#include "catch2/catch.hpp"
+
+#include <memory>
+
+// The collectors don't depend on the word size, so they are tested natively
+// on a fake stack instead of under an L2 program. Every frame calls
+// 'allocate' from the same return address, which keeps its pointers in the
+// first two slots below the frame pointer.
+constexpr intptr_t ReturnAddress = 100;
+extern "C" const intptr_t L2StackMaps[] = {1, ReturnAddress, 2, -1, -2};
+extern "C" const int32_t L2WriteBarriers = 1;
+extern "C" const intptr_t L2AllocSites[] = {0};
+extern "C" uint64_t L2AllocSiteCounts[1];
+
+namespace {
+
+size_t collections = 0;
+
+// Header words as the compiler writes them
+intptr_t header(int32_t fields, uint32_t pointers = 0) {
+  return static_cast<intptr_t>(static_cast<uint32_t>(fields) << 24 | pointers << 1 | 1);
+}
+intptr_t wideHeader(int32_t fields, int32_t bitmapWords) {
+  return static_cast<intptr_t>(static_cast<uint32_t>(fields) << 24 | 1u << 23 |
+                               static_cast<uint32_t>(bitmapWords) << 1 | 1);
+}
+
+// The frame of an L2 function called from 'main', whose frame is `base`
+struct Stack {
+  intptr_t words[16] = {};
+  intptr_t* base = words + 14;
+  intptr_t* frame = words + 8;
+
+  Stack() { frame[0] = reinterpret_cast<intptr_t>(base); }
+
+  intptr_t*& slot(int32_t i) { return reinterpret_cast<intptr_t*&>(frame[-1 - i]); }
+};
+
+intptr_t* allocate(GarbageCollector& gc, Stack& stack, int32_t fields, intptr_t tag) {
+  auto object = gc.Alloc(fields, stack.frame, ReturnAddress);
+  object[-1] = tag;
+  for (int32_t i = 0; i < fields; ++i) {
+    object[i] = 0;
+  }
+  return object;
+}
+
+// Allocate like the compiler does, bumping L2AllocPtr while the object fits
+intptr_t* allocateInline(GarbageCollector& gc, Stack& stack, int32_t fields, intptr_t tag) {
+  intptr_t* object;
+  if (L2AllocPtr + fields + 1 <= L2AllocLimit) {
+    object = L2AllocPtr + 1;
+    L2AllocPtr += fields + 1;
+  } else {
+    object = gc.Alloc(fields, stack.frame, ReturnAddress);
+  }
+  object[-1] = tag;
+  for (int32_t i = 0; i < fields; ++i) {
+    object[i] = 0;
+  }
+  return object;
+}
+
+// Store a pointer into a field with the write barrier of the compiler
+void storePointer(intptr_t* object, int32_t field, intptr_t* value) {
+  object[field] = reinterpret_cast<intptr_t>(value);
+  L2CardTable[reinterpret_cast<uintptr_t>(&object[field]) >> CardShift] = 1;
+}
+
+std::unique_ptr<GarbageCollector> makeCollector(const std::string& name, intptr_t* base,
+                                                int heap_words) {
+  if (name == "generational") {
+    return std::make_unique<GcGenerational>(base, heap_words);
+  }
+  if (name == "markcompact") {
+    return std::make_unique<GcMarkCompact>(base, heap_words);
+  }
+  return std::make_unique<GcSemiSpace>(base, heap_words, name == "parallel" ? 3 : 1);
+}
+
+}  // namespace
+
+void ReportGCStats(size_t, size_t) {
+  ++collections;
+}
+
+TEST_CASE("Pointer fields of wide objects are roots", "[gc]") {
+  // 200 words with a pointer in field 150, which has no bit in the header,
+  // so the first 7 words of the object are a bitmap of its pointer fields
+  constexpr int32_t Fields = 200;
+  constexpr int32_t BitmapWords = 7;
+  constexpr int32_t Field = 150;
+
+  for (auto name : {"semispace", "parallel", "generational", "markcompact"}) {
+    SECTION(name) {
+      Stack stack;
+      auto gc = makeCollector(name, stack.base, 4096);
+      collections = 0;
+
+      auto wide = allocate(*gc, stack, Fields, wideHeader(Fields, BitmapWords));
+      wide[Field / 32] = 1 << (Field % 32);
+      stack.slot(0) = wide;
+      // allocate enough garbage to collect a few times, pointing the wide
+      // object at a new object every time
+      for (int32_t i = 0; i < 2000; ++i) {
+        auto small = allocate(*gc, stack, 2, header(2));
+        small[1] = i;
+        storePointer(stack.slot(0), Field, small);
+        allocate(*gc, stack, 30, header(30));
+        auto target = reinterpret_cast<intptr_t*>(stack.slot(0)[Field]);
+        REQUIRE(target[-1] == header(2));
+        REQUIRE(target[1] == i);
+      }
+      REQUIRE(collections > 3);
+    }
+  }
+}
+
+TEST_CASE("Collecting at every allocation", "[gc]") {
+  for (auto name : {"semispace", "parallel", "generational", "markcompact"}) {
+    SECTION(name) {
+      Stack stack;
+      auto gc = makeCollector(name, stack.base, 4096);
+      gc->collectEveryAllocation();
+      collections = 0;
+
+      // a list of 100 objects that is live at every collection
+      for (int32_t i = 0; i < 100; ++i) {
+        auto cell = allocateInline(*gc, stack, 2, header(2, 1));
+        storePointer(cell, 0, stack.slot(0));
+        cell[1] = i;
+        stack.slot(0) = cell;
+        REQUIRE(collections == static_cast<size_t>(i + 1));
+      }
+      auto cell = stack.slot(0);
+      for (int32_t i = 99; i >= 0; --i) {
+        REQUIRE(cell[-1] == header(2, 1));
+        REQUIRE(cell[1] == i);
+        cell = reinterpret_cast<intptr_t*>(cell[0]);
+      }
+      REQUIRE(cell == nullptr);
+    }
+  }
+}
+
+TEST_CASE("Collections for large objects resize the heap", "[gc]") {
+  Stack stack;
+  GcSemiSpace gc(stack.base, 4096, 1, 65536);
+  // The policy never goes below 16384 words, so the first collection that
+  // asks it grows the heap
+  gc.setSizingPolicy(HeapSizingPolicy(16384, 65536, 0.05));
+  collections = 0;
+
+  // Only large objects, so every collection starts in the large object space
+  for (int32_t i = 0; i < 1000; ++i) {
+    allocate(gc, stack, 2 * LargeObjectWords, header(2 * LargeObjectWords));
+  }
+  REQUIRE(collections > 0);
+  REQUIRE(L2AllocLimit - L2AllocPtr >= 16384 / 2);
+}
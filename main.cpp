@@ -1,21 +1,37 @@
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <sstream>
+#include <system_error>
 #include "frontend/lexer.h"
+#include "frontend/source_file.h"
 #include "frontend/parser.h"
 #include "backend/codegen.h"
+#include "backend/peephole.h"
 
 using namespace cs160::frontend;
 using namespace cs160::backend;
 
 void usage(char const* programName) {
-  std::cerr << "Usage: " << programName << " program.l2 [--gen-asm-only] output-file\n\n"
-            << "This program compiles given L2 program. If the `--gen-asm-only` option is given, it will only generate the assembly code, otherwise it will also link the assembly code with the bootstrap code and GC code to produce an executable.";
+  std::cerr << "Usage: " << programName << " program.l2 [--gen-asm-only] [--no-write-barrier] [--alloc-profile] [--peephole=rules] [--peephole-stats] output-file\n\n"
+            << "This program compiles given L2 program, use `-` as program.l2 to read it from the standard input. If the `--gen-asm-only` option is given, it will only generate the assembly code, otherwise it will also link the assembly code with the bootstrap code and GC code to produce an executable. The `--no-write-barrier` option leaves out the card marking barrier after pointer stores, such programs cannot run with the generational collector. The `--alloc-profile` option makes the program count the allocations and surviving objects of each `new` expression and report them when it ends. The `--peephole` option selects the peephole rules run on the generated code as a comma separated list, or `none`, all rules run by default. The `--peephole-stats` option prints how many times each rule fired.";
 }
 
 // Option for generating assembly only
 const std::string OnlyGenAsm{"--gen-asm-only"};
 
+// Option for leaving out write barriers
+const std::string NoWriteBarrier{"--no-write-barrier"};
+
+// Option for profiling allocation sites
+const std::string AllocProfile{"--alloc-profile"};
+
+// Option for selecting peephole rules, followed by the rule names
+const std::string Peephole{"--peephole="};
+
+// Option for printing how often each peephole rule fired
+const std::string PeepholeStats{"--peephole-stats"};
+
 // C++ compiler. We use it as linker. GCC's C++ compier is usually named `g++` on most systems.
 const std::string CPPCompiler{"g++-8"};
 
@@ -25,46 +41,81 @@ const std::string Assembler{"as"};
 int main(int argc, char* argv[]) {
   std::string outputFileName;
   bool link = true;
+  bool writeBarriers = true;
+  bool allocationProfile = false;
+  std::vector<PeepholeRule> peepholeRules = cs160::backend::peepholeRules();
+  bool peepholeStats = false;
 
-  if (argc == 3) {
-    outputFileName = argv[2];
-  } else if (argc == 4 && OnlyGenAsm == argv[2]) {
-    outputFileName = argv[3];
-    link = false;
-  } else{
+  if (argc < 3) {
     usage(argv[0]);
     return 1;
   }
+  for (int i = 2; i < argc - 1; ++i) {
+    if (OnlyGenAsm == argv[i]) {
+      link = false;
+    } else if (NoWriteBarrier == argv[i]) {
+      writeBarriers = false;
+    } else if (AllocProfile == argv[i]) {
+      allocationProfile = true;
+    } else if (std::string(argv[i]).rfind(Peephole, 0) == 0) {
+      std::vector<std::string> names;
+      std::istringstream list{argv[i] + Peephole.size()};
+      for (std::string name; std::getline(list, name, ',');) {
+        if (name != "none") {
+          names.push_back(name);
+        }
+      }
+      try {
+        peepholeRules = cs160::backend::peepholeRules(names);
+      } catch (const std::invalid_argument & e) {
+        std::cerr << e.what() << "\n\n";
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (PeepholeStats == argv[i]) {
+      peepholeStats = true;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  outputFileName = argv[argc - 1];
 
-  std::ifstream programFile{argv[1]};
-  if (!programFile.is_open()) {
+  // Map the program file into memory, or read it if it cannot be mapped
+  std::optional<SourceFile> programFile;
+  try {
+    programFile.emplace(argv[1]);
+  } catch (const std::system_error & e) {
     std::cerr << "'" << argv[1]
-              << "' does not exist or is not a regular file.\n\n";
+              << "' does not exist or cannot be read: " << e.what() << "\n\n";
     usage(argv[0]);
+    return 1;
+  }
+  auto programText = programFile->text();
 
-  }  // Read the file
-  std::string programText{std::istreambuf_iterator<char>(programFile),
-                          std::istreambuf_iterator<char>()};
-
-  // Run the lexer
-  std::cout << "Lexing the input program '" << argv[1] << "'" << std::endl;
-  Lexer lexer;
-  auto tokens = lexer.tokenize(programText);
-
-  // Run the parser
-  std::cout << "Parsing the token stream" << std::endl;
+  // Run the parser, it runs the lexer on demand
+  std::cout << "Lexing and parsing the input program '" << argv[1] << "'"
+            << std::endl;
+  LexingTokenStream tokens{programText};
   Parser parser(tokens);
   auto ast = parser.parse();
 
   if (! ast) {
-    std::cerr << "Parse error: the parser produced an empty unique_ptr" << std::endl;
+    std::cerr << "Parse error: the parser produced an empty tree" << std::endl;
     return 1;
   }
 
   // Run the code generator
   std::cout << "Generating code" << std::endl;
-  CodeGen codeGen;
-  auto insns = codeGen.generateCode(*ast);
+  CodeGen codeGen{writeBarriers, allocationProfile};
+  auto code = codeGen.generateCode(*ast);
+  PeepholeOptimizer peephole{std::move(peepholeRules)};
+  peephole.run(code);
+  if (peepholeStats) {
+    peephole.printStats(std::cout);
+  }
+  std::string assembly;
+  printAsm(code, assembly);
 
   // Write out the assembly file
   std::string asmFileName = link ? (outputFileName + ".asm") : outputFileName;
@@ -75,9 +126,7 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  for (auto & line : insns) {
-    asmFile << line << "\n";
-  } 
+  asmFile.write(assembly.data(), assembly.size());
 
   asmFile.close();
 
@@ -98,7 +147,7 @@ int main(int argc, char* argv[]) {
     std::cout << "Linking the bootstrap code with L2 program object code\n";
     // reset the command line
     cmdLine = std::ostringstream{};
-    cmdLine << CPPCompiler << " -m32 build/bootstrap.o build/gc.o " << outputFileName << ".o -o " << outputFileName;
+    cmdLine << CPPCompiler << " -m32 -pthread build/bootstrap.o build/gc.o " << outputFileName << ".o -o " << outputFileName;
     cmd = cmdLine.str();
     std::cout << "Running linker command: " << cmd << std::endl;
     // Run the linker
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Compiles the programs in tests/runtime and runs each of them under every
+# collector, collecting at every allocation. A program passes if it outputs
+# what the "// Output:" line at its top says.
+
+heap_words=65536
+failed=0
+
+for program in tests/runtime/*.l2; do
+  expected=$(sed -n 's|^// Output: ||p' "$program")
+  executable=build/$(basename "$program" .l2)
+  if ! ./build/c1 "$program" "$executable" > /dev/null; then
+    echo "FAILED: $program does not compile"
+    failed=1
+    continue
+  fi
+  for collector in semispace parallel generational markcompact; do
+    if [ "$collector" = parallel ]; then
+      output=$(L2_GC_STRESS=1 L2_GC_THREADS=3 "./$executable" $heap_words semispace 2> /dev/null)
+    else
+      output=$(L2_GC_STRESS=1 "./$executable" $heap_words $collector 2> /dev/null)
+    fi
+    if [ "$output" != "$expected" ]; then
+      echo "FAILED: $program with $collector output '$output' instead of '$expected'"
+      failed=1
+    fi
+  done
+done
+
+if [ $failed = 0 ]; then
+  echo "All runtime tests passed"
+fi
+exit $failed